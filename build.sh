@@ -2,6 +2,7 @@
 
 project_name="lloyd"
 gui_file="gui.c" # Default GUI file
+plug_files="incremental.c delaunay.c multilevel.c jobs.c density.c stochastic.c domain.c power.c grid.c grid3.c sphere.c volume.c sampling.c ensemble.c temporal.c scheduler.c kinetic.c kmeans.c assign.c filtering.c minibatch.c quantise.c locate.c dynamic.c interpolate.c" # Sources linked into the plug next to the GUI file
 
 # Check if project_name has been set properly
 if [ "$project_name" = "project_name" ]; then
@@ -22,12 +23,13 @@ compile_gui() {
 	local project_src="./src"
 	local project_build="./build"
 	local project_include="./include"
+	local plug_sources=$(for f in $gui_file $plug_files; do printf "%s/%s " "$project_src" "$f"; done)
 
 	# Compile gui
 	clang -Wall -Wextra -g -DHOTRELOAD \
 		-I$project_include/ \
 		-I$project_build/ \
-		-fPIC -shared -o $project_build/lib${project_name}.dylib.new $project_include/raylib/macos/libraylib.dylib $project_src/gui.c \
+		-fPIC -shared -o $project_build/lib${project_name}.dylib.new $project_include/raylib/macos/libraylib.dylib $plug_sources \
                 $project_include/raylib/macos/libraylib.dylib \
 		-lm -ldl -lpthread
 
@@ -62,7 +64,7 @@ compile_main() {
 watch_gui_changes() {
 	local last_gui_checksum=""
 	while true; do
-		local gui_files=$(find ./src -name 'gui.*')
+		local gui_files="$(find ./src -name 'gui.*') $(printf './src/%s ' $plug_files)"
 		local gui_checksum=$(md5 -q $gui_files)
 
 		if [ "$gui_checksum" != "$last_gui_checksum" ]; then
@@ -77,6 +79,7 @@ compile_together() {
 	local project_src="./src"
 	local project_build="./build"
 	local project_include="./include"
+	local plug_sources=$(for f in $gui_file $plug_files; do printf "%s/%s " "$project_src" "$f"; done)
 
         if [ ! -d "$project_build" ]; then
             mkdir -p "$project_build"
@@ -88,7 +91,7 @@ compile_together() {
 		-I$project_include/ \
 		-o $project_build/${project_name} \
 		$project_include/libraylib.a \
-		$project_src/gui.c $project_src/main.c \
+		$plug_sources $project_src/main.c \
 		-framework CoreVideo -framework IOKit -framework Cocoa -framework GLUT -framework OpenGL \
 		-framework Security -framework CoreServices \
          	-lm -ldl -lpthread
@@ -99,7 +102,9 @@ compile_together() {
 compile_web() {
   html_file="index"
 
-  emcc -o www/"$html_file".html src/main_web.c "src/$gui_file" \
+  local plug_sources=$(for f in $gui_file $plug_files; do printf "src/%s " "$f"; done)
+
+  emcc -o www/"$html_file".html src/main_web.c $plug_sources \
        -Os -Wall ./include/web/raylib/src/libraylib.a \
        -I. -I./include/web -L. -L/include/web/raylib/src/libraylib.a \
        -s USE_GLFW=3 -s ENVIRONMENT='web' -s ASYNCIFY -s MODULARIZE=1 -s EXPORT_ES6=1 -DPLATFORM_WEB
@@ -0,0 +1,193 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+
+#include "gui.h"
+
+// Register tile: ASSIGN_ROWS points by ASSIGN_LANES centres, held in
+// ASSIGN_ROWS * ASSIGN_LANES / 4 float4 accumulators
+#define ASSIGN_ROWS 4
+#define ASSIGN_LANES 8
+#define ASSIGN_VECTORS (ASSIGN_LANES / 4)
+// Cache blocks: a block of points is run against a block of centres, one
+// depth slice at a time, so the slice of packed centres stays in L2 and the
+// points' rows in L1
+#define ASSIGN_POINT_BLOCK 64
+#define ASSIGN_CENTRE_BLOCK 128
+#define ASSIGN_DEPTH_BLOCK 256
+#define MIN_BLOCKS_PER_JOB 1
+
+static inline int PaddedCentres(int k) {
+  return (k + ASSIGN_LANES - 1) / ASSIGN_LANES * ASSIGN_LANES;
+}
+
+uint64 PackedCentresCount(int k, int dim) {
+  return (uint64)PaddedCentres(k) * dim;
+}
+
+// Centres go into panels of ASSIGN_LANES, each stored dimension by dimension
+// so one depth step of the kernel is ASSIGN_VECTORS aligned loads. The
+// padding centres are all zero with an infinite norm, so they never win.
+// norms holds PaddedCentres(k) entries.
+void PackCentres(const float *centres, int k, int dim, float *packed,
+                 float *norms) {
+  int padded = PaddedCentres(k);
+  for (int j = 0; j < padded; j++) {
+    float *panel = &packed[(uint64)(j / ASSIGN_LANES) * dim * ASSIGN_LANES];
+    int lane = j % ASSIGN_LANES;
+    if (j >= k) {
+      for (int d = 0; d < dim; d++) {
+        panel[d * ASSIGN_LANES + lane] = 0;
+      }
+      norms[j] = INFINITY;
+      continue;
+    }
+    const float *c = &centres[(uint64)j * dim];
+    float norm = 0;
+    for (int d = 0; d < dim; d++) {
+      panel[d * ASSIGN_LANES + lane] = c[d];
+      norm += c[d] * c[d];
+    }
+    norms[j] = norm;
+  }
+}
+
+typedef struct {
+  const float *points;
+  int numPoints;
+  int dim;
+  const float *packed;
+  const float *norms;
+  int k;
+  int *nearest;
+  float *distances;
+} AssignJob;
+
+// Accumulates the dot products of up to ASSIGN_ROWS point rows with one
+// panel over depth dimensions. Missing rows repeat the first, their results
+// are ignored.
+static inline void DotTile(const float *rows[ASSIGN_ROWS], const float *panel,
+                           int depth, float4 acc[ASSIGN_ROWS][ASSIGN_VECTORS]) {
+  for (int d = 0; d < depth; d++) {
+    float4 c[ASSIGN_VECTORS];
+    memcpy(c, &panel[d * ASSIGN_LANES], sizeof(c));
+    for (int r = 0; r < ASSIGN_ROWS; r++) {
+      float x = rows[r][d];
+      float4 broadcast = {x, x, x, x};
+      for (int v = 0; v < ASSIGN_VECTORS; v++) {
+        acc[r][v] += broadcast * c[v];
+      }
+    }
+  }
+}
+
+static void RunAssignBlocks(void *data, int start, int end) {
+  AssignJob *job = (AssignJob *)data;
+  int dim = job->dim;
+  int panels = PaddedCentres(job->k) / ASSIGN_LANES;
+  int panelsPerBlock = ASSIGN_CENTRE_BLOCK / ASSIGN_LANES;
+
+  // Partial dot products of one point block against one centre block, only
+  // needed when the depth takes more than one slice
+  float4 tile[ASSIGN_POINT_BLOCK][ASSIGN_CENTRE_BLOCK / 4];
+  float best[ASSIGN_POINT_BLOCK];
+  int bestCentre[ASSIGN_POINT_BLOCK];
+
+  for (int block = start; block < end; block++) {
+    int first = block * ASSIGN_POINT_BLOCK;
+    int count = job->numPoints - first < ASSIGN_POINT_BLOCK
+                    ? job->numPoints - first
+                    : ASSIGN_POINT_BLOCK;
+    for (int i = 0; i < count; i++) {
+      best[i] = INFINITY;
+      bestCentre[i] = 0;
+    }
+
+    for (int p0 = 0; p0 < panels; p0 += panelsPerBlock) {
+      int p1 = p0 + panelsPerBlock < panels ? p0 + panelsPerBlock : panels;
+      for (int d0 = 0; d0 < dim; d0 += ASSIGN_DEPTH_BLOCK) {
+        int depth = dim - d0 < ASSIGN_DEPTH_BLOCK ? dim - d0
+                                                  : ASSIGN_DEPTH_BLOCK;
+        bool32 firstSlice = d0 == 0;
+        bool32 lastSlice = d0 + depth == dim;
+
+        for (int i = 0; i < count; i += ASSIGN_ROWS) {
+          const float *rows[ASSIGN_ROWS];
+          for (int r = 0; r < ASSIGN_ROWS; r++) {
+            int row = i + r < count ? i + r : i;
+            rows[r] = &job->points[(uint64)(first + row) * dim + d0];
+          }
+
+          for (int p = p0; p < p1; p++) {
+            const float *panel =
+                &job->packed[((uint64)p * dim + d0) * ASSIGN_LANES];
+            int column = (p - p0) * ASSIGN_VECTORS;
+            float4 acc[ASSIGN_ROWS][ASSIGN_VECTORS];
+            for (int r = 0; r < ASSIGN_ROWS; r++) {
+              for (int v = 0; v < ASSIGN_VECTORS; v++) {
+                acc[r][v] = firstSlice ? (float4){0, 0, 0, 0}
+                                       : tile[i + r][column + v];
+              }
+            }
+            DotTile(rows, panel, depth, acc);
+
+            if (!lastSlice) {
+              for (int r = 0; r < ASSIGN_ROWS && i + r < count; r++) {
+                for (int v = 0; v < ASSIGN_VECTORS; v++) {
+                  tile[i + r][column + v] = acc[r][v];
+                }
+              }
+              continue;
+            }
+
+            // Epilogue: |x|^2 is the same for every centre, so the argmin
+            // only needs |c|^2 - 2 x.c; centres arrive in index order and a
+            // tie keeps the lower one
+            const float *norms = &job->norms[p * ASSIGN_LANES];
+            for (int r = 0; r < ASSIGN_ROWS && i + r < count; r++) {
+              for (int v = 0; v < ASSIGN_VECTORS; v++) {
+                float4 value = (float4){norms[4 * v], norms[4 * v + 1],
+                                        norms[4 * v + 2], norms[4 * v + 3]} -
+                               2.0f * acc[r][v];
+                for (int lane = 0; lane < 4; lane++) {
+                  if (value[lane] < best[i + r]) {
+                    best[i + r] = value[lane];
+                    bestCentre[i + r] = p * ASSIGN_LANES + 4 * v + lane;
+                  }
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+
+    for (int i = 0; i < count; i++) {
+      job->nearest[first + i] = bestCentre[i];
+      if (job->distances) {
+        const float *x = &job->points[(uint64)(first + i) * dim];
+        float norm = 0;
+        for (int d = 0; d < dim; d++) {
+          norm += x[d] * x[d];
+        }
+        job->distances[first + i] = fmaxf(norm + best[i], 0);
+      }
+    }
+  }
+}
+
+// Nearest packed centre to each of numPoints row-major points, through
+// |x - c|^2 = |x|^2 - 2 x.c + |c|^2 with the x.c computed as a blocked matrix
+// product and the argmin taken as each tile finishes, so the point-by-centre
+// matrix is never stored. distances, if given, gets the squared distances.
+// Rounding differs from a direct difference of squares, so near-ties may
+// resolve differently than in the plain search.
+void AssignNearestBlocked(const float *points, int numPoints, int dim,
+                          const float *packed, const float *norms, int k,
+                          int *nearest, float *distances) {
+  AssignJob job = {points, numPoints, dim, packed, norms, k, nearest,
+                   distances};
+  int blocks = (numPoints + ASSIGN_POINT_BLOCK - 1) / ASSIGN_POINT_BLOCK;
+  ParallelFor(blocks, MIN_BLOCKS_PER_JOB, RunAssignBlocks, &job);
+}
@@ -0,0 +1,912 @@
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+// Ghost corners sit this many times the bounds' size from their centre, far
+// enough that no point of the bounds is closer to a ghost than to a site
+#define GHOST_DISTANCE 8.0f
+// A site inserted exactly on an edge is moved this far into the triangle
+#define INSERT_NUDGE 1e-3f
+// Edges waiting to be checked while one site is inserted
+#define MAX_PENDING_FLIPS 256
+// Larger stars than this are rare enough to fall back to a rebuild
+#define MAX_GHOST_RING 64
+
+#define NEXT(k) (((k) + 1) % 3)
+#define PREV(k) (((k) + 2) % 3)
+
+// Twice the signed area of abc, positive when counter-clockwise
+double Orient(Vector2 a, Vector2 b, Vector2 c) {
+  return ((double)b.x - a.x) * ((double)c.y - a.y) -
+         ((double)b.y - a.y) * ((double)c.x - a.x);
+}
+
+// Positive when d lies inside the circumcircle of the counter-clockwise
+// triangle abc
+double InCircle(Vector2 a, Vector2 b, Vector2 c, Vector2 d) {
+  double adx = (double)a.x - d.x, ady = (double)a.y - d.y;
+  double bdx = (double)b.x - d.x, bdy = (double)b.y - d.y;
+  double cdx = (double)c.x - d.x, cdy = (double)c.y - d.y;
+  double ad = adx * adx + ady * ady;
+  double bd = bdx * bdx + bdy * bdy;
+  double cd = cdx * cdx + cdy * cdy;
+  return adx * (bdy * cd - bd * cdy) - ady * (bdx * cd - bd * cdx) +
+         ad * (bdx * cdy - bdy * cdx);
+}
+
+Vector2 Circumcentre(Vector2 a, Vector2 b, Vector2 c) {
+  double bx = (double)b.x - a.x, by = (double)b.y - a.y;
+  double cx = (double)c.x - a.x, cy = (double)c.y - a.y;
+  double d = 2.0 * (bx * cy - by * cx);
+  if (fabs(d) < 1e-12) {
+    return (Vector2){(a.x + b.x + c.x) / 3.0f, (a.y + b.y + c.y) / 3.0f};
+  }
+  double b2 = bx * bx + by * by;
+  double c2 = cx * cx + cy * cy;
+  return (Vector2){a.x + (cy * b2 - by * c2) / d,
+                   a.y + (bx * c2 - cx * b2) / d};
+}
+
+// Builds counter-clockwise triangles with neighbour links from the site
+// triples reported by the sweep. Returns false if the triples do not form a
+// manifold triangulation, in which case the topology cannot be frozen.
+bool32 BuildTriangulation(Triangulation *tri, const SiteTriangle *sites,
+                          int numTriangles, Vertex *vertices, int numSites) {
+  tri->valid = 0;
+  tri->numTriangles = 0;
+  tri->numSites = numSites;
+  if (numTriangles > MAX_TRIANGLES || numSites > MAX_SITES) {
+    return 0;
+  }
+
+  for (int t = 0; t < numTriangles; t++) {
+    DelaunayTriangle *dt = &tri->triangles[tri->numTriangles];
+    int a = sites[t].sites[0], b = sites[t].sites[1], c = sites[t].sites[2];
+    if (a < 0 || b < 0 || c < 0 || a >= numSites || b >= numSites ||
+        c >= numSites || a == b || b == c || a == c) {
+      return 0;
+    }
+    double o = Orient(vertices[a].position, vertices[b].position,
+                      vertices[c].position);
+    if (o == 0.0) {
+      continue;
+    }
+    dt->v[0] = a;
+    dt->v[1] = (o > 0) ? b : c;
+    dt->v[2] = (o > 0) ? c : b;
+    dt->n[0] = dt->n[1] = dt->n[2] = -1;
+    tri->numTriangles++;
+  }
+
+  // Incident triangles per site
+  memset(tri->incidentOffsets, 0, (numSites + 1) * sizeof(int));
+  for (int t = 0; t < tri->numTriangles; t++) {
+    for (int k = 0; k < 3; k++) {
+      tri->incidentOffsets[tri->triangles[t].v[k] + 1]++;
+    }
+  }
+  for (int i = 0; i < numSites; i++) {
+    tri->incidentOffsets[i + 1] += tri->incidentOffsets[i];
+  }
+  int fill[MAX_SITES];
+  memcpy(fill, tri->incidentOffsets, numSites * sizeof(int));
+  for (int t = 0; t < tri->numTriangles; t++) {
+    for (int k = 0; k < 3; k++) {
+      tri->incident[fill[tri->triangles[t].v[k]]++] = t;
+    }
+  }
+
+  // Edge (a, b) of t is shared with the triangle holding (b, a)
+  for (int t = 0; t < tri->numTriangles; t++) {
+    DelaunayTriangle *dt = &tri->triangles[t];
+    for (int k = 0; k < 3; k++) {
+      int a = dt->v[(k + 1) % 3];
+      int b = dt->v[(k + 2) % 3];
+      int matches = 0;
+      for (int m = tri->incidentOffsets[b]; m < tri->incidentOffsets[b + 1];
+           m++) {
+        int u = tri->incident[m];
+        if (u == t) {
+          continue;
+        }
+        DelaunayTriangle *du = &tri->triangles[u];
+        for (int l = 0; l < 3; l++) {
+          if (du->v[(l + 1) % 3] == b && du->v[(l + 2) % 3] == a) {
+            dt->n[k] = u;
+            matches++;
+          }
+        }
+      }
+      if (matches > 1) {
+        return 0;
+      }
+    }
+  }
+
+  for (int i = 0; i < numSites; i++) {
+    tri->hullNext[i] = -1;
+    tri->siteTriangle[i] = -1;
+  }
+  for (int t = 0; t < tri->numTriangles; t++) {
+    DelaunayTriangle *dt = &tri->triangles[t];
+    for (int k = 0; k < 3; k++) {
+      tri->siteTriangle[dt->v[k]] = t;
+      if (dt->n[k] < 0) {
+        int a = dt->v[(k + 1) % 3];
+        if (tri->hullNext[a] >= 0) {
+          return 0;
+        }
+        tri->hullNext[a] = dt->v[(k + 2) % 3];
+      }
+    }
+  }
+  for (int i = 0; i < numSites; i++) {
+    if (tri->siteTriangle[i] < 0) {
+      return 0;
+    }
+  }
+
+  tri->valid = (tri->numTriangles > 0);
+  return tri->valid;
+}
+
+bool32 InitSiteGraph(SiteGraph *graph, memory_arena *arena, int capacity) {
+  memset(graph, 0, sizeof(*graph));
+  graph->capacity = capacity;
+  graph->triangles = PushArray(arena, 2 * (uint64)capacity, SiteTriangle);
+  graph->neighbourStart = PushArray(arena, capacity + 1, int);
+  // Each triangle names two neighbours for each of its corners; a site's
+  // repeats are dropped once its list is complete
+  graph->neighbours = PushArray(arena, 12 * (uint64)capacity, int);
+  graph->mark = PushArray(arena, capacity, int);
+  return graph->triangles && graph->neighbourStart && graph->neighbours &&
+         graph->mark;
+}
+
+// Collinear sites have no triangles; their Delaunay graph is the chain
+// through them in order along the line. Only ever a handful of sites, so an
+// insertion sort does.
+static void ChainSites(SiteGraph *graph, const Vertex *vertices) {
+  int n = graph->numSites;
+  int *order = graph->mark;
+  for (int i = 0; i < n; i++) {
+    order[i] = i;
+  }
+  for (int i = 1; i < n; i++) {
+    int s = order[i], j = i;
+    for (; j > 0; j--) {
+      Vector2 a = vertices[order[j - 1]].position, b = vertices[s].position;
+      if (a.x < b.x || (a.x == b.x && a.y <= b.y)) {
+        break;
+      }
+      order[j] = order[j - 1];
+    }
+    order[j] = s;
+  }
+  int *start = graph->neighbourStart;
+  memset(start, 0, (n + 1) * sizeof(int));
+  for (int i = 0; i < n; i++) {
+    start[order[i] + 1] = (i > 0) + (i + 1 < n);
+  }
+  for (int i = 0; i < n; i++) {
+    start[i + 1] += start[i];
+  }
+  for (int i = 0; i < n; i++) {
+    int at = start[order[i]];
+    if (i > 0) {
+      graph->neighbours[at++] = order[i - 1];
+    }
+    if (i + 1 < n) {
+      graph->neighbours[at] = order[i + 1];
+    }
+  }
+}
+
+// Exports the sweep's site triples as counter-clockwise triangles and every
+// site's Delaunay neighbours as CSR, in time linear in the triangles. Triples
+// that name a missing site or are flat are dropped. Returns 0 if the graph
+// is too small for the sites.
+bool32 BuildSiteGraph(SiteGraph *graph, const SiteTriangle *sites,
+                      int numTriangles, const Vertex *vertices, int numSites) {
+  graph->numSites = 0;
+  graph->numTriangles = 0;
+  graph->version++;
+  if (numSites < 0 || numSites > graph->capacity ||
+      numTriangles > 2 * graph->capacity) {
+    return 0;
+  }
+  graph->numSites = numSites;
+
+  for (int t = 0; t < numTriangles; t++) {
+    int a = sites[t].sites[0], b = sites[t].sites[1], c = sites[t].sites[2];
+    if (a < 0 || b < 0 || c < 0 || a >= numSites || b >= numSites ||
+        c >= numSites) {
+      continue;
+    }
+    double o = Orient(vertices[a].position, vertices[b].position,
+                      vertices[c].position);
+    if (o != 0.0) {
+      graph->triangles[graph->numTriangles++] =
+          (SiteTriangle){{a, o > 0 ? b : c, o > 0 ? c : b}};
+    }
+  }
+  if (graph->numTriangles == 0) {
+    ChainSites(graph, vertices);
+    return 1;
+  }
+
+  int *start = graph->neighbourStart;
+  memset(start, 0, (numSites + 1) * sizeof(int));
+  for (int t = 0; t < graph->numTriangles; t++) {
+    for (int k = 0; k < 3; k++) {
+      start[graph->triangles[t].sites[k] + 1] += 2;
+    }
+  }
+  for (int i = 0; i < numSites; i++) {
+    start[i + 1] += start[i];
+  }
+  int *fill = graph->mark;
+  memcpy(fill, start, numSites * sizeof(int));
+  for (int t = 0; t < graph->numTriangles; t++) {
+    const int *v = graph->triangles[t].sites;
+    for (int k = 0; k < 3; k++) {
+      graph->neighbours[fill[v[k]]++] = v[(k + 1) % 3];
+      graph->neighbours[fill[v[k]]++] = v[(k + 2) % 3];
+    }
+  }
+
+  // Drop the repeats, packing the lists down as they shrink. mark[s] holds
+  // the last site s was listed for, plus one.
+  memset(graph->mark, 0, numSites * sizeof(int));
+  int next = 0;
+  for (int i = 0; i < numSites; i++) {
+    int from = start[i], to = start[i + 1];
+    start[i] = next;
+    for (int e = from; e < to; e++) {
+      int s = graph->neighbours[e];
+      if (graph->mark[s] != i + 1) {
+        graph->mark[s] = i + 1;
+        graph->neighbours[next++] = s;
+      }
+    }
+  }
+  start[numSites] = next;
+  return 1;
+}
+
+// The cached connectivity is still the Delaunay triangulation of the current
+// positions as long as no triangle flipped over, every interior edge is
+// locally Delaunay and the hull stayed convex.
+bool32 IsTriangulationDelaunay(const Triangulation *tri, Vertex *vertices) {
+  for (int t = 0; t < tri->numTriangles; t++) {
+    const DelaunayTriangle *dt = &tri->triangles[t];
+    Vector2 a = vertices[dt->v[0]].position;
+    Vector2 b = vertices[dt->v[1]].position;
+    Vector2 c = vertices[dt->v[2]].position;
+    if (Orient(a, b, c) <= 0.0) {
+      return 0;
+    }
+
+    for (int k = 0; k < 3; k++) {
+      int u = dt->n[k];
+      if (u < t) {
+        continue; // hull edge, or pair already checked from u
+      }
+      const DelaunayTriangle *du = &tri->triangles[u];
+      int far = -1;
+      for (int l = 0; l < 3; l++) {
+        if (du->n[l] == t) {
+          far = du->v[l];
+        }
+      }
+      if (far < 0 || InCircle(a, b, c, vertices[far].position) > 0.0) {
+        return 0;
+      }
+    }
+  }
+
+  for (int i = 0; i < tri->numSites; i++) {
+    int j = tri->hullNext[i];
+    if (j < 0) {
+      continue;
+    }
+    int k = tri->hullNext[j];
+    if (k >= 0 && Orient(vertices[i].position, vertices[j].position,
+                         vertices[k].position) < 0.0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void ComputeCircumcentres(Triangulation *tri, Vertex *vertices) {
+  for (int t = 0; t < tri->numTriangles; t++) {
+    const DelaunayTriangle *dt = &tri->triangles[t];
+    tri->circumcentres[t] =
+        Circumcentre(vertices[dt->v[0]].position, vertices[dt->v[1]].position,
+                     vertices[dt->v[2]].position);
+  }
+}
+
+// Emits the Voronoi diagram as labelled edges: one segment between the
+// circumcentres of every pair of adjacent triangles, and an outward ray for
+// every hull edge. Returns the number of edges written.
+int VoronoiEdgesFromTriangulation(const Triangulation *tri, Vertex *vertices,
+                                  CompleteEdge *edges, int maxEdges) {
+  int count = 0;
+  for (int t = 0; t < tri->numTriangles && count < maxEdges; t++) {
+    const DelaunayTriangle *dt = &tri->triangles[t];
+    for (int k = 0; k < 3 && count < maxEdges; k++) {
+      int u = dt->n[k];
+      int a = dt->v[(k + 1) % 3];
+      int b = dt->v[(k + 2) % 3];
+      if (u >= 0 && u < t) {
+        continue;
+      }
+
+      CompleteEdge *edge = &edges[count++];
+      edge->vertices[0] = a;
+      edge->vertices[1] = b;
+      edge->endpointA = tri->circumcentres[t];
+      if (u >= 0) {
+        edge->endpointB = tri->circumcentres[u];
+      } else {
+        // Same length FinishEdge uses for unbounded edges
+        Vector2 d = Vector2Subtract(vertices[b].position,
+                                    vertices[a].position);
+        Vector2 outward = Vector2Normalize((Vector2){d.y, -d.x});
+        edge->endpointB =
+            Vector2Add(edge->endpointA, Vector2Scale(outward, 10000.0f));
+      }
+    }
+  }
+  return count;
+}
+
+void RebuildVoronoi(struct app_state *AppState) {
+  Triangulation *tri = &AppState->triangulation;
+
+  // Sweep to completion: the hull triangles have circle events far below the
+  // screen and the triangulation is only closed once all of them are seen
+  AppState->fortuneState = FortunesAlgorithm(AppState, -FLT_MAX);
+  AssociateEdgesWithVertices(AppState->fortuneState.edges,
+                             AppState->fortuneState.edgesSize,
+                             AppState->vertices, AppState->num_vertices);
+  if (AppState->siteGraph.capacity) {
+    BuildSiteGraph(&AppState->siteGraph, AppState->fortuneState.triangles,
+                   AppState->fortuneState.trianglesSize, AppState->vertices,
+                   AppState->num_vertices);
+  }
+
+  if (AppState->freezeTopology) {
+    BuildTriangulation(tri, AppState->fortuneState.triangles,
+                       AppState->fortuneState.trianglesSize,
+                       AppState->vertices, AppState->num_vertices);
+    tri->fullRebuilds++;
+  }
+}
+
+// Topology-frozen fast path: while the cached triangulation passes the
+// validity check the diagram is just its circumcentres, a linear pass with no
+// sweep. The first flip falls back to a full rebuild.
+void UpdateVoronoi(struct app_state *AppState) {
+  Triangulation *tri = &AppState->triangulation;
+
+  if (!AppState->freezeTopology || !tri->valid ||
+      tri->numSites != AppState->num_vertices ||
+      !IsTriangulationDelaunay(tri, AppState->vertices)) {
+    RebuildVoronoi(AppState);
+    return;
+  }
+
+  ComputeCircumcentres(tri, AppState->vertices);
+  AppState->fortuneState.edgesSize = VoronoiEdgesFromTriangulation(
+      tri, AppState->vertices, AppState->fortuneState.edges, MAX_EDGES);
+  tri->frozenIterations++;
+}
+
+static inline bool32 IsGhost(int v) { return v >= MAX_SITES; }
+
+static inline int Ghost(int g) { return MAX_SITES + g; }
+
+static inline double SquaredGap(Vector2 a, Vector2 b) {
+  double dx = (double)a.x - b.x, dy = (double)a.y - b.y;
+  return dx * dx + dy * dy;
+}
+
+static inline int CornerOf(const DelaunayTriangle *dt, int v) {
+  return dt->v[0] == v ? 0 : (dt->v[1] == v ? 1 : 2);
+}
+
+// Index of the edge of t shared with u
+int SharedEdge(const DelaunayTriangle *triangles, int t, int u) {
+  const DelaunayTriangle *dt = &triangles[t];
+  return dt->n[0] == u ? 0 : (dt->n[1] == u ? 1 : 2);
+}
+
+static void ReplaceNeighbour(GhostTriangulation *gt, int t, int from, int to) {
+  if (t >= 0) {
+    gt->triangles[t].n[SharedEdge(gt->triangles, t, from)] = to;
+  }
+}
+
+static inline void Link(GhostTriangulation *gt, int t, int k, int to) {
+  if (t >= 0) {
+    gt->triangles[t].n[k] = to;
+  }
+}
+
+static void MarkChanged(GhostTriangulation *gt, int v) {
+  if (!IsGhost(v) && gt->changedStamp[v] != gt->stamp) {
+    gt->changedStamp[v] = gt->stamp;
+    gt->changed[gt->numChanged++] = v;
+  }
+}
+
+static void MarkTriangle(GhostTriangulation *gt, int t) {
+  for (int k = 0; k < 3; k++) {
+    MarkChanged(gt, gt->triangles[t].v[k]);
+  }
+}
+
+static void UnmarkChanged(GhostTriangulation *gt, int v) {
+  if (gt->changedStamp[v] != gt->stamp) {
+    return;
+  }
+  gt->changedStamp[v] = gt->stamp - 1;
+  for (int c = 0; c < gt->numChanged; c++) {
+    if (gt->changed[c] == v) {
+      gt->changed[c] = gt->changed[--gt->numChanged];
+      break;
+    }
+  }
+}
+
+// Starts a new set of changed sites
+void ClearGhostChanges(GhostTriangulation *gt) {
+  gt->numChanged = 0;
+  if (++gt->stamp == 0) {
+    memset(gt->changedStamp, 0, sizeof(gt->changedStamp));
+    gt->stamp = 1;
+  }
+}
+
+// Whether p is far enough inside the ghosts for the diagram within the bounds
+// to stay exact
+bool32 InsideGhosts(const GhostTriangulation *gt, Vector2 p) {
+  Rectangle b = gt->bounds;
+  float margin = 0.5f * GHOST_DISTANCE * fmaxf(b.width, b.height);
+  return p.x >= b.x - margin && p.y >= b.y - margin &&
+         p.x <= b.x + b.width + margin && p.y <= b.y + b.height + margin;
+}
+
+// Flips the edge opposite v[k] of t. With a = v[k], edge bc and d across it,
+// t becomes (a, b, d) and its neighbour (a, d, c), a first in both so the two
+// edges facing a are edge 0. Returns the neighbour.
+int FlipGhostEdge(GhostTriangulation *gt, int t, int k) {
+  DelaunayTriangle *dt = &gt->triangles[t];
+  int u = dt->n[k];
+  DelaunayTriangle *du = &gt->triangles[u];
+  int l = SharedEdge(gt->triangles, u, t);
+
+  int a = dt->v[k], b = dt->v[NEXT(k)], c = dt->v[PREV(k)];
+  int d = du->v[l];
+  int tA = dt->n[NEXT(k)]; // across ca
+  int tB = dt->n[PREV(k)]; // across ab
+  int uA = du->n[NEXT(l)]; // across bd
+  int uB = du->n[PREV(l)]; // across dc
+
+  *dt = (DelaunayTriangle){{a, b, d}, {uA, u, tB}};
+  *du = (DelaunayTriangle){{a, d, c}, {uB, tA, t}};
+  ReplaceNeighbour(gt, tA, t, u);
+  ReplaceNeighbour(gt, uA, u, t);
+  gt->siteTriangle[a] = t;
+  gt->siteTriangle[b] = t;
+  gt->siteTriangle[d] = t;
+  gt->siteTriangle[c] = u;
+  gt->versions[t]++;
+  gt->versions[u]++;
+  // b and c lose an edge, a and d gain one
+  MarkTriangle(gt, t);
+  MarkChanged(gt, c);
+  return u;
+}
+
+static bool32 EdgeIllegal(const GhostTriangulation *gt, int t, int k) {
+  const DelaunayTriangle *dt = &gt->triangles[t];
+  int u = dt->n[k];
+  if (u < 0) {
+    return 0;
+  }
+  int d = gt->triangles[u].v[SharedEdge(gt->triangles, u, t)];
+  const Vector2 *p = gt->positions;
+  return InCircle(p[dt->v[0]], p[dt->v[1]], p[dt->v[2]], p[d]) > 0.0;
+}
+
+// Flips illegal edges until none is left. Lawson's flip algorithm reaches the
+// Delaunay triangulation from any triangulation; the pass limit only guards
+// against rounding cycling between cocircular diagonals.
+static void LegaliseGhostTriangulation(GhostTriangulation *gt) {
+  bool32 flipped = 1;
+  for (int pass = 0; flipped && pass < gt->numTriangles; pass++) {
+    flipped = 0;
+    for (int t = 0; t < gt->numTriangles; t++) {
+      for (int k = 0; k < 3; k++) {
+        if (gt->triangles[t].n[k] > t && EdgeIllegal(gt, t, k)) {
+          FlipGhostEdge(gt, t, k);
+          flipped = 1;
+        }
+      }
+    }
+  }
+}
+
+// Walks towards p over triangles whose corners index positions, starting at
+// *t and leaving the last triangle seen there. Returns the triangle holding
+// p, -1 once the walk steps off through an edge without a neighbour. onEdge,
+// when given, is set if p lies on an edge of the triangle returned.
+int WalkToTriangle(const DelaunayTriangle *triangles, int numTriangles,
+                   const Vector2 *positions, Vector2 p, int *t,
+                   bool32 *onEdge) {
+  int at = *t;
+  for (int steps = 0; steps <= numTriangles; steps++) {
+    const DelaunayTriangle *dt = &triangles[at];
+    int next = -2;
+    bool32 on = 0;
+    for (int k = 0; k < 3 && next == -2; k++) {
+      double o =
+          Orient(positions[dt->v[NEXT(k)]], positions[dt->v[PREV(k)]], p);
+      if (o < 0) {
+        next = dt->n[k];
+      } else if (o == 0) {
+        on = 1;
+      }
+    }
+    if (next == -2) {
+      if (onEdge) {
+        *onEdge = on;
+      }
+      *t = at;
+      return at;
+    }
+    if (next < 0) {
+      break;
+    }
+    at = next;
+  }
+  *t = at;
+  return -1;
+}
+
+// The ghosts close every edge, so the walk only fails for p outside them
+static int LocateGhostTriangle(const GhostTriangulation *gt, Vector2 p, int t,
+                               bool32 *onEdge) {
+  *onEdge = 0;
+  return WalkToTriangle(gt->triangles, gt->numTriangles, gt->positions, p, &t,
+                        onEdge);
+}
+
+// Lawson insertion of site i, whose position is already set, walking from
+// triangle start: split the triangle holding it in three, then flip until
+// every edge around the new site is locally Delaunay. More pending flips than
+// the stack holds fall back to legalising the whole triangulation. Returns 0
+// if i is outside the ghosts or the triangles are full.
+bool32 InsertGhostSite(GhostTriangulation *gt, int i, int start) {
+  bool32 onEdge = 0;
+  int t = LocateGhostTriangle(gt, gt->positions[i], start, &onEdge);
+  for (int attempt = 0; t >= 0 && onEdge && attempt < 4; attempt++) {
+    const DelaunayTriangle *dt = &gt->triangles[t];
+    const Vector2 *p = gt->positions;
+    Vector2 centre = Vector2Scale(
+        Vector2Add(p[dt->v[0]], Vector2Add(p[dt->v[1]], p[dt->v[2]])),
+        1.0f / 3.0f);
+    gt->positions[i] =
+        Vector2MoveTowards(gt->positions[i], centre, INSERT_NUDGE);
+    t = LocateGhostTriangle(gt, gt->positions[i], t, &onEdge);
+  }
+  if (t < 0 || gt->numTriangles + 2 > MAX_GHOST_TRIANGLES) {
+    return 0;
+  }
+
+  DelaunayTriangle old = gt->triangles[t];
+  int a = old.v[0], b = old.v[1], c = old.v[2];
+  int t1 = gt->numTriangles++;
+  int t2 = gt->numTriangles++;
+  gt->triangles[t] = (DelaunayTriangle){{a, b, i}, {t1, t2, old.n[2]}};
+  gt->triangles[t1] = (DelaunayTriangle){{b, c, i}, {t2, t, old.n[0]}};
+  gt->triangles[t2] = (DelaunayTriangle){{c, a, i}, {t, t1, old.n[1]}};
+  ReplaceNeighbour(gt, old.n[0], t, t1);
+  ReplaceNeighbour(gt, old.n[1], t, t2);
+  gt->siteTriangle[a] = t;
+  gt->siteTriangle[b] = t1;
+  gt->siteTriangle[c] = t2;
+  gt->siteTriangle[i] = t;
+  gt->versions[t]++;
+  gt->versions[t1]++;
+  gt->versions[t2]++;
+  MarkTriangle(gt, t);
+  MarkChanged(gt, c);
+
+  // Edges facing the new site, each keeps it at v[0] once flipped
+  int stack[2 * MAX_PENDING_FLIPS];
+  int top = 0;
+  int seeds[3] = {t, t1, t2};
+  for (int s = 0; s < 3; s++) {
+    stack[top++] = seeds[s];
+    stack[top++] = 2;
+  }
+  bool32 overflow = 0;
+  while (top > 0) {
+    int k = stack[--top];
+    int f = stack[--top];
+    if (EdgeIllegal(gt, f, k)) {
+      int u = FlipGhostEdge(gt, f, k);
+      if (top + 4 <= 2 * MAX_PENDING_FLIPS) {
+        stack[top++] = f;
+        stack[top++] = 0;
+        stack[top++] = u;
+        stack[top++] = 0;
+      } else {
+        overflow = 1;
+      }
+    }
+  }
+  if (overflow) {
+    LegaliseGhostTriangulation(gt);
+  }
+  return 1;
+}
+
+// Moves the last triangle into the freed slot t
+static void FreeTriangle(GhostTriangulation *gt, int t) {
+  int last = --gt->numTriangles;
+  if (t == last) {
+    return;
+  }
+  DelaunayTriangle *dt = &gt->triangles[t];
+  *dt = gt->triangles[last];
+  gt->versions[t]++;
+  for (int k = 0; k < 3; k++) {
+    ReplaceNeighbour(gt, dt->n[k], last, t);
+    if (gt->siteTriangle[dt->v[k]] == last) {
+      gt->siteTriangle[dt->v[k]] = t;
+    }
+  }
+}
+
+// Takes site i out and fills its star-shaped hole with the Delaunay
+// triangulation of the ring around it. An ear is a Delaunay triangle of the
+// hole when it is convex and its circumcircle holds no other ring site, and
+// what is left after clipping one is still triangulated by the rest, so
+// clipping such ears one at a time fills the hole. Returns 0 if the ring is
+// too large, leaving the triangulation untouched.
+bool32 RemoveGhostSite(GhostTriangulation *gt, int i) {
+  int slots[MAX_GHOST_RING];
+  int ring[MAX_GHOST_RING];
+  // Triangle and edge across the ring edge from r to next[r]
+  int across[MAX_GHOST_RING];
+  int acrossEdge[MAX_GHOST_RING];
+  int prev[MAX_GHOST_RING];
+  int next[MAX_GHOST_RING];
+
+  int count = 0;
+  int first = gt->siteTriangle[i];
+  int t = first;
+  do {
+    if (count == MAX_GHOST_RING) {
+      return 0;
+    }
+    const DelaunayTriangle *dt = &gt->triangles[t];
+    int k = CornerOf(dt, i);
+    slots[count] = t;
+    ring[count] = dt->v[NEXT(k)];
+    across[count] = dt->n[k];
+    acrossEdge[count] =
+        dt->n[k] >= 0 ? SharedEdge(gt->triangles, dt->n[k], t) : -1;
+    count++;
+    t = dt->n[NEXT(k)];
+  } while (t != first);
+
+  const Vector2 *p = gt->positions;
+  for (int r = 0; r < count; r++) {
+    prev[r] = (r + count - 1) % count;
+    next[r] = (r + 1) % count;
+    MarkChanged(gt, ring[r]);
+  }
+
+  int used = 0;
+  int remaining = count;
+  int r = 0;
+  while (remaining > 3) {
+    // First empty convex ear; failing that, on rounding, the first convex one
+    int ear = -1, convex = -1;
+    for (int step = 0; step < remaining && ear < 0; step++, r = next[r]) {
+      Vector2 a = p[ring[prev[r]]], b = p[ring[r]], c = p[ring[next[r]]];
+      if (Orient(a, b, c) <= 0) {
+        continue;
+      }
+      convex = convex < 0 ? r : convex;
+      bool32 empty = 1;
+      for (int s = 0; s < count && empty; s++) {
+        if (s != r && s != prev[r] && s != next[r]) {
+          empty = InCircle(a, b, c, p[ring[s]]) <= 0;
+        }
+      }
+      ear = empty ? r : ear;
+    }
+    ear = ear >= 0 ? ear : (convex >= 0 ? convex : r);
+
+    int a = prev[ear], c = next[ear];
+    int e = slots[used++];
+    gt->triangles[e] = (DelaunayTriangle){{ring[a], ring[ear], ring[c]},
+                                          {across[ear], -1, across[a]}};
+    gt->versions[e]++;
+    Link(gt, across[ear], acrossEdge[ear], e);
+    Link(gt, across[a], acrossEdge[a], e);
+    across[a] = e;
+    acrossEdge[a] = 1;
+    next[a] = c;
+    prev[c] = a;
+    r = c;
+    remaining--;
+    for (int k = 0; k < 3; k++) {
+      gt->siteTriangle[gt->triangles[e].v[k]] = e;
+    }
+  }
+
+  int a = prev[r], c = next[r];
+  int e = slots[used++];
+  gt->triangles[e] = (DelaunayTriangle){{ring[a], ring[r], ring[c]},
+                                        {across[r], across[c], across[a]}};
+  gt->versions[e]++;
+  Link(gt, across[r], acrossEdge[r], e);
+  Link(gt, across[c], acrossEdge[c], e);
+  Link(gt, across[a], acrossEdge[a], e);
+  for (int k = 0; k < 3; k++) {
+    gt->siteTriangle[gt->triangles[e].v[k]] = e;
+  }
+
+  // The two triangles left over, highest slot first so the other stays put
+  int s0 = slots[count - 2], s1 = slots[count - 1];
+  FreeTriangle(gt, s0 > s1 ? s0 : s1);
+  FreeTriangle(gt, s0 > s1 ? s1 : s0);
+  UnmarkChanged(gt, i);
+  return 1;
+}
+
+// Gives site from, and the triangles around it, the index to
+void RenumberGhostSite(GhostTriangulation *gt, int from, int to) {
+  int first = gt->siteTriangle[from];
+  int t = first;
+  do {
+    DelaunayTriangle *dt = &gt->triangles[t];
+    int k = CornerOf(dt, from);
+    dt->v[k] = to;
+    MarkChanged(gt, dt->v[NEXT(k)]);
+    t = dt->n[NEXT(k)];
+  } while (t != first);
+  gt->positions[to] = gt->positions[from];
+  gt->siteTriangle[to] = first;
+  UnmarkChanged(gt, from);
+  MarkChanged(gt, to);
+}
+
+// Delaunay triangulation of positions [0, numSites) inside four ghost corners
+// around bounds, built by Lawson insertion. Every site is changed.
+bool32 BuildGhostTriangulation(GhostTriangulation *gt) {
+  Rectangle bounds = gt->bounds;
+  float size = fmaxf(bounds.width, bounds.height);
+  Vector2 centre = {bounds.x + 0.5f * bounds.width,
+                    bounds.y + 0.5f * bounds.height};
+  float r = GHOST_DISTANCE * size;
+  gt->positions[Ghost(0)] = (Vector2){centre.x - r, centre.y - r};
+  gt->positions[Ghost(1)] = (Vector2){centre.x + r, centre.y - r};
+  gt->positions[Ghost(2)] = (Vector2){centre.x + r, centre.y + r};
+  gt->positions[Ghost(3)] = (Vector2){centre.x - r, centre.y + r};
+
+  gt->numTriangles = 2;
+  gt->triangles[0] =
+      (DelaunayTriangle){{Ghost(0), Ghost(1), Ghost(2)}, {-1, 1, -1}};
+  gt->triangles[1] =
+      (DelaunayTriangle){{Ghost(0), Ghost(2), Ghost(3)}, {-1, -1, 0}};
+  gt->siteTriangle[Ghost(0)] = 0;
+  gt->siteTriangle[Ghost(1)] = 0;
+  gt->siteTriangle[Ghost(2)] = 0;
+  gt->siteTriangle[Ghost(3)] = 1;
+
+  for (int i = 0; i < gt->numSites; i++) {
+    if (!InsertGhostSite(gt, i, gt->siteTriangle[i > 0 ? i - 1 : Ghost(0)])) {
+      return 0;
+    }
+  }
+  memset(gt->versions, 0, gt->numTriangles * sizeof(gt->versions[0]));
+  for (int i = 0; i < gt->numSites; i++) {
+    MarkChanged(gt, i);
+  }
+  return 1;
+}
+
+// Site nearest p, for p inside the bounds, by walking towards it from start
+// over the Delaunay neighbours. The ghosts' cells lie outside the bounds, so
+// the walk never needs them. Returns -1 when there are no sites.
+int NearestGhostSite(const GhostTriangulation *gt, Vector2 p, int start) {
+  if (gt->numSites < 1) {
+    return -1;
+  }
+  int site = (start >= 0 && start < gt->numSites) ? start : 0;
+  double best = SquaredGap(gt->positions[site], p);
+  for (;;) {
+    int nearer = -1;
+    int first = gt->siteTriangle[site];
+    int t = first;
+    do {
+      const DelaunayTriangle *dt = &gt->triangles[t];
+      int k = CornerOf(dt, site);
+      int s = dt->v[NEXT(k)];
+      double gap = IsGhost(s) ? INFINITY : SquaredGap(gt->positions[s], p);
+      if (gap < best) {
+        best = gap;
+        nearer = s;
+      }
+      t = dt->n[NEXT(k)];
+    } while (t != first);
+    if (nearer < 0) {
+      return site;
+    }
+    site = nearer;
+  }
+}
+
+// Delaunay neighbours of site i, ghosts left out. Returns their number.
+int GhostNeighbours(const GhostTriangulation *gt, int i, int *neighbours,
+                    int maxNeighbours) {
+  int count = 0;
+  int first = gt->siteTriangle[i];
+  int t = first;
+  do {
+    const DelaunayTriangle *dt = &gt->triangles[t];
+    int k = CornerOf(dt, i);
+    if (!IsGhost(dt->v[NEXT(k)]) && count < maxNeighbours) {
+      neighbours[count++] = dt->v[NEXT(k)];
+    }
+    t = dt->n[NEXT(k)];
+  } while (t != first);
+  return count;
+}
+
+// The Voronoi diagram of the sites as labelled segments between the
+// circumcentres of triangles sharing a site-site edge. Edges to the ghosts
+// lie outside the bounds and are left out. Returns the number of edges.
+int GhostVoronoiEdges(GhostTriangulation *gt, CompleteEdge *edges,
+                      int maxEdges) {
+  const Vector2 *p = gt->positions;
+  for (int t = 0; t < gt->numTriangles; t++) {
+    const DelaunayTriangle *dt = &gt->triangles[t];
+    gt->circumcentres[t] =
+        Circumcentre(p[dt->v[0]], p[dt->v[1]], p[dt->v[2]]);
+  }
+
+  int count = 0;
+  for (int t = 0; t < gt->numTriangles && count < maxEdges; t++) {
+    const DelaunayTriangle *dt = &gt->triangles[t];
+    for (int k = 0; k < 3 && count < maxEdges; k++) {
+      int u = dt->n[k];
+      int a = dt->v[NEXT(k)];
+      int b = dt->v[PREV(k)];
+      if (u < t || IsGhost(a) || IsGhost(b)) {
+        continue;
+      }
+      CompleteEdge *edge = &edges[count++];
+      edge->vertices[0] = a;
+      edge->vertices[1] = b;
+      edge->endpointA = gt->circumcentres[t];
+      edge->endpointB = gt->circumcentres[u];
+    }
+  }
+  return count;
+}
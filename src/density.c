@@ -0,0 +1,228 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+static bool32 AllocateDensityField(DensityField *field, memory_arena *arena,
+                                   int width, int height, Rectangle box) {
+  field->valid = 0;
+  field->width = width;
+  field->height = height;
+  field->box = box;
+
+  uint64 entries = (uint64)(width + 1) * height;
+  field->rowMass = PushArray(arena, entries, double);
+  field->rowMoment = PushArray(arena, entries, double);
+  return field->rowMass && field->rowMoment;
+}
+
+static void FillDensityTables(DensityField *field, const float *rho) {
+  int width = field->width;
+  for (int y = 0; y < field->height; y++) {
+    double *mass = &field->rowMass[(uint64)y * (width + 1)];
+    double *moment = &field->rowMoment[(uint64)y * (width + 1)];
+    mass[0] = 0.0;
+    moment[0] = 0.0;
+    for (int x = 0; x < width; x++) {
+      double r = rho[(uint64)y * width + x];
+      mass[x + 1] = mass[x] + r;
+      moment[x + 1] = moment[x] + (x + 0.5) * r;
+    }
+  }
+  field->valid = 1;
+}
+
+bool32 BuildDensityField(DensityField *field, memory_arena *arena,
+                         const float *rho, int width, int height,
+                         Rectangle box) {
+  if (!AllocateDensityField(field, arena, width, height, box)) {
+    return 0;
+  }
+  FillDensityTables(field, rho);
+  return 1;
+}
+
+// Refills the field with a new density of the same size in place, so an
+// animation does not grow the arena every frame. Allocates when the size or
+// box changed.
+bool32 UpdateDensityField(DensityField *field, memory_arena *arena,
+                          const float *rho, int width, int height,
+                          Rectangle box) {
+  bool32 sameShape = field->valid && field->width == width &&
+                     field->height == height && field->box.x == box.x &&
+                     field->box.y == box.y && field->box.width == box.width &&
+                     field->box.height == box.height;
+  if (!sameShape) {
+    return BuildDensityField(field, arena, rho, width, height, box);
+  }
+  FillDensityTables(field, rho);
+  return 1;
+}
+
+// Dark pixels are dense, which is what stippling wants. A small floor keeps
+// cells over pure white from collapsing to zero mass.
+bool32 DensityFieldFromImage(DensityField *field, memory_arena *arena,
+                             Image image, Rectangle box) {
+  if (!AllocateDensityField(field, arena, image.width, image.height, box)) {
+    return 0;
+  }
+
+  // rho is only needed while the tables are filled
+  uint64 used = arena->used;
+  float *rho = PushArray(arena, (uint64)image.width * image.height, float);
+  if (!rho) {
+    return 0;
+  }
+
+  Color *pixels = LoadImageColors(image);
+  for (int i = 0; i < image.width * image.height; i++) {
+    float luminance = (0.2126f * pixels[i].r + 0.7152f * pixels[i].g +
+                       0.0722f * pixels[i].b) /
+                      255.0f;
+    rho[i] = 0.01f + (1.0f - luminance) * (pixels[i].a / 255.0f);
+  }
+  UnloadImageColors(pixels);
+
+  FillDensityTables(field, rho);
+  arena->used = used;
+  return 1;
+}
+
+// Prefix value at a fractional pixel coordinate, linear inside a pixel
+static inline double RowPrefix(const double *prefix, int width, double x) {
+  if (x <= 0) {
+    return 0;
+  }
+  if (x >= width) {
+    return prefix[width];
+  }
+  int i = (int)x;
+  return prefix[i] + (x - i) * (prefix[i + 1] - prefix[i]);
+}
+
+// Mass and pixel-space moments of a convex polygon. Each pixel row inside the
+// polygon contributes its span's mass and x moment from the prefix tables; the
+// y moment is just the row's centre times its mass, so no third table is
+// needed.
+static double IntegrateDensity(const DensityField *field,
+                               const Vector2 *polygon, int n,
+                               double *momentXOut, double *momentYOut) {
+  float scaleX = field->width / field->box.width;
+  float scaleY = field->height / field->box.height;
+  Vector2 pixels[MAX_CLIP_VERTICES];
+  if (n > MAX_CLIP_VERTICES) {
+    n = MAX_CLIP_VERTICES;
+  }
+
+  int top = 0, bottom = 0;
+  for (int k = 0; k < n; k++) {
+    pixels[k] = (Vector2){(polygon[k].x - field->box.x) * scaleX,
+                          (polygon[k].y - field->box.y) * scaleY};
+    if (pixels[k].y < pixels[top].y) {
+      top = k;
+    }
+    if (pixels[k].y > pixels[bottom].y) {
+      bottom = k;
+    }
+  }
+
+  int firstRow = (int)ceilf(pixels[top].y - 0.5f);
+  int lastRow = (int)floorf(pixels[bottom].y - 0.5f);
+  if (firstRow < 0) {
+    firstRow = 0;
+  }
+  if (lastRow > field->height - 1) {
+    lastRow = field->height - 1;
+  }
+
+  // Walk both chains from the top vertex down, so each row finds its span in
+  // constant time instead of testing every edge
+  int forward = top, backward = top;
+  double mass = 0, momentX = 0, momentY = 0;
+  for (int row = firstRow; row <= lastRow; row++) {
+    double y = row + 0.5;
+    while (forward != bottom && pixels[(forward + 1) % n].y < y) {
+      forward = (forward + 1) % n;
+    }
+    while (backward != bottom && pixels[(backward + n - 1) % n].y < y) {
+      backward = (backward + n - 1) % n;
+    }
+    if (forward == bottom || backward == bottom) {
+      break;
+    }
+
+    Vector2 a = pixels[forward], b = pixels[(forward + 1) % n];
+    Vector2 c = pixels[backward], d = pixels[(backward + n - 1) % n];
+    double xa = (b.y > a.y) ? a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y) : a.x;
+    double xc = (d.y > c.y) ? c.x + (y - c.y) * (d.x - c.x) / (d.y - c.y) : c.x;
+    double x0 = fmin(xa, xc), x1 = fmax(xa, xc);
+
+    uint64 offset = (uint64)row * (field->width + 1);
+    const double *rowMass = &field->rowMass[offset];
+    const double *rowMoment = &field->rowMoment[offset];
+    double m = RowPrefix(rowMass, field->width, x1) -
+               RowPrefix(rowMass, field->width, x0);
+    mass += m;
+    momentX += RowPrefix(rowMoment, field->width, x1) -
+               RowPrefix(rowMoment, field->width, x0);
+    momentY += y * m;
+  }
+
+  *momentXOut = momentX;
+  *momentYOut = momentY;
+  return mass;
+}
+
+// Weighted centroid of a convex polygon, the plain centroid where it holds no
+// mass
+Vector2 WeightedCentroid(const DensityField *field, const Vector2 *polygon,
+                         int n) {
+  if (n < 3) {
+    return ComputeTrueCentroid((Vector2 *)polygon, n);
+  }
+
+  double momentX, momentY;
+  double mass = IntegrateDensity(field, polygon, n, &momentX, &momentY);
+  if (mass <= 0) {
+    return ComputeTrueCentroid((Vector2 *)polygon, n);
+  }
+  float scaleX = field->width / field->box.width;
+  float scaleY = field->height / field->box.height;
+  return (Vector2){field->box.x + (float)(momentX / mass) / scaleX,
+                   field->box.y + (float)(momentY / mass) / scaleY};
+}
+
+// Density integrated over a convex polygon, in density units times pixels
+double DensityMass(const DensityField *field, const Vector2 *polygon, int n) {
+  double momentX, momentY;
+  return n < 3 ? 0 : IntegrateDensity(field, polygon, n, &momentX, &momentY);
+}
+
+typedef struct {
+  const DensityField *field;
+  Cell *cells;
+  const int *sites;
+  Vector2 *centroids;
+} WeightedCentroidJob;
+
+static void RunWeightedCentroids(void *data, int start, int end) {
+  WeightedCentroidJob *job = (WeightedCentroidJob *)data;
+  for (int k = start; k < end; k++) {
+    int i = job->sites ? job->sites[k] : k;
+    Cell *cell = &job->cells[i];
+    job->centroids[i] =
+        WeightedCentroid(job->field, cell->vertices, cell->num_vertices);
+  }
+}
+
+// Weighted centroids of cells[sites[k]] for k < count (or of the first count
+// cells when sites is NULL), written to centroids[site]. Cells are
+// independent, so they are split across threads.
+void WeightedCentroids(const DensityField *field, Cell *cells,
+                       const int *sites, int count, Vector2 *centroids) {
+  WeightedCentroidJob job = {field, cells, sites, centroids};
+  ParallelFor(count, 64, RunWeightedCentroids, &job);
+}
@@ -0,0 +1,367 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+#define MAX_DOMAIN_QUERY 512
+// Crossings of one cell edge with the boundary
+#define MAX_EDGE_CUTS (MAX_DOMAIN_QUERY + 2)
+#define DOMAIN_STACK_SIZE 64
+
+static double Cross(Vector2 a, Vector2 b) {
+  return (double)a.x * b.y - (double)a.y * b.x;
+}
+
+static double RingArea(const Vector2 *ring, int n) {
+  double area = 0;
+  for (int i = 0; i < n; i++) {
+    area += Cross(ring[i], ring[(i + 1) % n]);
+  }
+  return area * 0.5;
+}
+
+static int CompareSegmentX(const void *a, const void *b) {
+  const Segment *s = (const Segment *)a;
+  const Segment *t = (const Segment *)b;
+  float ms = s->start.x + s->end.x;
+  float mt = t->start.x + t->end.x;
+  return (ms > mt) - (ms < mt);
+}
+
+static int CompareSegmentY(const void *a, const void *b) {
+  const Segment *s = (const Segment *)a;
+  const Segment *t = (const Segment *)b;
+  float ms = s->start.y + s->end.y;
+  float mt = t->start.y + t->end.y;
+  return (ms > mt) - (ms < mt);
+}
+
+static void BuildDomainNode(Domain *domain, int nodeIndex, int start,
+                            int end) {
+  DomainNode *node = &domain->nodes[nodeIndex];
+  node->min = (Vector2){FLT_MAX, FLT_MAX};
+  node->max = (Vector2){-FLT_MAX, -FLT_MAX};
+  Vector2 midMin = node->min, midMax = node->max;
+  for (int i = start; i < end; i++) {
+    Segment *s = &domain->segments[i];
+    node->min = Vector2Min(node->min, Vector2Min(s->start, s->end));
+    node->max = Vector2Max(node->max, Vector2Max(s->start, s->end));
+    Vector2 mid = Midpoint(s->start, s->end);
+    midMin = Vector2Min(midMin, mid);
+    midMax = Vector2Max(midMax, mid);
+  }
+
+  if (end - start <= DOMAIN_LEAF_SEGMENTS) {
+    node->first = start;
+    node->count = end - start;
+    return;
+  }
+
+  // Median split along the longer axis of the segment midpoints
+  bool32 splitX = (midMax.x - midMin.x) >= (midMax.y - midMin.y);
+  qsort(&domain->segments[start], end - start, sizeof(Segment),
+        splitX ? CompareSegmentX : CompareSegmentY);
+
+  int left = domain->numNodes;
+  domain->numNodes += 2;
+  node->first = left;
+  node->count = 0;
+
+  int mid = (start + end) / 2;
+  BuildDomainNode(domain, left, start, mid);
+  BuildDomainNode(domain, left + 1, mid, end);
+}
+
+// rings[0] is the outer boundary, every further ring is a hole. Ring winding
+// is normalised here, so callers can pass either orientation.
+bool32 BuildDomain(Domain *domain, memory_arena *arena, const Vector2 **rings,
+                   const int *ringCounts, int numRings) {
+  domain->valid = 0;
+  domain->numSegments = 0;
+  for (int r = 0; r < numRings; r++) {
+    domain->numSegments += ringCounts[r];
+  }
+  if (numRings == 0 || domain->numSegments < 3) {
+    return 0;
+  }
+
+  domain->segments = PushArray(arena, domain->numSegments, Segment);
+  domain->nodes = PushArray(arena, 2 * domain->numSegments, DomainNode);
+  if (!domain->segments || !domain->nodes) {
+    return 0;
+  }
+
+  int count = 0;
+  for (int r = 0; r < numRings; r++) {
+    const Vector2 *ring = rings[r];
+    int n = ringCounts[r];
+    double area = RingArea(ring, n);
+    bool32 reverse = (r == 0) ? (area < 0) : (area > 0);
+    for (int i = 0; i < n; i++) {
+      Vector2 a = ring[i];
+      Vector2 b = ring[(i + 1) % n];
+      domain->segments[count++] =
+          reverse ? (Segment){b, a} : (Segment){a, b};
+    }
+  }
+
+  domain->numNodes = 1;
+  BuildDomainNode(domain, 0, 0, domain->numSegments);
+
+  DomainNode *root = &domain->nodes[0];
+  domain->bounds = (Rectangle){root->min.x, root->min.y,
+                               root->max.x - root->min.x,
+                               root->max.y - root->min.y};
+  domain->valid = 1;
+  return 1;
+}
+
+// Indices of the boundary segments whose bounds overlap [min, max], at most
+// maxOut of them. Returns how many there are in all, which is more than
+// maxOut when some were left out.
+int QueryDomainSegments(const Domain *domain, Vector2 min, Vector2 max,
+                        int *out, int maxOut) {
+  int count = 0;
+  int stack[DOMAIN_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+
+  while (top > 0) {
+    const DomainNode *node = &domain->nodes[stack[--top]];
+    if (node->max.x < min.x || node->min.x > max.x || node->max.y < min.y ||
+        node->min.y > max.y) {
+      continue;
+    }
+    if (node->count > 0) {
+      for (int i = node->first; i < node->first + node->count; i++) {
+        const Segment *s = &domain->segments[i];
+        if (fmaxf(s->start.x, s->end.x) < min.x ||
+            fminf(s->start.x, s->end.x) > max.x ||
+            fmaxf(s->start.y, s->end.y) < min.y ||
+            fminf(s->start.y, s->end.y) > max.y) {
+          continue;
+        }
+        if (count < maxOut) {
+          out[count] = i;
+        }
+        count++;
+      }
+    } else if (top + 2 <= DOMAIN_STACK_SIZE) {
+      stack[top++] = node->first;
+      stack[top++] = node->first + 1;
+    }
+  }
+  return count;
+}
+
+// Even-odd test with a ray towards +x; only subtrees straddling the ray's
+// height and reaching right of p are visited.
+bool32 PointInDomain(const Domain *domain, Vector2 p) {
+  bool32 inside = 0;
+  int stack[DOMAIN_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+
+  while (top > 0) {
+    const DomainNode *node = &domain->nodes[stack[--top]];
+    if (node->max.x < p.x || node->min.y > p.y || node->max.y < p.y) {
+      continue;
+    }
+    if (node->count > 0) {
+      for (int i = node->first; i < node->first + node->count; i++) {
+        Vector2 a = domain->segments[i].start;
+        Vector2 b = domain->segments[i].end;
+        if ((a.y > p.y) != (b.y > p.y)) {
+          float x = a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y);
+          if (x > p.x) {
+            inside = !inside;
+          }
+        }
+      }
+    } else if (top + 2 <= DOMAIN_STACK_SIZE) {
+      stack[top++] = node->first;
+      stack[top++] = node->first + 1;
+    }
+  }
+  return inside;
+}
+
+typedef struct {
+  double area2; // twice the signed area
+  double momentX;
+  double momentY;
+} BoundaryMoments;
+
+static void AddBoundaryPiece(BoundaryMoments *m, Vector2 p, Vector2 q) {
+  double cross = Cross(p, q);
+  m->area2 += cross;
+  m->momentX += (p.x + q.x) * cross;
+  m->momentY += (p.y + q.y) * cross;
+}
+
+static int CompareFloat(const void *a, const void *b) {
+  float x = *(const float *)a, y = *(const float *)b;
+  return (x > y) - (x < y);
+}
+
+// Centroid of cell ∩ domain by Green's theorem: the boundary of the
+// intersection is the part of the cell boundary inside the domain plus the
+// part of the domain boundary inside the cell. Only segments near the cell
+// are fetched from the hierarchy, or every segment is used when more than
+// MAX_DOMAIN_QUERY are near. Returns the clipped area, 0 when the cell misses
+// the domain or one of its edges crosses the boundary more than
+// MAX_EDGE_CUTS times.
+float DomainClippedCentroid(const Domain *domain, const Vector2 *cell, int n,
+                            Vector2 *centroid) {
+  if (n < 3) {
+    return 0;
+  }
+
+  Vector2 poly[MAX_CLIP_VERTICES];
+  if (n > MAX_CLIP_VERTICES) {
+    n = MAX_CLIP_VERTICES;
+  }
+  bool32 reverse = RingArea(cell, n) < 0;
+  Vector2 min = {FLT_MAX, FLT_MAX}, max = {-FLT_MAX, -FLT_MAX};
+  for (int k = 0; k < n; k++) {
+    poly[k] = cell[reverse ? n - 1 - k : k];
+    min = Vector2Min(min, poly[k]);
+    max = Vector2Max(max, poly[k]);
+  }
+
+  int query[MAX_DOMAIN_QUERY];
+  const int *nearby = query;
+  int numNearby =
+      QueryDomainSegments(domain, min, max, query, MAX_DOMAIN_QUERY);
+  if (numNearby > MAX_DOMAIN_QUERY) {
+    // Segments away from the cell cross none of its edges and clip to
+    // nothing, so the whole list gives the same answer, only slower
+    nearby = 0;
+    numNearby = domain->numSegments;
+  }
+
+  BoundaryMoments m = {0};
+  if (numNearby == 0) {
+    // No boundary crosses the cell, it is either wholly inside or outside
+    if (!PointInDomain(domain, ComputeTrueCentroid(poly, n))) {
+      return 0;
+    }
+    for (int k = 0; k < n; k++) {
+      AddBoundaryPiece(&m, poly[k], poly[(k + 1) % n]);
+    }
+  } else {
+    // Cell edges, split where they cross the domain boundary
+    for (int k = 0; k < n; k++) {
+      Vector2 p = poly[k];
+      Vector2 q = poly[(k + 1) % n];
+      Vector2 r = Vector2Subtract(q, p);
+
+      float cuts[MAX_EDGE_CUTS];
+      int numCuts = 0;
+      cuts[numCuts++] = 0.0f;
+      for (int s = 0; s < numNearby; s++) {
+        Segment seg = domain->segments[nearby ? nearby[s] : s];
+        Vector2 d = Vector2Subtract(seg.end, seg.start);
+        double denom = Cross(r, d);
+        if (fabs(denom) < 1e-12) {
+          continue;
+        }
+        Vector2 ap = Vector2Subtract(seg.start, p);
+        double t = Cross(ap, d) / denom;
+        double u = Cross(ap, r) / denom;
+        if (t > 0.0 && t < 1.0 && u >= 0.0 && u <= 1.0) {
+          if (numCuts == MAX_EDGE_CUTS - 1) {
+            return 0;
+          }
+          cuts[numCuts++] = (float)t;
+        }
+      }
+      qsort(&cuts[1], numCuts - 1, sizeof(float), CompareFloat);
+      cuts[numCuts++] = 1.0f;
+
+      for (int c = 0; c + 1 < numCuts; c++) {
+        if (cuts[c + 1] <= cuts[c]) {
+          continue;
+        }
+        Vector2 a = Vector2Lerp(p, q, cuts[c]);
+        Vector2 b = Vector2Lerp(p, q, cuts[c + 1]);
+        if (PointInDomain(domain, Midpoint(a, b))) {
+          AddBoundaryPiece(&m, a, b);
+        }
+      }
+    }
+
+    // Domain edges, clipped to the convex cell (Cyrus-Beck)
+    for (int s = 0; s < numNearby; s++) {
+      Segment seg = domain->segments[nearby ? nearby[s] : s];
+      Vector2 d = Vector2Subtract(seg.end, seg.start);
+      double t0 = 0.0, t1 = 1.0;
+      for (int k = 0; k < n && t0 < t1; k++) {
+        Vector2 p = poly[k];
+        Vector2 e = Vector2Subtract(poly[(k + 1) % n], p);
+        // Inside the cell means left of every edge: cross(e, x - p) >= 0
+        double at = Cross(e, Vector2Subtract(seg.start, p));
+        double slope = Cross(e, d);
+        if (fabs(slope) < 1e-12) {
+          if (at < 0) {
+            t1 = -1.0;
+          }
+          continue;
+        }
+        double t = -at / slope;
+        if (slope > 0) {
+          t0 = fmax(t0, t);
+        } else {
+          t1 = fmin(t1, t);
+        }
+      }
+      if (t0 < t1) {
+        AddBoundaryPiece(&m, Vector2Lerp(seg.start, seg.end, (float)t0),
+                         Vector2Lerp(seg.start, seg.end, (float)t1));
+      }
+    }
+  }
+
+  if (m.area2 <= 1e-9) {
+    return 0;
+  }
+  *centroid = (Vector2){(float)(m.momentX / (3.0 * m.area2)),
+                        (float)(m.momentY / (3.0 * m.area2))};
+  return (float)(m.area2 * 0.5);
+}
+
+typedef struct {
+  const Domain *domain;
+  Cell *cells;
+  Vertex *vertices;
+  const int *sites;
+  Vector2 *centroids;
+} DomainCentroidJob;
+
+static void RunDomainCentroids(void *data, int start, int end) {
+  DomainCentroidJob *job = (DomainCentroidJob *)data;
+  for (int k = start; k < end; k++) {
+    int i = job->sites ? job->sites[k] : k;
+    Cell *cell = &job->cells[i];
+    Vector2 centroid;
+    float area = DomainClippedCentroid(job->domain, cell->vertices,
+                                       cell->num_vertices, &centroid);
+    // A cell wrapped around a hole can have its centroid in the hole, in
+    // which case the site stays where it is rather than leave the domain
+    if (area > 0 && PointInDomain(job->domain, centroid)) {
+      job->centroids[i] = centroid;
+    } else {
+      job->centroids[i] = job->vertices[i].position;
+    }
+  }
+}
+
+void DomainCentroids(const Domain *domain, Cell *cells, Vertex *vertices,
+                     const int *sites, int count, Vector2 *centroids) {
+  DomainCentroidJob job = {domain, cells, vertices, sites, centroids};
+  ParallelFor(count, 64, RunDomainCentroids, &job);
+}
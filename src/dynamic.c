@@ -0,0 +1,180 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+// Mouse distance in pixels within which a click picks a site
+#define PICK_RADIUS 8.0f
+// Drags shorter than this, twice the nudge a site inserted on an edge gets,
+// leave the site where it is
+#define MIN_DRAG 2e-3f
+
+static bool32 RebuildDynamicDelaunay(DynamicDelaunay *dd) {
+  dd->valid = BuildGhostTriangulation(&dd->mesh);
+  dd->rebuilds++;
+  return dd->valid;
+}
+
+// Builds the structure for the sites' positions. Edits must keep sites well
+// inside the ghosts around bounds; the diagram is exact within bounds.
+bool32 InitDynamicDelaunay(DynamicDelaunay *dd, const Vertex *vertices,
+                           int numSites, Rectangle bounds) {
+  GhostTriangulation *gt = &dd->mesh;
+  dd->valid = 0;
+  if (numSites > MAX_SITES || numSites < 0) {
+    return 0;
+  }
+  gt->numSites = numSites;
+  gt->bounds = bounds;
+  for (int i = 0; i < numSites; i++) {
+    gt->positions[i] = vertices[i].position;
+  }
+  dd->rebuilds = 0;
+  ClearGhostChanges(gt);
+  return RebuildDynamicDelaunay(dd);
+}
+
+// Adds a site at position. Returns its index, always the last, or -1 if the
+// structure is full or the position is outside the ghosts.
+int InsertDynamicSite(DynamicDelaunay *dd, Vector2 position) {
+  GhostTriangulation *gt = &dd->mesh;
+  int i = gt->numSites;
+  if (!dd->valid || i >= MAX_SITES || !InsideGhosts(gt, position)) {
+    return -1;
+  }
+  gt->positions[i] = position;
+  gt->numSites = i + 1;
+  int start = gt->siteTriangle[i > 0 ? i - 1 : MAX_SITES];
+  if (!InsertGhostSite(gt, i, start)) {
+    RebuildDynamicDelaunay(dd);
+  }
+  return i;
+}
+
+// Removes site i. The last site takes over its index, as in the app's vertex
+// array, so its cell and its neighbours' are reported changed too.
+bool32 DeleteDynamicSite(DynamicDelaunay *dd, int i) {
+  GhostTriangulation *gt = &dd->mesh;
+  if (!dd->valid || i < 0 || i >= gt->numSites) {
+    return 0;
+  }
+  int last = gt->numSites - 1;
+  bool32 local = RemoveGhostSite(gt, i);
+  if (local && i != last) {
+    RenumberGhostSite(gt, last, i);
+  }
+  gt->numSites = last;
+  if (!local) {
+    gt->positions[i] = gt->positions[last];
+    RebuildDynamicDelaunay(dd);
+  }
+  return 1;
+}
+
+// Moves site i to position by taking it out and putting it back, so only the
+// stars it leaves and joins are touched. Returns 0 if position is outside the
+// ghosts.
+bool32 MoveDynamicSite(DynamicDelaunay *dd, int i, Vector2 position) {
+  GhostTriangulation *gt = &dd->mesh;
+  if (!dd->valid || i < 0 || i >= gt->numSites ||
+      !InsideGhosts(gt, position)) {
+    return 0;
+  }
+  const DelaunayTriangle *dt = &gt->triangles[gt->siteTriangle[i]];
+  int k = dt->v[0] == i ? 0 : (dt->v[1] == i ? 1 : 2);
+  int neighbour = dt->v[(k + 1) % 3];
+  if (!RemoveGhostSite(gt, i)) {
+    gt->positions[i] = position;
+    return RebuildDynamicDelaunay(dd);
+  }
+  gt->positions[i] = position;
+  if (!InsertGhostSite(gt, i, gt->siteTriangle[neighbour])) {
+    RebuildDynamicDelaunay(dd);
+  }
+  return 1;
+}
+
+// Refreshes the relaxation cache for the cells the last edits changed, so
+// the next Lloyd iteration only clips those
+static void SyncChangedCells(struct app_state *AppState) {
+  GhostTriangulation *gt = &AppState->dynamicDelaunay.mesh;
+  IncrementalState *inc = &AppState->incremental;
+  if (inc->numSites == AppState->num_vertices) {
+    for (int c = 0; c < gt->numChanged; c++) {
+      int s = gt->changed[c];
+      inc->numNeighbours[s] =
+          GhostNeighbours(gt, s, inc->neighbours[s], MAX_CELL_NEIGHBOURS);
+      inc->stale[s] = 1;
+    }
+  }
+  ClearGhostChanges(gt);
+  AppState->fortuneState.edgesSize =
+      GhostVoronoiEdges(gt, AppState->fortuneState.edges, MAX_EDGES);
+}
+
+// Editing mode for the app: a left click away from every site adds one,
+// dragging a site moves it and a right click removes it. Each edit repairs
+// the diagram around it instead of sweeping it again.
+void EditSitesWithMouse(struct app_state *AppState) {
+  DynamicDelaunay *dd = &AppState->dynamicDelaunay;
+  IncrementalState *inc = &AppState->incremental;
+  int n = AppState->num_vertices;
+  if (!dd->valid || dd->mesh.numSites != n) {
+    Rectangle screen = {0, 0, GetScreenWidth(), GetScreenHeight()};
+    InitDynamicDelaunay(dd, AppState->vertices, n, screen);
+    AppState->draggedSite = -1;
+    SyncChangedCells(AppState);
+  }
+
+  Vector2 mouse = {(float)GetMouseX(),
+                   (float)(GetScreenHeight() - GetMouseY())};
+  int nearest = NearestGhostSite(&dd->mesh, mouse, AppState->hoveredSite);
+  AppState->hoveredSite = nearest;
+  bool32 picked =
+      nearest >= 0 && Vector2Distance(dd->mesh.positions[nearest], mouse) <=
+                          PICK_RADIUS;
+
+  if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT)) {
+    AppState->draggedSite = -1;
+  }
+  int dragged = AppState->draggedSite;
+  if (dragged >= 0 && IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
+    Vector2 *at = &AppState->vertices[dragged].position;
+    if (Vector2Distance(*at, mouse) > MIN_DRAG &&
+        MoveDynamicSite(dd, dragged, mouse)) {
+      *at = dd->mesh.positions[dragged];
+    }
+  } else if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+    if (picked) {
+      AppState->draggedSite = nearest;
+    } else if (nearest >= 0 && n < MAX_SITES - 1) {
+      // Appended on both sides, so the indices agree
+      int i = InsertDynamicSite(dd, mouse);
+      if (i >= 0) {
+        InsertSite(AppState, nearest, dd->mesh.positions[i]);
+      }
+    }
+  } else if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT) && picked && n > 1) {
+    int last = n - 1;
+    DeleteDynamicSite(dd, nearest);
+    AppState->vertices[nearest] = AppState->vertices[last];
+    if (inc->numSites == n) {
+      inc->cachedPositions[nearest] = inc->cachedPositions[last];
+      inc->cachedCentroids[nearest] = inc->cachedCentroids[last];
+      Cell *from = &AppState->cells[last];
+      AppState->cells[nearest].num_vertices = from->num_vertices;
+      memcpy(AppState->cells[nearest].vertices, from->vertices,
+             from->num_vertices * sizeof(Vector2));
+      inc->numSites = last;
+    }
+    AppState->num_vertices = last;
+    AppState->hoveredSite = -1;
+  }
+
+  if (dd->mesh.numChanged > 0) {
+    SyncChangedCells(AppState);
+  }
+}
@@ -0,0 +1,254 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+#define ENSEMBLE_SITES_PER_CELL 2
+
+// Bytes one worker's workspace takes from the arena, alignment included
+static uint64 WorkspaceSize(int maxSites) {
+  return SiteGridSize(maxSites, ENSEMBLE_SITES_PER_CELL) +
+         (uint64)maxSites * sizeof(Vector2) + 16;
+}
+
+bool32 InitLloydWorkspace(LloydWorkspace *ws, memory_arena *arena,
+                          int maxSites) {
+  memset(ws, 0, sizeof(*ws));
+  ws->centroids = PushArray(arena, maxSites, Vector2);
+  return ws->centroids &&
+         InitSiteGrid(&ws->grid, arena, maxSites, ENSEMBLE_SITES_PER_CELL);
+}
+
+typedef struct {
+  const SiteGrid *grid;
+  int slot;
+  Vector2 p;
+  Vector2 *polygon;
+  int *labels;
+  int count;
+} CellClip;
+
+static void ClipAgainstSlot(void *data, int k) {
+  CellClip *clip = (CellClip *)data;
+  if (k == clip->slot || clip->count == 0) {
+    return;
+  }
+  // Keep the side closer to p: dot(x - mid, q - p) <= 0
+  Vector2 scratch[MAX_CLIP_VERTICES];
+  int scratchLabels[MAX_CLIP_VERTICES];
+  Vector2 p = clip->p;
+  Vector2 q = {clip->grid->sortedX[k], clip->grid->sortedY[k]};
+  Vector2 normal = Vector2Subtract(q, p);
+  float offset = Vector2DotProduct(normal, Midpoint(p, q));
+  clip->count =
+      ClipHalfPlane(normal, offset, clip->grid->sortedSite[k], clip->polygon,
+                    clip->labels, clip->count, scratch, scratchLabels);
+  memcpy(clip->polygon, scratch, clip->count * sizeof(Vector2));
+  memcpy(clip->labels, scratchLabels, clip->count * sizeof(int));
+}
+
+// Voronoi cell of sorted slot k clipped to the box, visiting rings of grid
+// cells until they are more than twice the cell radius away
+static int WorkspaceCell(const SiteGrid *grid, int slot, Vector2 *polygon) {
+  Rectangle box = grid->box;
+  int labels[MAX_CLIP_VERTICES];
+  polygon[0] = (Vector2){box.x, box.y};
+  polygon[1] = (Vector2){box.x + box.width, box.y};
+  polygon[2] = (Vector2){box.x + box.width, box.y + box.height};
+  polygon[3] = (Vector2){box.x, box.y + box.height};
+  labels[0] = labels[1] = labels[2] = labels[3] = -1;
+
+  CellClip clip = {grid, slot, {grid->sortedX[slot], grid->sortedY[slot]},
+                   polygon, labels, 4};
+  int cx, cy;
+  SiteGridCoords(grid, clip.p, &cx, &cy);
+  for (int r = 0;; r++) {
+    if (!VisitSiteGridRing(grid, cx, cy, r, ClipAgainstSlot, &clip)) {
+      break;
+    }
+    float radius = 0;
+    for (int k = 0; k < clip.count; k++) {
+      radius = fmaxf(radius, Vector2Distance(polygon[k], clip.p));
+    }
+    if (r * grid->cellSize >= 2.0f * radius) {
+      break;
+    }
+  }
+  return clip.count;
+}
+
+typedef struct {
+  LloydWorkspace *ws;
+} CentroidJob;
+
+static void RunWorkspaceCentroids(void *data, int start, int end) {
+  LloydWorkspace *ws = ((CentroidJob *)data)->ws;
+  SiteGrid *grid = &ws->grid;
+  Vector2 polygon[MAX_CLIP_VERTICES];
+  for (int slot = start; slot < end; slot++) {
+    int count = WorkspaceCell(grid, slot, polygon);
+    int i = grid->sortedSite[slot];
+    Vector2 p = {grid->sortedX[slot], grid->sortedY[slot]};
+    ws->centroids[i] = p;
+    if (count >= 3) {
+      // Relative to the site, sets can sit anywhere without the centroid
+      // sums losing precision
+      for (int k = 0; k < count; k++) {
+        polygon[k] = Vector2Subtract(polygon[k], p);
+      }
+      ws->centroids[i] = Vector2Add(p, ComputeTrueCentroid(polygon, count));
+    }
+  }
+}
+
+// Plain Lloyd on one set, every cell built from the grid alone so the only
+// state is the workspace. Stops once no site moves more than tolerance.
+// The cells are split over the job threads when parallel is set, which
+// callers already running on a job thread must not ask for.
+static void RelaxSites(LloydWorkspace *ws, EnsembleSet *set, float tolerance,
+                       bool32 parallel) {
+  int n = set->numSites;
+  set->iterationsRun = 0;
+  set->movement = 0;
+  SiteGrid *grid = &ws->grid;
+  if (n <= 0 || n > grid->maxSites) {
+    return;
+  }
+
+  CentroidJob job = {ws};
+  for (int it = 0; it < set->iterations; it++) {
+    BuildSiteGrid(grid, set->sites, n, set->box);
+    if (parallel) {
+      ParallelFor(n, 256, RunWorkspaceCentroids, &job);
+    } else {
+      RunWorkspaceCentroids(&job, 0, n);
+    }
+
+    float movement = 0;
+    for (int i = 0; i < n; i++) {
+      movement = fmaxf(movement, Vector2Distance(set->sites[i],
+                                                 ws->centroids[i]));
+      set->sites[i] = ws->centroids[i];
+    }
+    set->movement = movement;
+    set->iterationsRun = it + 1;
+    if (movement <= tolerance) {
+      break;
+    }
+  }
+}
+
+void RelaxSiteSet(LloydWorkspace *ws, EnsembleSet *set, float tolerance) {
+  RelaxSites(ws, set, tolerance, 0);
+}
+
+// One large set with its cells spread over every core
+void RelaxSiteSetParallel(LloydWorkspace *ws, EnsembleSet *set,
+                          float tolerance) {
+  RelaxSites(ws, set, tolerance, 1);
+}
+
+typedef struct {
+  EnsembleSet *sets;
+  const int *order;
+  int numSets;
+  LloydWorkspace *workspaces;
+  float tolerance;
+  int next;
+} EnsembleJob;
+
+static void RunEnsembleWorkers(void *data, int start, int end) {
+  EnsembleJob *job = (EnsembleJob *)data;
+  for (int worker = start; worker < end; worker++) {
+    LloydWorkspace *ws = &job->workspaces[worker];
+    // Sets are claimed one at a time, so a worker that drew small sets
+    // simply takes more of them
+    for (;;) {
+      int k = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+      if (k >= job->numSets) {
+        break;
+      }
+      RelaxSiteSet(ws, &job->sets[job->order[k]], job->tolerance);
+    }
+  }
+}
+
+typedef struct {
+  int numSites;
+  int index;
+} SetSize;
+
+// Descending by site count, ties in index order so the schedule is stable
+static int CompareSetSizes(const void *a, const void *b) {
+  const SetSize *s = (const SetSize *)a;
+  const SetSize *t = (const SetSize *)b;
+  if (s->numSites != t->numSites) {
+    return (s->numSites < t->numSites) - (s->numSites > t->numSites);
+  }
+  return (s->index > t->index) - (s->index < t->index);
+}
+
+// Relaxes numSets independent site sets concurrently, in place. One worker
+// per core, each with its own workspace sized for the largest set; fewer
+// workers are used when their workspaces would not fit in memoryBudget bytes.
+// Sets are handed out largest first so the long ones do not end up last.
+// Returns the number of workers used, 0 if not even one fits.
+int RelaxEnsemble(EnsembleSet *sets, int numSets, memory_arena *arena,
+                  uint64 memoryBudget, float tolerance) {
+  if (numSets <= 0) {
+    return 0;
+  }
+
+  uint64 used = arena->used;
+  int maxSites = 1;
+  for (int k = 0; k < numSets; k++) {
+    if (sets[k].numSites > maxSites) {
+      maxSites = sets[k].numSites;
+    }
+  }
+
+  int *order = PushArray(arena, numSets, int);
+  SetSize *sizes = PushArray(arena, numSets, SetSize);
+  if (!order || !sizes) {
+    arena->used = used;
+    return 0;
+  }
+
+  uint64 perWorker = WorkspaceSize(maxSites) + sizeof(LloydWorkspace);
+  int workers = JobThreadCount();
+  if (workers > numSets) {
+    workers = numSets;
+  }
+  if ((uint64)workers * perWorker > memoryBudget) {
+    workers = (int)(memoryBudget / perWorker);
+  }
+  LloydWorkspace *workspaces = PushArray(arena, workers, LloydWorkspace);
+  for (int w = 0; workspaces && w < workers; w++) {
+    if (!InitLloydWorkspace(&workspaces[w], arena, maxSites)) {
+      workers = w;
+    }
+  }
+  if (!workspaces || workers < 1) {
+    arena->used = used;
+    return 0;
+  }
+
+  // Largest first
+  for (int k = 0; k < numSets; k++) {
+    sizes[k] = (SetSize){sets[k].numSites, k};
+  }
+  qsort(sizes, numSets, sizeof(SetSize), CompareSetSizes);
+  for (int k = 0; k < numSets; k++) {
+    order[k] = sizes[k].index;
+  }
+
+  EnsembleJob job = {sets, order, numSets, workspaces, tolerance, 0};
+  ParallelFor(workers, 1, RunEnsembleWorkers, &job);
+
+  arena->used = used;
+  return workers;
+}
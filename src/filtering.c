@@ -0,0 +1,530 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+
+#include "gui.h"
+
+#define FILTER_LEAF 8
+// Subtrees per thread, so uneven pruning still balances
+#define FILTER_TASKS_PER_THREAD 4
+#define MIN_TASK_POINTS (4 * FILTER_LEAF)
+
+static inline const float *PointAt(const KMeans *km, int i) {
+  return &km->points[(uint64)i * km->dim];
+}
+
+static inline const float *CentreAt(const KMeans *km, int j) {
+  return &km->centres[(uint64)j * km->dim];
+}
+
+static inline double SquaredDistance(const float *a, const float *b,
+                                     int dim) {
+  double sum = 0;
+  for (int d = 0; d < dim; d++) {
+    double delta = (double)a[d] - b[d];
+    sum += delta * delta;
+  }
+  return sum;
+}
+
+// Nodes taken by the subtree over count points; the layout is depth-first,
+// so a node's left child follows it and its right child follows the left
+// child's subtree
+static int NodeCount(int count) {
+  if (count <= FILTER_LEAF) {
+    return 1;
+  }
+  return 1 + NodeCount(count / 2) + NodeCount(count - count / 2);
+}
+
+static int TreeDepth(int count) {
+  int depth = 1;
+  while (count > FILTER_LEAF) {
+    count -= count / 2;
+    depth++;
+  }
+  return depth;
+}
+
+static void NodeBounds(KMeansTree *tree, const KMeans *km, int node) {
+  int dim = km->dim;
+  KMeansTreeNode *n = &tree->nodes[node];
+  float *lo = &tree->lo[(uint64)node * dim];
+  float *hi = &tree->hi[(uint64)node * dim];
+  for (int d = 0; d < dim; d++) {
+    lo[d] = INFINITY;
+    hi[d] = -INFINITY;
+  }
+  for (int s = n->start; s < n->start + n->count; s++) {
+    const float *p = PointAt(km, tree->order[s]);
+    for (int d = 0; d < dim; d++) {
+      lo[d] = p[d] < lo[d] ? p[d] : lo[d];
+      hi[d] = p[d] > hi[d] ? p[d] : hi[d];
+    }
+  }
+}
+
+// Bounds the node and moves the median along its widest side to the middle
+// of its points, the smaller half in front
+static void SplitNode(KMeansTree *tree, const KMeans *km, int node) {
+  NodeBounds(tree, km, node);
+  int dim = km->dim;
+  const float *lo = &tree->lo[(uint64)node * dim];
+  const float *hi = &tree->hi[(uint64)node * dim];
+  int axis = 0;
+  for (int d = 1; d < dim; d++) {
+    if (hi[d] - lo[d] > hi[axis] - lo[axis]) {
+      axis = d;
+    }
+  }
+
+  KMeansTreeNode *n = &tree->nodes[node];
+  int *order = tree->order;
+  int start = n->start, end = n->start + n->count;
+  int mid = start + n->count / 2;
+  while (end - start > 1) {
+    float pivot = PointAt(km, order[(start + end) / 2])[axis];
+    int a = start, b = end - 1;
+    while (a <= b) {
+      while (PointAt(km, order[a])[axis] < pivot) {
+        a++;
+      }
+      while (PointAt(km, order[b])[axis] > pivot) {
+        b--;
+      }
+      if (a <= b) {
+        int swap = order[a];
+        order[a++] = order[b];
+        order[b--] = swap;
+      }
+    }
+    if (mid <= b) {
+      end = b + 1;
+    } else if (mid >= a) {
+      start = a;
+    } else {
+      break;
+    }
+  }
+}
+
+static void SumLeaf(KMeansTree *tree, const KMeans *km, int node) {
+  int dim = km->dim;
+  KMeansTreeNode *n = &tree->nodes[node];
+  double *sum = &tree->sums[(uint64)node * dim];
+  memset(sum, 0, dim * sizeof(double));
+  for (int s = n->start; s < n->start + n->count; s++) {
+    const float *p = PointAt(km, tree->order[s]);
+    for (int d = 0; d < dim; d++) {
+      sum[d] += p[d];
+    }
+  }
+}
+
+static void SumChildren(KMeansTree *tree, int dim, int node) {
+  double *sum = &tree->sums[(uint64)node * dim];
+  const double *left = &tree->sums[(uint64)(node + 1) * dim];
+  const double *right = &tree->sums[(uint64)tree->nodes[node].right * dim];
+  for (int d = 0; d < dim; d++) {
+    sum[d] = left[d] + right[d];
+  }
+}
+
+static void InitNode(KMeansTree *tree, int node, int start, int count) {
+  tree->nodes[node] = (KMeansTreeNode){start, count, -1, -1, 0};
+}
+
+// Returns the number of nodes used
+static int BuildSubtree(KMeansTree *tree, const KMeans *km, int node,
+                        int start, int count) {
+  InitNode(tree, node, start, count);
+  if (count <= FILTER_LEAF) {
+    NodeBounds(tree, km, node);
+    SumLeaf(tree, km, node);
+    return 1;
+  }
+  SplitNode(tree, km, node);
+  int half = count / 2;
+  int left = BuildSubtree(tree, km, node + 1, start, half);
+  tree->nodes[node].right = node + 1 + left;
+  int right = BuildSubtree(tree, km, node + 1 + left, start + half,
+                           count - half);
+  SumChildren(tree, km->dim, node);
+  return 1 + left + right;
+}
+
+// Splits serially down to subtrees of at most taskSize points, which become
+// the tasks built and filtered in parallel
+static void SplitTop(KMeansTree *tree, const KMeans *km, int node, int start,
+                     int count, int taskSize) {
+  InitNode(tree, node, start, count);
+  if (count <= taskSize || count <= FILTER_LEAF) {
+    tree->tasks[tree->numTasks++] = node;
+    return;
+  }
+  tree->topNodes[tree->numTopNodes++] = node;
+  SplitNode(tree, km, node);
+  int half = count / 2;
+  int right = node + 1 + NodeCount(half);
+  tree->nodes[node].right = right;
+  SplitTop(tree, km, node + 1, start, half, taskSize);
+  SplitTop(tree, km, right, start + half, count - half, taskSize);
+}
+
+typedef struct {
+  KMeansTree *tree;
+  const KMeans *km;
+} BuildJob;
+
+static void RunBuildTasks(void *data, int start, int end) {
+  BuildJob *job = (BuildJob *)data;
+  KMeansTree *tree = job->tree;
+  for (int t = start; t < end; t++) {
+    KMeansTreeNode *n = &tree->nodes[tree->tasks[t]];
+    BuildSubtree(tree, job->km, tree->tasks[t], n->start, n->count);
+  }
+}
+
+// Builds the k-d tree over the points for the filtering backend and sets
+// km->tree. Returns 0 if the points are weighted or the arena is too small.
+bool32 BuildKMeansTree(KMeans *km, memory_arena *arena) {
+  if (km->weights) {
+    return 0;
+  }
+  int n = km->numPoints, dim = km->dim, k = km->k;
+  int threads = JobThreadCount();
+  int taskSize = (n + threads * FILTER_TASKS_PER_THREAD - 1) /
+                 (threads * FILTER_TASKS_PER_THREAD);
+  taskSize = taskSize > MIN_TASK_POINTS ? taskSize : MIN_TASK_POINTS;
+  // Every task holds more than half of taskSize points
+  int maxTasks = 2 * (n / taskSize) + 2;
+
+  KMeansTree *tree = PushStruct(arena, KMeansTree);
+  if (!tree) {
+    return 0;
+  }
+  memset(tree, 0, sizeof(*tree));
+  tree->numNodes = NodeCount(n);
+  tree->maxDepth = TreeDepth(n);
+  tree->workers = threads < maxTasks ? threads : maxTasks;
+  tree->nodes = PushArray(arena, tree->numNodes, KMeansTreeNode);
+  tree->order = PushArray(arena, n, int);
+  tree->lo = PushArray(arena, (uint64)tree->numNodes * dim, float);
+  tree->hi = PushArray(arena, (uint64)tree->numNodes * dim, float);
+  tree->sums = PushArray(arena, (uint64)tree->numNodes * dim, double);
+  tree->tasks = PushArray(arena, maxTasks, int);
+  tree->topNodes = PushArray(arena, maxTasks, int);
+  tree->taskCandidates = PushArray(arena, (uint64)maxTasks * k, int);
+  tree->taskNumCandidates = PushArray(arena, maxTasks, int);
+  tree->taskInherited = PushArray(arena, maxTasks, int);
+  tree->lists = PushArray(
+      arena, (uint64)tree->workers * (tree->maxDepth + 1) * k, int);
+  tree->workerSums = PushArray(arena, (uint64)tree->workers * k * dim, double);
+  tree->workerCounts = PushArray(arena, (uint64)tree->workers * k, int);
+  if (!tree->nodes || !tree->order || !tree->lo || !tree->hi ||
+      !tree->sums || !tree->tasks || !tree->topNodes ||
+      !tree->taskCandidates || !tree->taskNumCandidates ||
+      !tree->taskInherited || !tree->lists ||
+      !tree->workerSums || !tree->workerCounts) {
+    return 0;
+  }
+
+  for (int i = 0; i < n; i++) {
+    tree->order[i] = i;
+  }
+  SplitTop(tree, km, 0, 0, n, taskSize);
+  BuildJob job = {tree, km};
+  ParallelFor(tree->numTasks, 1, RunBuildTasks, &job);
+  for (int t = tree->numTopNodes - 1; t >= 0; t--) {
+    SumChildren(tree, dim, tree->topNodes[t]);
+  }
+  km->tree = tree;
+  return 1;
+}
+
+typedef struct {
+  KMeans *km;
+  KMeansTree *tree;
+  int *lists;
+  double *sums;
+  int *counts;
+  bool32 writeAssignment;
+  int changed;
+  uint64 distances;
+  uint64 visited;
+} Filter;
+
+// Centre the node took as a whole in the previous pass, from the node itself
+// or from the ancestor that took it; -1 if it was split
+static inline int PreviousOwner(const KMeansTree *tree, int node,
+                                int inherited) {
+  const KMeansTreeNode *n = &tree->nodes[node];
+  return n->pass == tree->pass - 1 ? n->owner : inherited;
+}
+
+// Hands every point under the node to centre c through the node's sums
+static void TakeNode(Filter *f, int node, int c, int previous) {
+  KMeans *km = f->km;
+  KMeansTree *tree = f->tree;
+  KMeansTreeNode *n = &tree->nodes[node];
+  int dim = km->dim;
+  const double *sum = &tree->sums[(uint64)node * dim];
+  double *to = &f->sums[(uint64)c * dim];
+  for (int d = 0; d < dim; d++) {
+    to[d] += sum[d];
+  }
+  f->counts[c] += n->count;
+  // A node that split last time may have had some points at c already; they
+  // are counted as changed, which only matters before convergence
+  if (previous != c) {
+    f->changed += n->count;
+  }
+  n->owner = c;
+  n->pass = tree->pass;
+  if (f->writeAssignment) {
+    for (int s = n->start; s < n->start + n->count; s++) {
+      km->assignment[tree->order[s]] = c;
+    }
+  }
+}
+
+static void FilterLeaf(Filter *f, int node, const int *z, int nz,
+                       int previous) {
+  KMeans *km = f->km;
+  KMeansTree *tree = f->tree;
+  KMeansTreeNode *n = &tree->nodes[node];
+  int dim = km->dim;
+  for (int s = n->start; s < n->start + n->count; s++) {
+    int i = tree->order[s];
+    const float *p = PointAt(km, i);
+    int best = z[0];
+    double bestDistance = INFINITY;
+    for (int c = 0; c < nz; c++) {
+      double distance = SquaredDistance(p, CentreAt(km, z[c]), dim);
+      if (distance < bestDistance) {
+        bestDistance = distance;
+        best = z[c];
+      }
+    }
+    double *to = &f->sums[(uint64)best * dim];
+    for (int d = 0; d < dim; d++) {
+      to[d] += p[d];
+    }
+    f->counts[best]++;
+    int before = previous >= 0 ? previous : km->assignment[i];
+    f->changed += before != best;
+    km->assignment[i] = best;
+  }
+  f->distances += (uint64)n->count * nz;
+  n->owner = -1;
+  n->pass = tree->pass;
+}
+
+// Kanungo's test: z is farther than best from all of the box when it is
+// farther at the box corner furthest along z - best. Ties go to the lower
+// index, as in the plain search.
+static bool32 Dominated(const float *z, const float *best, int zIndex,
+                        int bestIndex, const float *lo, const float *hi,
+                        int dim) {
+  double dz = 0, db = 0;
+  for (int d = 0; d < dim; d++) {
+    double v = z[d] > best[d] ? hi[d] : lo[d];
+    double a = (double)z[d] - v, b = (double)best[d] - v;
+    dz += a * a;
+    db += b * b;
+  }
+  return dz > db || (dz == db && zIndex > bestIndex);
+}
+
+// Drops the candidates that cannot own any of the node's points into this
+// depth's list. Returns how many are kept, the nearest to the box centre
+// first in *best.
+static int PruneCandidates(Filter *f, int node, const int *z, int nz,
+                           int *kept, int *best) {
+  KMeans *km = f->km;
+  KMeansTree *tree = f->tree;
+  int dim = km->dim;
+  const float *lo = &tree->lo[(uint64)node * dim];
+  const float *hi = &tree->hi[(uint64)node * dim];
+
+  int nearest = z[0];
+  double nearestDistance = INFINITY;
+  for (int c = 0; c < nz; c++) {
+    const float *centre = CentreAt(km, z[c]);
+    double distance = 0;
+    for (int d = 0; d < dim; d++) {
+      double delta = 0.5 * ((double)lo[d] + hi[d]) - centre[d];
+      distance += delta * delta;
+    }
+    if (distance < nearestDistance) {
+      nearestDistance = distance;
+      nearest = z[c];
+    }
+  }
+  f->distances += 2 * nz - 1;
+
+  int numKept = 0;
+  const float *nearestCentre = CentreAt(km, nearest);
+  for (int c = 0; c < nz; c++) {
+    if (z[c] == nearest || !Dominated(CentreAt(km, z[c]), nearestCentre,
+                                      z[c], nearest, lo, hi, dim)) {
+      kept[numKept++] = z[c];
+    }
+  }
+  *best = nearest;
+  return numKept;
+}
+
+static void FilterNode(Filter *f, int node, const int *z, int nz, int depth,
+                       int inherited) {
+  KMeansTree *tree = f->tree;
+  KMeansTreeNode *n = &tree->nodes[node];
+  int previous = PreviousOwner(tree, node, inherited);
+  f->visited++;
+  if (nz == 1) {
+    TakeNode(f, node, z[0], previous);
+    return;
+  }
+  if (n->right < 0) {
+    FilterLeaf(f, node, z, nz, previous);
+    return;
+  }
+
+  // The children filter into the next depth's list and leave this one alone
+  int *kept = &f->lists[(uint64)(depth + 1) * f->km->k];
+  int best;
+  int numKept = PruneCandidates(f, node, z, nz, kept, &best);
+  if (numKept == 1) {
+    TakeNode(f, node, best, previous);
+    return;
+  }
+  n->owner = -1;
+  n->pass = tree->pass;
+  FilterNode(f, node + 1, kept, numKept, depth + 1, previous);
+  FilterNode(f, n->right, kept, numKept, depth + 1, previous);
+}
+
+// Filters the top of the tree serially, leaving each task its candidates
+// and the owner it inherits; a task whose subtree was taken whole gets no
+// candidates
+static void FilterTop(Filter *f, int node, const int *z, int nz, int depth,
+                      int inherited, int *nextTask) {
+  KMeansTree *tree = f->tree;
+  KMeansTreeNode *n = &tree->nodes[node];
+  int k = f->km->k;
+  int t = *nextTask;
+  if (t < tree->numTasks && tree->tasks[t] == node) {
+    memcpy(&tree->taskCandidates[(uint64)t * k], z, nz * sizeof(int));
+    tree->taskNumCandidates[t] = nz;
+    tree->taskInherited[t] = inherited;
+    (*nextTask)++;
+    return;
+  }
+
+  int previous = PreviousOwner(tree, node, inherited);
+  f->visited++;
+  int *kept = &f->lists[(uint64)(depth + 1) * k];
+  int best = z[0];
+  int numKept = nz == 1 ? 1 : PruneCandidates(f, node, z, nz, kept, &best);
+  if (numKept == 1) {
+    TakeNode(f, node, best, previous);
+    // Skip the tasks under it
+    while (*nextTask < tree->numTasks &&
+           tree->nodes[tree->tasks[*nextTask]].start < n->start + n->count) {
+      tree->taskNumCandidates[(*nextTask)++] = 0;
+    }
+    return;
+  }
+  n->owner = -1;
+  n->pass = tree->pass;
+  FilterTop(f, node + 1, kept, numKept, depth + 1, previous, nextTask);
+  FilterTop(f, n->right, kept, numKept, depth + 1, previous, nextTask);
+}
+
+typedef struct {
+  KMeans *km;
+  bool32 writeAssignment;
+  int changed;
+  uint64 distances;
+  uint64 visited;
+} FilterJob;
+
+static Filter WorkerFilter(KMeans *km, int worker, bool32 writeAssignment) {
+  KMeansTree *tree = km->tree;
+  Filter f = {0};
+  f.km = km;
+  f.tree = tree;
+  f.lists = &tree->lists[(uint64)worker * (tree->maxDepth + 1) * km->k];
+  f.sums = &tree->workerSums[(uint64)worker * km->k * km->dim];
+  f.counts = &tree->workerCounts[(uint64)worker * km->k];
+  f.writeAssignment = writeAssignment;
+  return f;
+}
+
+// Worker w takes tasks w, w + workers, ... so the sums each worker adds up,
+// and with them the centres, do not depend on timing
+static void RunFilterTasks(void *data, int start, int end) {
+  FilterJob *job = (FilterJob *)data;
+  KMeansTree *tree = job->km->tree;
+  for (int w = start; w < end; w++) {
+    Filter f = WorkerFilter(job->km, w, job->writeAssignment);
+    for (int t = w; t < tree->numTasks; t += tree->workers) {
+      if (tree->taskNumCandidates[t] > 0) {
+        FilterNode(&f, tree->tasks[t],
+                   &tree->taskCandidates[(uint64)t * job->km->k],
+                   tree->taskNumCandidates[t], 0, tree->taskInherited[t]);
+      }
+    }
+    __atomic_fetch_add(&job->changed, f.changed, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&job->distances, f.distances, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&job->visited, f.visited, __ATOMIC_RELAXED);
+  }
+}
+
+// One assignment pass of Kanungo et al.'s filtering algorithm: each node
+// passes down only the centres that may own some of its box, and a node left
+// with one is handed to it whole through its precomputed sums. Fills
+// km->sums and the counts in clusterStart for the update. The per-point
+// assignment is only complete when writeAssignment is set.
+void FilterKMeansTree(KMeans *km, bool32 writeAssignment) {
+  KMeansTree *tree = km->tree;
+  int k = km->k, dim = km->dim;
+  tree->pass++;
+  memset(tree->workerSums, 0, (uint64)tree->workers * k * dim * sizeof(double));
+  memset(tree->workerCounts, 0, (uint64)tree->workers * k * sizeof(int));
+
+  Filter top = WorkerFilter(km, 0, writeAssignment);
+  int *all = top.lists;
+  for (int j = 0; j < k; j++) {
+    all[j] = j;
+  }
+  int nextTask = 0;
+  FilterTop(&top, 0, all, k, 0, -1, &nextTask);
+
+  FilterJob job = {km, writeAssignment, top.changed, top.distances,
+                   top.visited};
+  ParallelFor(tree->workers, 1, RunFilterTasks, &job);
+
+  // Reduce in worker order
+  int total = 0;
+  for (int j = 0; j < k; j++) {
+    double *sum = &km->sums[(uint64)j * dim];
+    memset(sum, 0, dim * sizeof(double));
+    int count = 0;
+    for (int w = 0; w < tree->workers; w++) {
+      const double *from = &tree->workerSums[((uint64)w * k + j) * dim];
+      for (int d = 0; d < dim; d++) {
+        sum[d] += from[d];
+      }
+      count += tree->workerCounts[(uint64)w * k + j];
+    }
+    km->clusterStart[j] = total;
+    total += count;
+  }
+  km->clusterStart[k] = total;
+
+  km->changed = km->iteration == 0 ? km->numPoints : job.changed;
+  km->distances += job.distances;
+  tree->nodesVisited = job.visited;
+}
@@ -0,0 +1,113 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+// A long thin box rounds up a whole row or column of cells, so leave room
+// for one cell per site on top of the usual count
+static inline int SiteGridCells(int maxSites, float sitesPerCell) {
+  return (int)(maxSites / sitesPerCell) + maxSites + 64;
+}
+
+// Bytes InitSiteGrid takes from the arena, alignment included
+uint64 SiteGridSize(int maxSites, float sitesPerCell) {
+  uint64 coordinates = 2 * (uint64)(maxSites + 4) * sizeof(float);
+  uint64 indices = 2 * (uint64)maxSites * sizeof(int);
+  return (uint64)(SiteGridCells(maxSites, sitesPerCell) + 1) * sizeof(int) +
+         coordinates + indices + 5 * 16;
+}
+
+bool32 InitSiteGrid(SiteGrid *grid, memory_arena *arena, int maxSites,
+                    float sitesPerCell) {
+  memset(grid, 0, sizeof(*grid));
+  grid->maxSites = maxSites;
+  grid->sitesPerCell = sitesPerCell;
+  grid->maxCells = SiteGridCells(maxSites, sitesPerCell);
+  grid->cellStart = PushArray(arena, grid->maxCells + 1, int);
+  grid->sortedX = PushArray(arena, maxSites + 4, float);
+  grid->sortedY = PushArray(arena, maxSites + 4, float);
+  grid->sortedSite = PushArray(arena, maxSites, int);
+  grid->siteCell = PushArray(arena, maxSites, int);
+  return grid->cellStart && grid->sortedX && grid->sortedY &&
+         grid->sortedSite && grid->siteCell;
+}
+
+void SiteGridCoords(const SiteGrid *grid, Vector2 p, int *cx, int *cy) {
+  *cx = CLAMP((int)((p.x - grid->box.x) / grid->cellSize), 0, grid->gridW - 1);
+  *cy = CLAMP((int)((p.y - grid->box.y) / grid->cellSize), 0, grid->gridH - 1);
+}
+
+// Counting sort of n sites into square cells over box, about sitesPerCell
+// to a cell. n must not exceed the grid's maxSites.
+void BuildSiteGrid(SiteGrid *grid, const Vector2 *sites, int n,
+                   Rectangle box) {
+  grid->box = box;
+  grid->numSites = n;
+  grid->cellSize =
+      sqrtf(box.width * box.height * grid->sitesPerCell / (n > 0 ? n : 1));
+  grid->gridW = (int)ceilf(box.width / grid->cellSize);
+  grid->gridH = (int)ceilf(box.height / grid->cellSize);
+  grid->gridW = CLAMP(grid->gridW, 1, grid->maxCells);
+  grid->gridH = CLAMP(grid->gridH, 1, grid->maxCells / grid->gridW);
+
+  int numCells = grid->gridW * grid->gridH;
+  memset(grid->cellStart, 0, (numCells + 1) * sizeof(int));
+  for (int i = 0; i < n; i++) {
+    int cx, cy;
+    SiteGridCoords(grid, sites[i], &cx, &cy);
+    grid->siteCell[i] = cy * grid->gridW + cx;
+    grid->cellStart[grid->siteCell[i] + 1]++;
+  }
+  for (int c = 0; c < numCells; c++) {
+    grid->cellStart[c + 1] += grid->cellStart[c];
+  }
+  for (int i = 0; i < n; i++) {
+    int slot = grid->cellStart[grid->siteCell[i]]++;
+    grid->sortedX[slot] = sites[i].x;
+    grid->sortedY[slot] = sites[i].y;
+    grid->sortedSite[slot] = i;
+  }
+  for (int c = numCells; c > 0; c--) {
+    grid->cellStart[c] = grid->cellStart[c - 1];
+  }
+  grid->cellStart[0] = 0;
+}
+
+int SiteGridSlot(const SiteGrid *grid, int site) {
+  int slot = grid->cellStart[grid->siteCell[site]];
+  while (grid->sortedSite[slot] != site) {
+    slot++;
+  }
+  return slot;
+}
+
+// Calls visit for every sorted slot in the cells at Chebyshev distance r from
+// cell (cx, cy), the border of a (2r + 1)^2 block. Returns 0 once the ring
+// lies entirely outside the grid, so callers know nothing further out is left.
+bool32 VisitSiteGridRing(const SiteGrid *grid, int cx, int cy, int r,
+                         GridShellVisit *visit, void *data) {
+  bool32 inside = 0;
+  for (int y = cy - r; y <= cy + r; y++) {
+    if (y < 0 || y >= grid->gridH) {
+      continue;
+    }
+    // The first and last rows are walked in full, the others only at their
+    // two ends
+    bool32 edgeRow = (y == cy - r || y == cy + r);
+    int step = (edgeRow || r == 0) ? 1 : 2 * r;
+    for (int x = cx - r; x <= cx + r; x += step) {
+      if (x < 0 || x >= grid->gridW) {
+        continue;
+      }
+      inside = 1;
+      int cell = y * grid->gridW + x;
+      for (int k = grid->cellStart[cell]; k < grid->cellStart[cell + 1]; k++) {
+        visit(data, k);
+      }
+    }
+  }
+  return inside;
+}
@@ -0,0 +1,112 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+bool32 InitSiteGrid3(SiteGrid3 *grid, memory_arena *arena, int numSites,
+                     BoundingBox box, float cellSize, int maxCellsPerAxis) {
+  memset(grid, 0, sizeof(*grid));
+  grid->numSites = numSites;
+  grid->min = box.min;
+
+  // Grow the cells until the grid fits in maxCellsPerAxis along every axis
+  Vector3 size = Vector3Subtract(box.max, box.min);
+  float longest = fmaxf(size.x, fmaxf(size.y, size.z));
+  if (cellSize * maxCellsPerAxis < longest) {
+    cellSize = longest / maxCellsPerAxis;
+  }
+  grid->cellSize = cellSize;
+  grid->dims[0] = CLAMP((int)ceilf(size.x / cellSize), 1, maxCellsPerAxis);
+  grid->dims[1] = CLAMP((int)ceilf(size.y / cellSize), 1, maxCellsPerAxis);
+  grid->dims[2] = CLAMP((int)ceilf(size.z / cellSize), 1, maxCellsPerAxis);
+
+  int numCells = grid->dims[0] * grid->dims[1] * grid->dims[2];
+  grid->cellStart = PushArray(arena, numCells + 1, int);
+  grid->sorted = PushArray(arena, numSites, Vector3);
+  grid->sortedSite = PushArray(arena, numSites, int);
+  grid->siteCell = PushArray(arena, numSites, int);
+  return grid->cellStart && grid->sorted && grid->sortedSite &&
+         grid->siteCell;
+}
+
+static inline int GridCell3(const SiteGrid3 *grid, const int c[3]) {
+  return (c[2] * grid->dims[1] + c[1]) * grid->dims[0] + c[0];
+}
+
+void SiteGrid3Coords(const SiteGrid3 *grid, Vector3 p, int c[3]) {
+  float x[3] = {p.x - grid->min.x, p.y - grid->min.y, p.z - grid->min.z};
+  for (int axis = 0; axis < 3; axis++) {
+    c[axis] = CLAMP((int)(x[axis] / grid->cellSize), 0, grid->dims[axis] - 1);
+  }
+}
+
+// Counting sort of the sites into grid cells, the same layout as the
+// stochastic Lloyd grid but in three dimensions
+void BuildSiteGrid3(SiteGrid3 *grid, const Vector3 *sites) {
+  int numCells = grid->dims[0] * grid->dims[1] * grid->dims[2];
+  memset(grid->cellStart, 0, (numCells + 1) * sizeof(int));
+  for (int i = 0; i < grid->numSites; i++) {
+    int c[3];
+    SiteGrid3Coords(grid, sites[i], c);
+    grid->siteCell[i] = GridCell3(grid, c);
+    grid->cellStart[grid->siteCell[i] + 1]++;
+  }
+  for (int c = 0; c < numCells; c++) {
+    grid->cellStart[c + 1] += grid->cellStart[c];
+  }
+  for (int i = 0; i < grid->numSites; i++) {
+    int slot = grid->cellStart[grid->siteCell[i]]++;
+    grid->sorted[slot] = sites[i];
+    grid->sortedSite[slot] = i;
+  }
+  for (int c = numCells; c > 0; c--) {
+    grid->cellStart[c] = grid->cellStart[c - 1];
+  }
+  grid->cellStart[0] = 0;
+}
+
+int SiteGrid3Slot(const SiteGrid3 *grid, int site) {
+  int slot = grid->cellStart[grid->siteCell[site]];
+  while (grid->sortedSite[slot] != site) {
+    slot++;
+  }
+  return slot;
+}
+
+// Calls visit for every sorted slot in the cells at Chebyshev distance r from
+// cell c, the surface of a (2r + 1)^3 block. Returns 0 once the shell lies
+// entirely outside the grid, so callers know nothing further out is left.
+bool32 VisitSiteGrid3Shell(const SiteGrid3 *grid, const int c[3], int r,
+                           GridShellVisit *visit, void *data) {
+  bool32 inside = 0;
+  for (int z = c[2] - r; z <= c[2] + r; z++) {
+    if (z < 0 || z >= grid->dims[2]) {
+      continue;
+    }
+    for (int y = c[1] - r; y <= c[1] + r; y++) {
+      if (y < 0 || y >= grid->dims[1]) {
+        continue;
+      }
+      // Rows on the block's faces are walked in full, the others only at
+      // their two ends
+      bool32 faceRow =
+          (z == c[2] - r || z == c[2] + r || y == c[1] - r || y == c[1] + r);
+      int step = (faceRow || r == 0) ? 1 : 2 * r;
+      for (int x = c[0] - r; x <= c[0] + r; x += step) {
+        if (x < 0 || x >= grid->dims[0]) {
+          continue;
+        }
+        inside = 1;
+        int cell = (z * grid->dims[1] + y) * grid->dims[0] + x;
+        for (int k = grid->cellStart[cell]; k < grid->cellStart[cell + 1];
+             k++) {
+          visit(data, k);
+        }
+      }
+    }
+  }
+  return inside;
+}
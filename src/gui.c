@@ -11,6 +11,16 @@
 
 #define APP_PLUG
 
+// Fixed so every run starts from the same sites
+#define SITES_SEED 0x5eed
+
+// Relaxation gets what is left of a 60 Hz frame after drawing
+#define LLOYD_FRAME_BUDGET 0.008
+#define LLOYD_CHUNK_CELLS 64
+
+// Pixels per second the sites drift at in kinetic mode
+#define KINETIC_SPEED 40.0f
+
 static float Magnitude(Vector2 v) {
   float result = sqrt(v.x * v.x + v.y * v.y);
   return result;
@@ -160,11 +170,12 @@ BeachlineItem *allocateBeachlineItem(FortuneState *state) {
   return NULL; // No more items available
 }
 
-BeachlineItem *createArc(Vector2 focus, FortuneState *state) {
+BeachlineItem *createArc(Vector2 focus, int site, FortuneState *state) {
   if (state->beachlineItemCount < MAX_BEACHLINE_ITEMS) {
     BeachlineItem *item = &state->beachlineItems[state->beachlineItemCount++];
     item->type = Arc;
     item->arc.focus = focus;
+    item->arc.site = site;
     item->arc.squeezeEvent = NULL;
     item->parent = NULL;
     item->left = NULL;
@@ -482,9 +493,11 @@ BeachlineItem *AddArcToBeachline(EventQueue *eventQueue, FortuneState *state,
       GetActiveArcForXCoord(root, newPoint.x, sweepLineY);
   assert(replacedArc != NULL && replacedArc->type == Arc);
 
-  BeachlineItem *splitArcLeft = createArc(replacedArc->arc.focus, state);
-  BeachlineItem *splitArcRight = createArc(replacedArc->arc.focus, state);
-  BeachlineItem *newArc = createArc(newPoint, state);
+  BeachlineItem *splitArcLeft =
+      createArc(replacedArc->arc.focus, replacedArc->arc.site, state);
+  BeachlineItem *splitArcRight =
+      createArc(replacedArc->arc.focus, replacedArc->arc.site, state);
+  BeachlineItem *newArc = createArc(newPoint, evt->newPoint.site, state);
 
   float intersectionY =
       GetArcYForXCoord(&replacedArc->arc, newPoint.x, sweepLineY);
@@ -618,6 +631,15 @@ BeachlineItem *RemoveArcFromBeachline(EventQueue *eventQueue,
   assert(leftArc && rightArc && leftArc != rightArc);
 
   Vector2 circleCentre = evt->edgeIntersect.intersectionPoint;
+
+  // Each circle event is the circumcircle of one Delaunay triangle
+  if (state->trianglesSize < MAX_TRIANGLES) {
+    SiteTriangle *tri = &state->triangles[state->trianglesSize++];
+    tri->sites[0] = leftArc->arc.site;
+    tri->sites[1] = squeezedArc->arc.site;
+    tri->sites[2] = rightArc->arc.site;
+  }
+
   if (state->edgesSize < MAX_EDGES - 1) {
     CompleteEdge *edgeA = &state->edges[state->edgesSize++];
     edgeA->endpointA = leftEdge->edge.start;
@@ -700,6 +722,7 @@ FortuneState FortunesAlgorithm(struct app_state *AppState, float cutoffY) {
   FortuneState result = AppState->fortuneState;
   result.eventsSize = 0;
   result.edgesSize = 0;
+  result.trianglesSize = 0;
   result.beachlineItemCount = 0;
   EventQueue eventQueue;
   initEventQueue(&eventQueue);
@@ -712,6 +735,7 @@ FortuneState FortunesAlgorithm(struct app_state *AppState, float cutoffY) {
       SweepEvent *evt = &result.events[result.eventsSize++];
       evt->type = NewPoint;
       evt->newPoint.point = AppState->vertices[i].position;
+      evt->newPoint.site = i;
       evt->yCoord = AppState->vertices[i].position.y;
       pushEvent(&eventQueue, evt);
     } else {
@@ -741,6 +765,7 @@ FortuneState FortunesAlgorithm(struct app_state *AppState, float cutoffY) {
   if (firstArc) {
     firstArc->type = Arc;
     firstArc->arc.focus = firstEvent->newPoint.point;
+    firstArc->arc.site = firstEvent->newPoint.site;
     firstArc->arc.squeezeEvent = NULL;
     // delete the first event?
 
@@ -756,7 +781,7 @@ FortuneState FortunesAlgorithm(struct app_state *AppState, float cutoffY) {
 
       assert(evt->type == NewPoint);
       Vector2 newFocus = evt->newPoint.point;
-      BeachlineItem *newArc = createArc(newFocus, &result);
+      BeachlineItem *newArc = createArc(newFocus, evt->newPoint.site, &result);
 
       BeachlineItem *activeArc =
           GetActiveArcForXCoord(root, newFocus.x, newFocus.y);
@@ -1166,11 +1191,6 @@ double clamp(double val, double min, double max) {
   return val < min ? min : (val > max ? max : val);
 }
 
-typedef struct {
-  Vector2 points[2];
-  int count;
-} IntersectionResult;
-
 IntersectionResult IntersectBoundary(Vector2 endpointA, Vector2 endpointB,
                                      double screenWidth, double screenHeight) {
 
@@ -1237,20 +1257,29 @@ IntersectionResult IntersectBoundary(Vector2 endpointA, Vector2 endpointB,
   return result;
 }
 
-Vector2 centroidGlobal;
-int compare(const void *a, const void *b) {
-  const Vector2 *p1 = (const Vector2 *)a;
-  const Vector2 *p2 = (const Vector2 *)b;
-
-  double a1 = atan2(p1->y - centroidGlobal.y, p1->x - centroidGlobal.x);
-  double a2 = atan2(p2->y - centroidGlobal.y, p2->x - centroidGlobal.x);
-
-  if (a1 < a2)
-    return -1;
-  else if (a1 > a2)
-    return 1;
-  else
-    return 0;
+// Sorts the corners of a convex polygon by angle around centre. Angles are
+// computed once per corner and everything stays on the stack, so cells can be
+// gathered from several threads at once.
+void SortPolygonByAngle(Vector2 *polygon, int n, Vector2 centre) {
+  double angles[MAX_CLIP_VERTICES];
+  if (n > MAX_CLIP_VERTICES) {
+    n = MAX_CLIP_VERTICES;
+  }
+  for (int k = 0; k < n; k++) {
+    angles[k] = atan2(polygon[k].y - centre.y, polygon[k].x - centre.x);
+  }
+
+  for (int k = 1; k < n; k++) {
+    double angle = angles[k];
+    Vector2 corner = polygon[k];
+    int j = k - 1;
+    for (; j >= 0 && angles[j] > angle; j--) {
+      angles[j + 1] = angles[j];
+      polygon[j + 1] = polygon[j];
+    }
+    angles[j + 1] = angle;
+    polygon[j + 1] = corner;
+  }
 }
 
 Vector2 ComputeInitialCentroid(Vector2 *points, int n) {
@@ -1298,51 +1327,66 @@ Vector2 ComputeTrueCentroid(Vector2 *polygon, int n) {
   return centroid;
 }
 
-void LloydRelaxationFortune(struct app_state *AppState) {
-  int screenWidth = GetScreenWidth();
-  int screenHeight = GetScreenHeight();
-
-  for (int i = 0; i < AppState->num_vertices; i++) {
-    float x0, y0, x1, y1;
-    Vector2 polygon[100];
-    int polySize = 0;
-
-    for (int j = 0; j < AppState->fortuneState.edgesSize; j++) {
-      CompleteEdge edge = AppState->fortuneState.edges[j];
-      if (edge.vertices[0] == i || edge.vertices[1] == i) {
-        if (IsWithinBoundary(edge.endpointA, screenWidth, screenHeight)) {
-          if (!VectorExistsInPolygon(polygon, polySize, edge.endpointA)) {
-            polygon[polySize++] = edge.endpointA;
-          }
+// Collects the boundary-clipped polygon of site i from the diagram edges and
+// sorts it by angle. When edgeIndices is NULL every edge is scanned, otherwise
+// only the numEdgeIndices edges listed. Returns the polygon vertex count.
+int GatherFortuneCell(FortuneState *state, int i, const int *edgeIndices,
+                      int numEdgeIndices, float screenWidth,
+                      float screenHeight, Vector2 *polygon) {
+  int polySize = 0;
+  int count = edgeIndices ? numEdgeIndices : state->edgesSize;
+
+  for (int e = 0; e < count; e++) {
+    CompleteEdge edge = state->edges[edgeIndices ? edgeIndices[e] : e];
+    if (edge.vertices[0] == i || edge.vertices[1] == i) {
+      if (IsWithinBoundary(edge.endpointA, screenWidth, screenHeight)) {
+        if (!VectorExistsInPolygon(polygon, polySize, edge.endpointA)) {
+          polygon[polySize++] = edge.endpointA;
         }
+      }
 
-        if (IsWithinBoundary(edge.endpointB, screenWidth, screenHeight)) {
-          if (!VectorExistsInPolygon(polygon, polySize, edge.endpointB)) {
-            polygon[polySize++] = edge.endpointB;
-          }
+      if (IsWithinBoundary(edge.endpointB, screenWidth, screenHeight)) {
+        if (!VectorExistsInPolygon(polygon, polySize, edge.endpointB)) {
+          polygon[polySize++] = edge.endpointB;
         }
+      }
 
-        if (!IsWithinBoundary(edge.endpointA, screenWidth, screenHeight) ||
-            !IsWithinBoundary(edge.endpointB, screenWidth, screenHeight)) {
-          IntersectionResult intersections = IntersectBoundary(
-              edge.endpointA, edge.endpointB, screenWidth, screenHeight);
-          for (int k = 0; k < intersections.count; k++) {
-            Vector2 intersection = intersections.points[k];
-            if (intersection.x != -1 && intersection.y != -1 &&
-                !VectorExistsInPolygon(polygon, polySize, intersection)) {
-              polygon[polySize++] = intersection;
-            }
+      if (!IsWithinBoundary(edge.endpointA, screenWidth, screenHeight) ||
+          !IsWithinBoundary(edge.endpointB, screenWidth, screenHeight)) {
+        IntersectionResult intersections = IntersectBoundary(
+            edge.endpointA, edge.endpointB, screenWidth, screenHeight);
+        for (int k = 0; k < intersections.count; k++) {
+          Vector2 intersection = intersections.points[k];
+          if (intersection.x != -1 && intersection.y != -1 &&
+              !VectorExistsInPolygon(polygon, polySize, intersection)) {
+            polygon[polySize++] = intersection;
           }
         }
       }
     }
+  }
+
+  if (polySize > 0) {
+    SortPolygonByAngle(polygon, polySize,
+                       ComputeInitialCentroid(polygon, polySize));
+  }
+  return polySize;
+}
+
+void LloydRelaxationFortune(struct app_state *AppState) {
+  int screenWidth = GetScreenWidth();
+  int screenHeight = GetScreenHeight();
+
+  for (int i = 0; i < AppState->num_vertices; i++) {
+    Vector2 polygon[100];
+    int polySize =
+        GatherFortuneCell(&AppState->fortuneState, i, NULL, 0, screenWidth,
+                          screenHeight, polygon);
 
     if (polySize == 0) {
       continue;
     }
 
-    centroidGlobal = ComputeInitialCentroid(polygon, polySize);
-    qsort(polygon, polySize, sizeof(Vector2), compare);
     Vector2 centroid = ComputeTrueCentroid(polygon, polySize);
     assert(IsWithinBoundary(centroid, screenWidth, screenHeight));
     // assert(CheckCollisionPointPoly(centroid, polygon, polySize));
@@ -1459,16 +1503,8 @@ APP_PLUG int plug_update(struct app_memory *Memory) {
   struct app_state *AppState = (struct app_state *)Memory->PermanentStorage;
   if (!Memory->IsInitialized) {
     printf("starting app state initilization\n");
-    float centerX = screenWidth / 2.0f;
-    float centerY = screenHeight / 2.0f;
-
     AppState->num_vertices = 25 + 1;
 
-    // float scatterW = screenWidth / 2.0f - 10;
-    // float scatterH = screenHeight / 2.0f - 10;
-    float scatterW = 100;
-    float scatterH = 100;
-
     Vector2 initialPoints[11] = {{275, 99},  {715, 118}, {88, 196},  {497, 177},
                                  {261, 278}, {673, 299}, {458, 358}, {211, 419},
                                  {624, 463}, {155, 552}, {405, 552}};
@@ -1480,18 +1516,11 @@ APP_PLUG int plug_update(struct app_memory *Memory) {
     //                              {210.0, 441.0}, {643.0, 85.0},  {369.0,
     //                              502.0}, {516.0, 237.0}, {400, 1500}};
 
-    for (int i = 0; i < AppState->num_vertices; i++) {
-      AppState->vertices[i].position =
-          (Vector2){centerX + GetRandomValue(-scatterW, scatterW),
-                    centerY + GetRandomValue(-scatterH, scatterH)};
-      // AppState->vertices[i].velocity =
-      //     (Vector2){GetRandomValue(-1, 1), GetRandomValue(-1, 1)};
-      // AppState->vertices[i].position = initialPoints[i];
-      AppState->vertices[i].color =
-          (Color){GetRandomValue(0, 255), GetRandomValue(0, 255),
-                  GetRandomValue(0, 255), 255};
-      AppState->vertices[i].centroid = (Vector2){0};
-    }
+    InitializeArena(&AppState->arena, Memory->TransientStorageSize,
+                    Memory->TransientStorage);
+    InitialiseSites(AppState, AppState->num_vertices,
+                    (Rectangle){0, 0, screenWidth, screenHeight},
+                    JitteredSites, SITES_SEED);
 
     AppState->vertices[AppState->num_vertices].position.x = 400;
     AppState->vertices[AppState->num_vertices].position.y = 1500;
@@ -1501,11 +1530,27 @@ APP_PLUG int plug_update(struct app_memory *Memory) {
     AppState->vertices[AppState->num_vertices].centroid = (Vector2){0};
 
     AppState->fortuneState.edgesSize = 0;
-    AppState->fortuneState = FortunesAlgorithm(AppState, -screenHeight);
-    AssociateEdgesWithVertices(AppState->fortuneState.edges,
-                               AppState->fortuneState.edgesSize,
-                               AppState->vertices, AppState->num_vertices);
-    LloydRelaxationFortune(AppState);
+    AppState->density.valid = 0;
+    AppState->domain.valid = 0;
+    AppState->periodic = 0;
+    InvalidateIncrementalState(&AppState->incremental);
+    AppState->incremental.maxStep = 1.0f;
+    AppState->freezeTopology = 1;
+    AppState->triangulation.valid = 0;
+    InitLloydScheduler(&AppState->scheduler, LLOYD_FRAME_BUDGET,
+                       LLOYD_CHUNK_CELLS, 1);
+    AppState->kinetic = 0;
+    AppState->kineticDelaunay.valid = 0;
+    InitSiteGraph(&AppState->siteGraph, &AppState->arena, MAX_SITES);
+    InitPointLocator(&AppState->locator, &AppState->arena, MAX_SITES);
+    InitSiteGrid(&AppState->incremental.grid, &AppState->arena, MAX_SITES,
+                 INCREMENTAL_SITES_PER_CELL);
+    AppState->hoveredSite = -1;
+    AppState->editing = 0;
+    AppState->dynamicDelaunay.valid = 0;
+    AppState->draggedSite = -1;
+    LloydRelaxationFortuneIncremental(AppState, &AppState->incremental,
+                                      DIRTY_EPSILON);
 
     AppState->glowShader = LoadShader(0, "shaders/glow.fs");
     SetShaderValue(AppState->glowShader,
@@ -1579,11 +1624,33 @@ APP_PLUG int plug_update(struct app_memory *Memory) {
 
   EndDrawing();
 
-  AppState->fortuneState = FortunesAlgorithm(AppState, -screenHeight);
-  AssociateEdgesWithVertices(AppState->fortuneState.edges,
-                             AppState->fortuneState.edgesSize,
-                             AppState->vertices, AppState->num_vertices);
-  LloydRelaxationFortune(AppState);
+  AppState->hoveredSite = SiteAtMouse(AppState);
+
+  // E toggles editing the sites with the mouse. The edit structure is rebuilt
+  // on entry, since relaxation has moved the sites since it was last used.
+  if (IsKeyPressed(KEY_E)) {
+    AppState->editing = !AppState->editing;
+    AppState->dynamicDelaunay.valid = 0;
+    AppState->draggedSite = -1;
+  }
+
+  // K toggles kinetic mode, which sends every site off in a random direction
+  if (IsKeyPressed(KEY_K)) {
+    AppState->kinetic = !AppState->kinetic;
+    AppState->kineticDelaunay.valid = 0;
+    if (AppState->kinetic) {
+      SeedKineticVelocities(AppState->vertices, AppState->num_vertices,
+                            KINETIC_SPEED, SITES_SEED);
+    }
+  }
+
+  if (AppState->editing) {
+    EditSitesWithMouse(AppState);
+  } else if (AppState->kinetic) {
+    StepKineticVoronoi(AppState, GetFrameTime());
+  } else {
+    RunLloydScheduler(AppState, &AppState->scheduler);
+  }
 
   return 1;
 }
@@ -48,6 +48,89 @@ struct app_memory {
   void *TransientStorage;
 };
 
+typedef struct {
+  uint8_t *base;
+  uint64 size;
+  uint64 used;
+} memory_arena;
+
+static inline void InitializeArena(memory_arena *arena, uint64 size,
+                                   void *base) {
+  arena->base = (uint8_t *)base;
+  arena->size = size;
+  arena->used = 0;
+}
+
+// Returns 16-byte aligned storage, or 0 once the arena is exhausted
+static inline void *PushSize_(memory_arena *arena, uint64 size) {
+  uint64 start = (arena->used + 15) & ~(uint64)15;
+  if (start + size > arena->size) {
+    return 0;
+  }
+  arena->used = start + size;
+  return arena->base + start;
+}
+
+#define PushStruct(arena, type) (type *)PushSize_(arena, sizeof(type))
+#define PushArray(arena, count, type)                                          \
+  (type *)PushSize_(arena, (uint64)(count) * sizeof(type))
+
+// Counter-based hash (splitmix64): the n-th number of a stream is
+// Mix64(key + n), so any range of a stream can be drawn on any thread
+static inline uint64 Mix64(uint64 x) {
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+static inline float UnitFloat(uint64 x) {
+  return (x >> 40) * (1.0f / 16777216.0f);
+}
+
+// PCG32 generator. Every (seed, stream) pair is an independent sequence, so a
+// job seeds its own stream from its index instead of sharing one generator.
+typedef struct {
+  uint64 state;
+  uint64 inc;
+} pcg32;
+
+static inline uint32 Pcg32Next(pcg32 *rng) {
+  uint64 old = rng->state;
+  rng->state = old * 6364136223846793005ull + rng->inc;
+  uint32 xorshifted = (uint32)(((old >> 18) ^ old) >> 27);
+  uint32 rot = (uint32)(old >> 59);
+  return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+static inline pcg32 Pcg32Seed(uint64 seed, uint64 stream) {
+  pcg32 rng = {0, (stream << 1) | 1};
+  Pcg32Next(&rng);
+  rng.state += seed;
+  Pcg32Next(&rng);
+  return rng;
+}
+
+// Uniform in [0, 1)
+static inline float Pcg32Float(pcg32 *rng) {
+  return (Pcg32Next(rng) >> 8) * (1.0f / 16777216.0f);
+}
+
+static inline float Pcg32Range(pcg32 *rng, float lo, float hi) {
+  return lo + (hi - lo) * Pcg32Float(rng);
+}
+
+// Uniform in [0, bound) without modulo bias
+static inline uint32 Pcg32Bounded(pcg32 *rng, uint32 bound) {
+  uint32 threshold = (-bound) % bound;
+  for (;;) {
+    uint32 r = Pcg32Next(rng);
+    if (r >= threshold) {
+      return r % bound;
+    }
+  }
+}
+
 #define LIST_OF_PLUGS PLUG(plug_update, void *, struct app_memory *Memory)
 
 #define PLUG(name, ret, ...) typedef ret(name##_t)(__VA_ARGS__);
@@ -74,12 +157,21 @@ typedef struct {
   Color color;
 } Vertex;
 
+// 4-wide float SIMD through the compiler's vector extension, lowers to
+// SSE, NEON or wasm simd128 depending on the target
+typedef float float4 __attribute__((vector_size(16)));
+
 #define CLAMP(x, min, max) ((x) < (min) ? (min) : ((x) > (max) ? (max) : (x)))
 
 #define FLT_MAX __FLT_MAX__
 #define MAX_EDGES 1000
 #define MAX_EVENTS 1000
 #define MAX_BEACHLINE_ITEMS 10000
+#define MAX_SITES 1000
+#define MAX_TRIANGLES (2 * MAX_SITES)
+// The sweep stores two half edges per Voronoi vertex, up to 2n of them, plus
+// the rays on the hull
+#define MAX_SWEEP_SITES (MAX_EDGES / 5)
 
 typedef enum BeachlineItemType { NoneBeachline, Arc, Edge } BeachlineItemType;
 
@@ -91,6 +183,7 @@ typedef struct EdgeStruct {
 
 typedef struct ArcStruct {
   Vector2 focus;
+  int site;
   struct SweepEvent *squeezeEvent;
 } ArcStruct;
 
@@ -113,6 +206,7 @@ typedef enum SweepEventType {
 
 typedef struct NewPointEvent {
   Vector2 point;
+  int site;
 } NewPointEvent;
 
 typedef struct EdgeIntersectionEvent {
@@ -136,10 +230,16 @@ typedef struct CompleteEdge {
   int vertices[2];
 } CompleteEdge;
 
+typedef struct SiteTriangle {
+  int sites[3];
+} SiteTriangle;
+
 typedef struct {
   float sweepY;
   CompleteEdge edges[MAX_EDGES];
   int edgesSize;
+  SiteTriangle triangles[MAX_TRIANGLES];
+  int trianglesSize;
   SweepEvent *unencounteredEvents[MAX_EVENTS];
   int unencounteredEventsSize;
   SweepEvent events[MAX_EVENTS];
@@ -148,8 +248,556 @@ typedef struct {
   int beachlineItemCount;
 } FortuneState;
 
+typedef struct {
+  Vector2 points[2];
+  int count;
+} IntersectionResult;
+
+#define MAX_CELL_NEIGHBOURS 32
+#define MAX_CLIP_VERTICES 256
+#define DIRTY_EPSILON 0.25f
+#define INCREMENTAL_SITES_PER_CELL 2.0f
+
+// Uniform grid over a box with the sites bucketed in row-major cell order.
+// Coordinates are kept structure-of-arrays and padded, so searches can load
+// them four at a time. Sized once for maxSites and rebuilt in place.
+typedef struct {
+  Rectangle box;
+  float cellSize;
+  float sitesPerCell;
+  int gridW;
+  int gridH;
+  int maxSites;
+  int maxCells;
+  int numSites;
+  int *cellStart;
+  float *sortedX; // sites in grid-cell order
+  float *sortedY;
+  int *sortedSite;
+  int *siteCell;
+} SiteGrid;
+
+// Per-site cache for incremental Lloyd. A site is dirty once it has moved more
+// than epsilon away from the position its cell was last computed at; only
+// dirty sites and their neighbours get their cells recomputed.
+typedef struct {
+  Vector2 cachedPositions[MAX_SITES];
+  Vector2 cachedCentroids[MAX_SITES];
+  int neighbours[MAX_SITES][MAX_CELL_NEIGHBOURS];
+  int numNeighbours[MAX_SITES];
+
+  uint8 dirty[MAX_SITES];
+  // Recompute these cells next time even if their site has not moved
+  uint8 stale[MAX_SITES];
+  uint8 affected[MAX_SITES];
+  int affectedSites[MAX_SITES];
+  int numAffected;
+  int numDirty;
+
+  // Sites the cache was built for, zero forces a full rebuild
+  int numSites;
+
+  // Largest move per iteration, zero jumps straight to the centroid
+  float maxStep;
+
+  // Sweep path: edges of the current diagram grouped by site
+  int siteEdgeOffsets[MAX_SITES + 1];
+  int siteEdges[2 * MAX_EDGES];
+
+  // Scratch stamps for de-duplicating candidate lists
+  int candidateStamp[MAX_SITES];
+  int stampCounter;
+  // Every site in order, the candidates of a full rebuild
+  int allSites[MAX_SITES];
+
+  // Set when a site moved or was inserted further than its previous
+  // neighbourhood reaches, so the local candidates cannot be trusted
+  bool32 farMove;
+  // Sites bucketed for the iterations that cannot clip locally, set up by
+  // the app; without it those clip against every site
+  SiteGrid grid;
+  Vector2 gridPositions[MAX_SITES];
+  bool32 clipFromGrid; // grid holds this iteration's positions
+} IncrementalState;
+
+// Density image for weighted centroids. Every pixel row keeps running sums of
+// rho and x * rho, so a cell's mass and moments come from two lookups per
+// scanline it covers. Pixel (0, 0) maps to the top-left corner of box.
+typedef struct {
+  int width;
+  int height;
+  Rectangle box;
+  double *rowMass;   // (width + 1) prefix entries per row
+  double *rowMoment; // prefix of (x + 0.5) * rho
+  bool32 valid;
+} DensityField;
+
+// Fits as many incremental Lloyd iterations into each frame as its time
+// budget allows, cutting an iteration into chunks of cells that can be
+// resumed on a later frame when one does not fit.
+typedef struct {
+  double budget; // seconds per frame
+  int chunkSize; // cells between clock reads
+  bool32 sweep;  // Fortune sweep path, else half-plane clipping
+
+  // Iteration in progress
+  bool32 inIteration;
+  bool32 sweepIteration;
+  int numAffected;
+  int cursor;
+
+  int iterations;
+  // What the last frame did
+  int iterationsLastFrame;
+  int chunks;
+  double seconds;
+  bool32 converged;
+} LloydScheduler;
+
+// Warm-started relaxation of an animated density. Each frame starts from the
+// sites and cached cells of the one before and gets at most
+// iterationsPerFrame Lloyd steps.
+typedef struct {
+  int iterationsPerFrame;
+  float tolerance; // stop early once no site moves further than this
+  double share;    // sqrt(mass * area) one cell holds, set by the first frame
+  int frame;
+
+  // What the last frame did
+  int inserted;
+  int removed;
+  int iterationsRun;
+  float movement;
+} TemporalLloyd;
+
+// Polygonal domain with holes. Boundary segments are oriented so the inside
+// is on their left (positive area) and indexed by a bounding-volume hierarchy,
+// so a cell only ever looks at the few boundary edges near it.
+#define DOMAIN_LEAF_SEGMENTS 4
+
+typedef struct {
+  Vector2 min;
+  Vector2 max;
+  int first; // first segment for leaves, left child otherwise (right = +1)
+  int count; // segments in a leaf, 0 for inner nodes
+} DomainNode;
+
+typedef struct {
+  Segment *segments;
+  int numSegments;
+  DomainNode *nodes;
+  int numNodes;
+  Rectangle bounds;
+  bool32 valid;
+} Domain;
+
+// Probabilistic (MacQueen) Lloyd. Sites move towards the running mean of the
+// samples that land nearest to them; nothing but the sites and a uniform grid
+// over them is stored, so memory stays O(N).
+#define STOCHASTIC_SLICES 8
+
+typedef struct {
+  Vector2 *sites;
+  int numSites;
+  Rectangle box;
+  const DensityField *density;
+  double *rowCdf; // cumulative mass per density row, for inverse sampling
+
+  SiteGrid grid;
+
+  // Per-slice sample sums, reduced after every iteration
+  float *sumX[STOCHASTIC_SLICES];
+  float *sumY[STOCHASTIC_SLICES];
+  int *hits[STOCHASTIC_SLICES];
+  float *totalHits; // samples absorbed so far, sets the learning rate
+
+  uint64 seed;
+  int iteration;
+} StochasticLloyd;
+
+// Power diagram: site i owns the points where |x - p_i|^2 - w_i is smallest.
+// Weights are solved for so every cell gets its target area (capacity).
+typedef struct {
+  int numSites;
+  Rectangle box;
+  float *weights;
+  float *targets;
+  double *areas;
+  Vector2 *centroids;
+
+  // Cell adjacency, MAX_CELL_NEIGHBOURS slots per site. coupling is
+  // -dA_i/dw_j, the shared edge length over twice the site distance.
+  int *numNeighbours;
+  int *neighbours;
+  double *coupling;
+
+  // Sites bucketed for the cell clipping, rebuilt from positions
+  Vector2 *positions;
+  SiteGrid grid;
+
+  // Scratch for the Newton solve
+  float *trialWeights;
+  double *residual;
+  double *direction;
+  double *product;
+  double *step;
+
+  int newtonIterations;
+} PowerDiagram;
+
+// Uniform grid over a box with the sites bucketed in row-major cell order
+typedef struct {
+  Vector3 min;
+  float cellSize;
+  int dims[3];
+  int numSites;
+  int *cellStart;
+  Vector3 *sorted; // sites in grid-cell order
+  int *sortedSite;
+  int *siteCell;
+} SiteGrid3;
+
+// Lloyd relaxation on the unit sphere. Sites are unit vectors bucketed in a
+// grid over [-1, 1]^3; each cell is clipped in the gnomonic projection around
+// its site, where great circles become straight lines.
+typedef struct {
+  Vector3 *sites;
+  Vector3 *centroids;
+  int numSites;
+  SiteGrid3 grid;
+  int iteration;
+} SphericalLloyd;
+
+// Convex polyhedron as a list of faces, each a loop of corners that runs
+// counter-clockwise seen from outside. faceLabel is the neighbouring site whose
+// bisector made the face, -1 for the bounding box.
+#define MAX_POLY_FACES 64
+#define MAX_POLY_CORNERS 512
+
+typedef struct {
+  Vector3 corners[MAX_POLY_CORNERS];
+  int faceStart[MAX_POLY_FACES + 1];
+  int faceLabel[MAX_POLY_FACES];
+  int numFaces;
+} Polyhedron;
+
+// Lloyd relaxation of points in a box, every cell clipped from the box by the
+// bisector planes of the sites found around it in the grid
+typedef struct {
+  Vector3 *sites;
+  Vector3 *centroids;
+  float *volumes;
+  int numSites;
+  BoundingBox box;
+  SiteGrid3 grid;
+  int iteration;
+} VolumeLloyd;
+
+// One of many independent site sets relaxed together by RelaxEnsemble.
+// iterations is the most Lloyd steps to run; iterationsRun and movement (the
+// largest site move of the last step) are filled in.
+typedef struct {
+  Vector2 *sites;
+  int numSites;
+  Rectangle box;
+  int iterations;
+  int iterationsRun;
+  float movement;
+} EnsembleSet;
+
+// Everything one ensemble worker needs to relax a set: a uniform grid over
+// the set's box and the new centroids. Sized once for the largest set and
+// reused, so the sets share no state.
+typedef struct {
+  SiteGrid grid;
+  Vector2 *centroids;
+} LloydWorkspace;
+
+// Delaunay triangulation dual to the diagram, triangles are counter-clockwise
+typedef struct {
+  int v[3];
+  int n[3]; // triangle across the edge opposite v[k], -1 on the hull
+} DelaunayTriangle;
+
+typedef struct {
+  DelaunayTriangle triangles[MAX_TRIANGLES];
+  Vector2 circumcentres[MAX_TRIANGLES];
+  int numTriangles;
+  int numSites;
+
+  int hullNext[MAX_SITES]; // next hull site counter-clockwise, -1 if interior
+  int siteTriangle[MAX_SITES];
+
+  // Triangles around each site, from adjacency construction
+  int incidentOffsets[MAX_SITES + 1];
+  int incident[3 * MAX_TRIANGLES];
+
+  bool32 valid;
+  int frozenIterations;
+  int fullRebuilds;
+} Triangulation;
+
+// The Delaunay dual of the swept diagram, exported for consumers that need
+// neighbour relations rather than edge segments
+typedef struct {
+  int capacity; // sites
+  int numSites;
+  SiteTriangle *triangles; // counter-clockwise
+  int numTriangles;
+  int *neighbourStart; // neighbours of site i are [start[i], start[i + 1])
+  int *neighbours;
+  int *mark;      // scratch
+  uint32 version; // bumped by every build, for the caches built on it
+} SiteGraph;
+
+// Delaunay triangulation closed by four static ghost corners far outside the
+// bounds, so every edge between sites is interior and every site's star is a
+// closed ring. Sites are points [0, numSites), the ghosts MAX_SITES on.
+// versions bump whenever a triangle changes, and the sites whose stars change
+// are collected until the changes are cleared.
+#define GHOST_CORNERS 4
+#define MAX_GHOST_POINTS (MAX_SITES + GHOST_CORNERS)
+#define MAX_GHOST_TRIANGLES (2 * MAX_GHOST_POINTS)
+
+typedef struct {
+  Vector2 positions[MAX_GHOST_POINTS];
+  int numSites;
+  Rectangle bounds;
+
+  DelaunayTriangle triangles[MAX_GHOST_TRIANGLES];
+  Vector2 circumcentres[MAX_GHOST_TRIANGLES];
+  uint32 versions[MAX_GHOST_TRIANGLES];
+  int numTriangles;
+  int siteTriangle[MAX_GHOST_POINTS];
+
+  int changed[MAX_SITES];
+  int numChanged;
+  uint32 changedStamp[MAX_SITES]; // equal to stamp while in changed
+  uint32 stamp;
+} GhostTriangulation;
+
+// Kinetic Delaunay triangulation of sites moving at constant velocity, over a
+// ghost-cornered triangulation so every edge between sites has an in-circle
+// certificate. Each edge's next certificate failure is kept in a min-heap
+// keyed on time; a triangle's version bump retires the events of its edges.
+#define MAX_KINETIC_EVENTS (4 * MAX_GHOST_TRIANGLES)
+// How far ahead, in seconds, certificates are solved for
+#define KINETIC_HORIZON 2.0
+// The diagram of n sites has fewer than 3n edges between sites, and the frame
+// draws them from the edge buffer, so larger site sets are not animated
+#define MAX_KINETIC_SITES (MAX_EDGES / 3)
+
+typedef struct {
+  double time;
+  int triangle;
+  int edge;
+  int neighbour;
+  uint32 version;
+  uint32 neighbourVersion;
+  bool32 recheck; // no failure within the horizon, solve again from here
+} KineticEvent;
+
+typedef struct {
+  GhostTriangulation mesh;
+  Vector2 velocities[MAX_GHOST_POINTS];
+  double now;
+  double horizon;
+
+  KineticEvent events[MAX_KINETIC_EVENTS];
+  int numEvents;
+
+  int flips; // during the last step
+  int eventsProcessed;
+  int rebuilds;
+  bool32 overflow;
+  bool32 valid;
+} KineticDelaunay;
+
+// Delaunay triangulation that takes single-site edits. An edit only rewrites
+// the triangles around it, and the mesh records the sites whose cells it
+// reshaped or renumbered until the changes are cleared.
+typedef struct {
+  GhostTriangulation mesh;
+  int rebuilds;
+  bool32 valid;
+} DynamicDelaunay;
+
+// k-d tree over k-means data for Kanungo's filtering algorithm. Nodes are in
+// one flat array in depth-first order, the left child right after its parent,
+// and every node covers a contiguous run of order. Each keeps its points'
+// bounding box and sum, so a subtree that only one centre can own is handed
+// to it whole. The top of the tree is cut into tasks, subtrees that are built
+// and filtered in parallel.
+typedef struct {
+  int start; // first of the node's points in order
+  int count;
+  int right; // index of the right child, -1 on a leaf
+  int owner; // centre that took the whole node, -1 if it split
+  int pass;  // the filtering pass owner was set in
+} KMeansTreeNode;
+
+typedef struct {
+  KMeansTreeNode *nodes;
+  int numNodes;
+  int maxDepth;
+  int *order;
+  float *lo; // bounding boxes, dim floats per node
+  float *hi;
+  double *sums; // dim per node
+
+  int *tasks; // roots of the parallel subtrees
+  int numTasks;
+  int *topNodes; // the nodes above them, depth-first
+  int numTopNodes;
+  int *taskCandidates; // k per task, set by the serial top of each pass
+  int *taskNumCandidates;
+  int *taskInherited; // owner taken from above the task in the last pass
+
+  // Per worker: candidate lists for every depth, and the sums and counts of
+  // the points handed to each centre
+  int workers;
+  int *lists;
+  double *workerSums;
+  int *workerCounts;
+
+  int pass;
+  uint64 nodesVisited; // in the last pass
+} KMeansTree;
+
+// Lloyd's method as k-means on numPoints row-major points of dim floats.
+// With pruning on, every point keeps Hamerly's bounds: an upper bound on the
+// distance to its centre and a lower bound on the distance to any other, so
+// it only searches the centres when they overlap, and that search skips the
+// centres the centre-to-centre distances rule out. Assignments match the
+// plain search exactly; pruning only skips distances that cannot change them.
+typedef struct {
+  const float *points;
+  int numPoints;
+  int dim;
+  int k;
+  float *centres; // k x dim
+  // Optional, a point of weight w counts as w copies of it. Not used by the
+  // tree backend.
+  const float *weights;
+
+  int *assignment;
+  float *upper;
+  float *lower;
+  bool32 bounded; // upper and lower were kept up to date by the last pass
+  // Either switch may change between iterations, the bounds are rebuilt on
+  // the next pass that prunes
+  bool32 pruning;
+  // Assign through the blocked matrix-product kernel instead, for high dim.
+  // Exact up to float rounding of near-ties, pruning is not used.
+  bool32 blocked;
+  float *packed; // centres in kernel panels
+  float *norms;
+  // Filter whole subtrees of this tree instead, for 2D and 3D with large k;
+  // assignment is only written when RunKMeans finishes
+  KMeansTree *tree;
+
+  float *drift;          // how far each centre moved in the last update
+  float *halfSeparation; // half the distance to the closest other centre
+  float *centreDistances; // k x k
+  int *clusterStart;     // points grouped by cluster for the update
+  int *clusterPoints;
+  double *sums; // k x dim
+
+  int iteration;
+  int changed;
+  uint64 distances; // point-centre distances computed so far
+} KMeans;
+
+// Mini-batch k-means over a file of row-major float32 points too large to
+// load. The file is memory-mapped and read front to back one batch at a
+// time, wrapping around at the end; pages behind the cursor are handed back
+// to the OS. Only the centres and one batch are held, so memory is
+// O(k * dim + batch) whatever the file's size. Rows should be in random
+// order, as every batch is taken to be a fair sample.
+typedef struct {
+  int fd;
+  const float *mapped;
+  uint64 mappedBytes;
+  uint64 numPoints;
+  uint64 cursor; // first row of the next batch
+  int dim;
+  int k;
+  int batchSize;
+
+  float *centres; // k x dim
+  double *counts; // points each centre has absorbed, its rate is 1 / count
+  float *packed;  // centres laid out for the blocked assignment kernel
+  float *norms;
+
+  // One batch's worth
+  int *assignment;
+  float *distances; // squared, to the assigned centre
+  int *clusterStart;
+  int *clusterRows;
+
+  uint64 batches;
+  double inertia; // mean squared distance over the last batch
+
+  // Centres are written to checkpointPath every checkpointEvery batches,
+  // 0 for never
+  const char *checkpointPath;
+  int checkpointEvery;
+} MiniBatchKMeans;
+
+#define MAX_PALETTE 256
+#define PALETTE_GRID_BITS 4 // the lookup grid has 1 << bits cells a channel
+
+// An image's distinct colours, 0xRRGGBB, with how many pixels have each
+typedef struct {
+  uint32 *colours;
+  float *weights;
+  int count;
+} ColourHistogram;
+
+// Four palette entries for one float4 step of the lookup. Unused lanes sit
+// far outside the colour cube.
+typedef struct {
+  float4 r, g, b;
+  int32 index[4];
+} PaletteGroup;
+
+// Nearest-colour lookup for a palette. The RGB cube is cut into a coarse
+// grid and every cell lists the entries that can be nearest to some colour
+// in it, usually only a few.
+typedef struct {
+  int size;
+  Color colours[MAX_PALETTE];
+  int *owner;     // the entry a cell lists alone, -1 if it lists several
+  int *cellStart; // groups by cell
+  PaletteGroup *groups;
+} PaletteGrid;
+
+// Nearest-site queries over the Delaunay graph. A query jumps to the site
+// nearest the centre of its cell in a coarse grid and walks from there to
+// ever nearer Delaunay neighbours, which only stops at the nearest site.
+typedef struct {
+  int capacity;
+  int numSites;
+  Vector2 *sites;
+  const SiteGraph *graph;
+  uint32 graphVersion; // of graph when the locator was built
+
+  Rectangle box; // of the sites, the grid covers it
+  float cellSize;
+  int gridW;
+  int gridH;
+  int *hints; // a starting site per cell
+} PointLocator;
+
+typedef enum SiteSampler {
+  UniformSites,
+  JitteredSites,
+  PoissonDiskSites,
+  HilbertSites // jittered, then numbered along a Hilbert curve
+} SiteSampler;
+
 struct app_state {
-  Vertex vertices[1000];
+  Vertex vertices[MAX_SITES];
   int num_vertices;
   FortuneState fortuneState;
   Shader glowShader;
@@ -158,7 +806,322 @@ struct app_state {
   int mouse_y;
 
   Vector2 curvePts[1920];
-  Cell cells[1000];
+  Cell cells[MAX_SITES];
+
+  IncrementalState incremental;
+
+  memory_arena arena;
+  DensityField density;
+  Domain domain;
+  // Wrap the screen rectangle into a torus instead of clipping against it
+  bool32 periodic;
+
+  // Reuse the last Delaunay connectivity while it stays valid
+  bool32 freezeTopology;
+  Triangulation triangulation;
+  // Rebuilt with every sweep
+  SiteGraph siteGraph;
+
+  LloydScheduler scheduler;
+
+  // Move sites along their velocities and repair the diagram by flips
+  // instead of relaxing it, toggled with K
+  bool32 kinetic;
+  KineticDelaunay kineticDelaunay;
+
+  PointLocator locator;
+  int hoveredSite; // -1 when none
+
+  // Add, drag and remove sites with the mouse, toggled with E, repairing
+  // the diagram around each edit
+  bool32 editing;
+  DynamicDelaunay dynamicDelaunay;
+  int draggedSite; // -1 when none
 };
 
+// gui.c
+FortuneState FortunesAlgorithm(struct app_state *AppState, float cutoffY);
+void AssociateEdgesWithVertices(CompleteEdge edges[], int numEdges,
+                                Vertex vertices[], int numVertices);
+int GatherFortuneCell(FortuneState *state, int i, const int *edgeIndices,
+                      int numEdgeIndices, float screenWidth,
+                      float screenHeight, Vector2 *polygon);
+Vector2 ComputeTrueCentroid(Vector2 *polygon, int n);
+Vector2 Midpoint(Vector2 a, Vector2 b);
+void SortPolygonByAngle(Vector2 *polygon, int n, Vector2 centre);
+
+// delaunay.c
+double Orient(Vector2 a, Vector2 b, Vector2 c);
+double InCircle(Vector2 a, Vector2 b, Vector2 c, Vector2 d);
+Vector2 Circumcentre(Vector2 a, Vector2 b, Vector2 c);
+bool32 BuildTriangulation(Triangulation *tri, const SiteTriangle *sites,
+                          int numTriangles, Vertex *vertices, int numSites);
+bool32 InitSiteGraph(SiteGraph *graph, memory_arena *arena, int capacity);
+bool32 BuildSiteGraph(SiteGraph *graph, const SiteTriangle *sites,
+                      int numTriangles, const Vertex *vertices, int numSites);
+bool32 IsTriangulationDelaunay(const Triangulation *tri, Vertex *vertices);
+void ComputeCircumcentres(Triangulation *tri, Vertex *vertices);
+int VoronoiEdgesFromTriangulation(const Triangulation *tri, Vertex *vertices,
+                                  CompleteEdge *edges, int maxEdges);
+void RebuildVoronoi(struct app_state *AppState);
+void UpdateVoronoi(struct app_state *AppState);
+int SharedEdge(const DelaunayTriangle *triangles, int t, int u);
+int WalkToTriangle(const DelaunayTriangle *triangles, int numTriangles,
+                   const Vector2 *positions, Vector2 p, int *t,
+                   bool32 *onEdge);
+void ClearGhostChanges(GhostTriangulation *gt);
+bool32 InsideGhosts(const GhostTriangulation *gt, Vector2 p);
+int FlipGhostEdge(GhostTriangulation *gt, int t, int k);
+bool32 InsertGhostSite(GhostTriangulation *gt, int i, int start);
+bool32 RemoveGhostSite(GhostTriangulation *gt, int i);
+void RenumberGhostSite(GhostTriangulation *gt, int from, int to);
+bool32 BuildGhostTriangulation(GhostTriangulation *gt);
+int NearestGhostSite(const GhostTriangulation *gt, Vector2 p, int start);
+int GhostNeighbours(const GhostTriangulation *gt, int i, int *neighbours,
+                    int maxNeighbours);
+int GhostVoronoiEdges(GhostTriangulation *gt, CompleteEdge *edges,
+                      int maxEdges);
+
+// jobs.c
+#define MAX_JOB_THREADS 64
+typedef void(ParallelJob)(void *data, int start, int end);
+void ParallelFor(int count, int minBatch, ParallelJob *job, void *data);
+int JobThreadCount(void);
+
+// density.c
+bool32 BuildDensityField(DensityField *field, memory_arena *arena,
+                         const float *rho, int width, int height,
+                         Rectangle box);
+bool32 DensityFieldFromImage(DensityField *field, memory_arena *arena,
+                             Image image, Rectangle box);
+bool32 UpdateDensityField(DensityField *field, memory_arena *arena,
+                          const float *rho, int width, int height,
+                          Rectangle box);
+Vector2 WeightedCentroid(const DensityField *field, const Vector2 *polygon,
+                         int n);
+double DensityMass(const DensityField *field, const Vector2 *polygon, int n);
+void WeightedCentroids(const DensityField *field, Cell *cells,
+                       const int *sites, int count, Vector2 *centroids);
+
+// domain.c
+bool32 BuildDomain(Domain *domain, memory_arena *arena, const Vector2 **rings,
+                   const int *ringCounts, int numRings);
+int QueryDomainSegments(const Domain *domain, Vector2 min, Vector2 max,
+                        int *out, int maxOut);
+bool32 PointInDomain(const Domain *domain, Vector2 p);
+float DomainClippedCentroid(const Domain *domain, const Vector2 *cell, int n,
+                            Vector2 *centroid);
+void DomainCentroids(const Domain *domain, Cell *cells, Vertex *vertices,
+                     const int *sites, int count, Vector2 *centroids);
+
+// stochastic.c
+bool32 InitStochasticLloyd(StochasticLloyd *s, memory_arena *arena,
+                           int numSites, Rectangle box,
+                           const DensityField *density, uint64 seed);
+void StochasticLloydIteration(StochasticLloyd *s, int numSamples);
+
+// power.c
+bool32 InitPowerDiagram(PowerDiagram *pd, memory_arena *arena, int numSites,
+                        Rectangle box);
+void ComputePowerDiagram(PowerDiagram *pd, Vertex *vertices, Cell *cells);
+int SolvePowerWeights(PowerDiagram *pd, Vertex *vertices, Cell *cells,
+                      int maxIterations, float tolerance);
+void CapacityConstrainedLloyd(struct app_state *AppState, PowerDiagram *pd,
+                              int iterations, float tolerance);
+
+// grid.c
+typedef void(GridShellVisit)(void *data, int slot);
+uint64 SiteGridSize(int maxSites, float sitesPerCell);
+bool32 InitSiteGrid(SiteGrid *grid, memory_arena *arena, int maxSites,
+                    float sitesPerCell);
+void SiteGridCoords(const SiteGrid *grid, Vector2 p, int *cx, int *cy);
+void BuildSiteGrid(SiteGrid *grid, const Vector2 *sites, int n,
+                   Rectangle box);
+int SiteGridSlot(const SiteGrid *grid, int site);
+bool32 VisitSiteGridRing(const SiteGrid *grid, int cx, int cy, int r,
+                         GridShellVisit *visit, void *data);
+
+// grid3.c
+bool32 InitSiteGrid3(SiteGrid3 *grid, memory_arena *arena, int numSites,
+                     BoundingBox box, float cellSize, int maxCellsPerAxis);
+void SiteGrid3Coords(const SiteGrid3 *grid, Vector3 p, int c[3]);
+void BuildSiteGrid3(SiteGrid3 *grid, const Vector3 *sites);
+int SiteGrid3Slot(const SiteGrid3 *grid, int site);
+bool32 VisitSiteGrid3Shell(const SiteGrid3 *grid, const int c[3], int r,
+                           GridShellVisit *visit, void *data);
+
+// sphere.c
+bool32 InitSphericalLloyd(SphericalLloyd *s, memory_arena *arena,
+                          int numSites, uint64 seed);
+void SphericalLloydIteration(SphericalLloyd *s);
+int SphericalVoronoiCell(const SphericalLloyd *s, int i, Vector3 *corners,
+                         int maxCorners);
+
+// volume.c
+bool32 InitVolumeLloyd(VolumeLloyd *v, memory_arena *arena, int numSites,
+                       BoundingBox box, uint64 seed);
+int ClipPolyhedron(const Polyhedron *in, Vector3 normal, float offset,
+                   int label, Polyhedron *out);
+float PolyhedronCentroid(const Polyhedron *poly, Vector3 reference,
+                         Vector3 *centroid);
+void VolumeLloydIteration(VolumeLloyd *v);
+void VolumeVoronoiCell(const VolumeLloyd *v, int i, Polyhedron *cell);
+
+// sampling.c
+int SamplePoissonDisk(Vector2 *points, int maxPoints, Rectangle box,
+                      float radius, pcg32 *rng, memory_arena *arena);
+float PoissonDiskRadius(int n, Rectangle box);
+bool32 HilbertOrder(const Vector2 *points, int n, Rectangle box, int *order,
+                    memory_arena *arena);
+int *HilbertQueryOrder(const Vector2 *points, int count,
+                       memory_arena *arena);
+int InitialiseSites(struct app_state *AppState, int numSites, Rectangle box,
+                    SiteSampler sampler, uint64 seed);
+
+// ensemble.c
+bool32 InitLloydWorkspace(LloydWorkspace *ws, memory_arena *arena,
+                          int maxSites);
+void RelaxSiteSet(LloydWorkspace *ws, EnsembleSet *set, float tolerance);
+void RelaxSiteSetParallel(LloydWorkspace *ws, EnsembleSet *set,
+                          float tolerance);
+int RelaxEnsemble(EnsembleSet *sets, int numSets, memory_arena *arena,
+                  uint64 memoryBudget, float tolerance);
+
+// multilevel.c
+typedef void(LloydIteration)(struct app_state *AppState);
+void LloydIterationHalfPlane(struct app_state *AppState);
+void LloydIterationSweep(struct app_state *AppState);
+int MultilevelLloyd(struct app_state *AppState, int targetSites,
+                    int coarsestSites, int iterationsPerLevel,
+                    LloydIteration *iterate, uint64 seed);
+int MultilevelRelaxSites(Vector2 *sites, int targetSites, Rectangle box,
+                         int coarsestSites, int iterationsPerLevel,
+                         memory_arena *arena, uint64 seed);
+
+// incremental.c
+void InvalidateIncrementalState(IncrementalState *inc);
+int CollectAffectedSites(Vertex *vertices, int num_vertices,
+                         IncrementalState *inc, float epsilon);
+int RemoveSites(struct app_state *AppState, const uint8 *remove);
+int InsertSite(struct app_state *AppState, int parent, Vector2 position);
+int ClipHalfPlane(Vector2 normal, float offset, int label, const Vector2 *in,
+                  const int *inLabels, int count, Vector2 *out,
+                  int *outLabels);
+int BeginIncrementalIteration(struct app_state *AppState,
+                              IncrementalState *inc, float epsilon);
+void ClipIncrementalCells(struct app_state *AppState, IncrementalState *inc,
+                          int start, int end);
+void FinishIncrementalIteration(struct app_state *AppState,
+                                IncrementalState *inc);
+int BeginFortuneIteration(struct app_state *AppState, IncrementalState *inc,
+                          float epsilon);
+void GatherFortuneCells(struct app_state *AppState, IncrementalState *inc,
+                        int start, int end);
+void FinishFortuneIteration(struct app_state *AppState,
+                            IncrementalState *inc);
+int ClipVoronoiCell(Vertex *vertices, int i, const int *candidates,
+                    int numCandidates, Rectangle box, Cell *cell,
+                    int *edgeSites);
+int ClipPowerCell(Vertex *vertices, const float *weights, int i,
+                  const int *candidates, int numCandidates, Rectangle box,
+                  Cell *cell, int *edgeSites);
+Vector2 MinimumImage(Vector2 d, Rectangle period);
+Vector2 WrapToPeriod(Vector2 p, Rectangle period);
+int ClipPeriodicCell(Vertex *vertices, int i, const int *candidates,
+                     int numCandidates, Rectangle period, Cell *cell,
+                     int *edgeSites);
+void LloydRelaxationIncremental(struct app_state *AppState,
+                                IncrementalState *inc, float epsilon);
+void LloydRelaxationFortuneIncremental(struct app_state *AppState,
+                                       IncrementalState *inc, float epsilon);
+
+// scheduler.c
+void InitLloydScheduler(LloydScheduler *s, double budget, int chunkSize,
+                        bool32 sweep);
+int RunLloydScheduler(struct app_state *AppState, LloydScheduler *s);
+
+// temporal.c
+void InitTemporalLloyd(TemporalLloyd *t, int iterationsPerFrame,
+                       float tolerance);
+int RelaxDensityFrame(struct app_state *AppState, TemporalLloyd *t,
+                      const float *rho, int width, int height);
+
+// kinetic.c
+bool32 InitKineticDelaunay(KineticDelaunay *kd, const Vertex *vertices,
+                           int numSites, Rectangle bounds);
+void SetKineticVelocity(KineticDelaunay *kd, int i, Vector2 velocity);
+int AdvanceKineticDelaunay(KineticDelaunay *kd, float dt);
+void SeedKineticVelocities(Vertex *vertices, int numSites, float speed,
+                           uint64 seed);
+void StepKineticVoronoi(struct app_state *AppState, float dt);
+
+// kmeans.c
+bool32 InitKMeans(KMeans *km, memory_arena *arena, const float *points,
+                  int numPoints, int dim, int k, const float *centres);
+int KMeansIteration(KMeans *km);
+int RunKMeans(KMeans *km, int maxIterations);
+bool32 SeedKMeansParallel(KMeans *km, memory_arena *arena, uint64 seed,
+                          int rounds, float oversampling);
+
+// assign.c
+uint64 PackedCentresCount(int k, int dim);
+void PackCentres(const float *centres, int k, int dim, float *packed,
+                 float *norms);
+void AssignNearestBlocked(const float *points, int numPoints, int dim,
+                          const float *packed, const float *norms, int k,
+                          int *nearest, float *distances);
+
+// filtering.c
+bool32 BuildKMeansTree(KMeans *km, memory_arena *arena);
+void FilterKMeansTree(KMeans *km, bool32 writeAssignment);
+
+// minibatch.c
+bool32 OpenMiniBatchKMeans(MiniBatchKMeans *mb, memory_arena *arena,
+                           const char *path, int dim, int k, int batchSize,
+                           uint64 seed);
+void CloseMiniBatchKMeans(MiniBatchKMeans *mb);
+double MiniBatchStep(MiniBatchKMeans *mb);
+bool32 SaveMiniBatchCheckpoint(const MiniBatchKMeans *mb, const char *path);
+bool32 LoadMiniBatchCheckpoint(MiniBatchKMeans *mb, const char *path);
+
+// quantise.c
+bool32 BuildColourHistogram(ColourHistogram *histogram, memory_arena *arena,
+                            const Color *pixels, int count);
+int BuildPalette(Color *palette, memory_arena *arena,
+                 const ColourHistogram *histogram, int k, uint64 seed);
+bool32 BuildPaletteGrid(PaletteGrid *grid, memory_arena *arena,
+                        const Color *palette, int size);
+void RemapToPalette(const PaletteGrid *grid, Color *pixels, uint8 *indices,
+                    int count);
+int QuantiseImage(Image *image, memory_arena *arena, int k, uint64 seed,
+                  Color *palette, uint8 *indices);
+
+// locate.c
+bool32 InitPointLocator(PointLocator *loc, memory_arena *arena, int capacity);
+bool32 BuildPointLocator(PointLocator *loc, const SiteGraph *graph,
+                         const Vertex *vertices);
+int LocatePoint(const PointLocator *loc, Vector2 p, int start);
+bool32 LocatePoints(const PointLocator *loc, memory_arena *arena,
+                    const Vector2 *points, int count, int *sites);
+int SiteAtMouse(struct app_state *AppState);
+
+// dynamic.c
+bool32 InitDynamicDelaunay(DynamicDelaunay *dd, const Vertex *vertices,
+                           int numSites, Rectangle bounds);
+int InsertDynamicSite(DynamicDelaunay *dd, Vector2 position);
+bool32 DeleteDynamicSite(DynamicDelaunay *dd, int i);
+bool32 MoveDynamicSite(DynamicDelaunay *dd, int i, Vector2 position);
+void EditSitesWithMouse(struct app_state *AppState);
+
+// interpolate.c
+bool32 InterpolateNaturalNeighbour(const Triangulation *tri,
+                                   const PointLocator *loc,
+                                   const float *values, memory_arena *arena,
+                                   const Vector2 *points, int count,
+                                   float *out);
+bool32 InterpolateNaturalNeighbourGrid(const Triangulation *tri,
+                                       const PointLocator *loc,
+                                       const float *values, Rectangle box,
+                                       int width, int height, float *out);
+
 #endif
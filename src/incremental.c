@@ -0,0 +1,718 @@
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+void InvalidateIncrementalState(IncrementalState *inc) {
+  inc->numSites = 0;
+  inc->numAffected = 0;
+  inc->numDirty = 0;
+  inc->stampCounter = 0;
+  inc->farMove = 0;
+  inc->clipFromGrid = 0;
+  memset(inc->candidateStamp, 0, sizeof(inc->candidateStamp));
+}
+
+static void MarkAffected(IncrementalState *inc, int i) {
+  if (!inc->affected[i]) {
+    inc->affected[i] = 1;
+    inc->affectedSites[inc->numAffected++] = i;
+  }
+}
+
+// Flags every site that moved more than epsilon since its cell was computed,
+// then widens the set to their neighbours since a moving site also reshapes
+// the cells around it. The dirty sites come first in the affected list, so
+// their cells are clipped before those of the sites around them. Returns the
+// number of cells that need recomputing.
+int CollectAffectedSites(Vertex *vertices, int num_vertices,
+                         IncrementalState *inc, float epsilon) {
+  inc->numAffected = 0;
+  inc->numDirty = 0;
+  memset(inc->affected, 0, num_vertices * sizeof(inc->affected[0]));
+
+  if (inc->numSites != num_vertices) {
+    // Nothing cached yet (or sites were added/removed), rebuild every cell
+    for (int i = 0; i < num_vertices; i++) {
+      inc->dirty[i] = 1;
+      inc->stale[i] = 0;
+      inc->numNeighbours[i] = 0;
+      MarkAffected(inc, i);
+    }
+    inc->numDirty = num_vertices;
+    return inc->numAffected;
+  }
+
+  float epsilonSq = epsilon * epsilon;
+  for (int i = 0; i < num_vertices; i++) {
+    inc->dirty[i] = inc->stale[i] ||
+                    Vector2DistanceSqr(vertices[i].position,
+                                       inc->cachedPositions[i]) > epsilonSq;
+    inc->stale[i] = 0;
+    if (inc->dirty[i]) {
+      inc->numDirty++;
+      MarkAffected(inc, i);
+    }
+  }
+
+  for (int i = 0; i < num_vertices; i++) {
+    if (!inc->dirty[i]) {
+      continue;
+    }
+    for (int n = 0; n < inc->numNeighbours[i]; n++) {
+      MarkAffected(inc, inc->neighbours[i][n]);
+    }
+  }
+
+  return inc->numAffected;
+}
+
+static Vector2 StepTowardsCentroid(Vector2 position, Vector2 centroid,
+                                   float maxStep) {
+  if (maxStep > 0) {
+    return Vector2MoveTowards(position, centroid, maxStep);
+  }
+  return centroid;
+}
+
+static void AddNeighbour(IncrementalState *inc, int i, int j) {
+  for (int n = 0; n < inc->numNeighbours[i]; n++) {
+    if (inc->neighbours[i][n] == j) {
+      return;
+    }
+  }
+  if (inc->numNeighbours[i] < MAX_CELL_NEIGHBOURS) {
+    inc->neighbours[i][inc->numNeighbours[i]++] = j;
+  }
+}
+
+// Drops the sites flagged in remove, keeping the rest in order, and renumbers
+// the cache to match so the next iteration still clips locally. Neighbours of
+// a removed site become neighbours of each other, since they now share the
+// hole it leaves, and are marked stale. Returns the new site count.
+int RemoveSites(struct app_state *AppState, const uint8 *remove) {
+  IncrementalState *inc = &AppState->incremental;
+  int n = AppState->num_vertices;
+  bool32 cached = (inc->numSites == n);
+
+  int remap[MAX_SITES];
+  int kept = 0;
+  for (int i = 0; i < n; i++) {
+    remap[i] = remove[i] ? -1 : kept++;
+  }
+  if (kept == n) {
+    return n;
+  }
+
+  if (cached) {
+    for (int i = 0; i < n; i++) {
+      if (!remove[i]) {
+        continue;
+      }
+      for (int a = 0; a < inc->numNeighbours[i]; a++) {
+        int j = inc->neighbours[i][a];
+        inc->stale[j] = 1;
+        for (int b = 0; b < inc->numNeighbours[i]; b++) {
+          if (inc->neighbours[i][b] != j) {
+            AddNeighbour(inc, j, inc->neighbours[i][b]);
+          }
+        }
+      }
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    int to = remap[i];
+    if (to < 0) {
+      continue;
+    }
+
+    int count = 0;
+    for (int a = 0; cached && a < inc->numNeighbours[i]; a++) {
+      int j = remap[inc->neighbours[i][a]];
+      if (j >= 0) {
+        inc->neighbours[to][count++] = j;
+      }
+    }
+    inc->numNeighbours[to] = count;
+    if (to == i) {
+      continue;
+    }
+
+    AppState->vertices[to] = AppState->vertices[i];
+    inc->cachedPositions[to] = inc->cachedPositions[i];
+    inc->cachedCentroids[to] = inc->cachedCentroids[i];
+    inc->stale[to] = inc->stale[i];
+    Cell *from = &AppState->cells[i];
+    AppState->cells[to].num_vertices = from->num_vertices;
+    memcpy(AppState->cells[to].vertices, from->vertices,
+           from->num_vertices * sizeof(Vector2));
+  }
+
+  AppState->num_vertices = kept;
+  if (cached) {
+    inc->numSites = kept;
+  }
+  return kept;
+}
+
+// Appends a site at position that starts out with parent's colour and
+// neighbours. Both cells are marked stale; the parent's neighbours see the
+// new site through the parent's list. Returns its index, -1 when full.
+int InsertSite(struct app_state *AppState, int parent, Vector2 position) {
+  IncrementalState *inc = &AppState->incremental;
+  int n = AppState->num_vertices;
+  // One slot stays free for the sweep's sentinel site
+  if (n >= MAX_SITES - 1) {
+    return -1;
+  }
+
+  Vertex *v = &AppState->vertices[n];
+  *v = AppState->vertices[parent];
+  v->position = position;
+  v->velocity = (Vector2){0};
+  v->centroid = position;
+  AppState->num_vertices = n + 1;
+
+  if (inc->numSites == n) {
+    memcpy(inc->neighbours[n], inc->neighbours[parent],
+           inc->numNeighbours[parent] * sizeof(int));
+    inc->numNeighbours[n] = inc->numNeighbours[parent];
+    AddNeighbour(inc, n, parent);
+    AddNeighbour(inc, parent, n);
+    inc->cachedPositions[n] = position;
+    inc->cachedCentroids[n] = position;
+    inc->stale[n] = 1;
+    inc->stale[parent] = 1;
+    inc->numSites = n + 1;
+    // The parent's neighbours only cover the new site if it lands close by
+    inc->farMove = 1;
+  }
+  return n;
+}
+
+// One Sutherland-Hodgman pass: keeps the part of the polygon where
+// dot(normal, x) <= offset and labels the new edge along the line with
+// label. Returns the vertex count.
+int ClipHalfPlane(Vector2 normal, float offset, int label, const Vector2 *in,
+                  const int *inLabels, int count, Vector2 *out,
+                  int *outLabels) {
+  int outCount = 0;
+  for (int k = 0; k < count; k++) {
+    Vector2 a = in[k];
+    Vector2 b = in[(k + 1) % count];
+    float da = Vector2DotProduct(normal, a) - offset;
+    float db = Vector2DotProduct(normal, b) - offset;
+
+    if (da <= 0) {
+      if (outCount >= MAX_CLIP_VERTICES) {
+        break;
+      }
+      out[outCount] = a;
+      outLabels[outCount++] = inLabels[k];
+    }
+    if ((da <= 0) != (db <= 0)) {
+      if (outCount >= MAX_CLIP_VERTICES) {
+        break;
+      }
+      float t = da / (da - db);
+      out[outCount] = Vector2Lerp(a, b, t);
+      // Entering the kept side continues along edge k, leaving it starts
+      // the new edge
+      outLabels[outCount++] = (da <= 0) ? label : inLabels[k];
+    }
+  }
+  return outCount;
+}
+
+// Keeps the part of the polygon closer to p than to q and labels the new
+// bisector edge with site j. shift is half the weight difference w_p - w_q of
+// a power diagram, zero for the plain bisector.
+static int ClipByBisector(Vector2 p, Vector2 q, float shift, int j,
+                          const Vector2 *in, const int *inSites, int count,
+                          Vector2 *out, int *outSites) {
+  // Keep the side closer to p: dot(x - mid, q - p) <= shift
+  Vector2 normal = Vector2Subtract(q, p);
+  float offset = Vector2DotProduct(normal, Midpoint(p, q)) + shift;
+  return ClipHalfPlane(normal, offset, j, in, inSites, count, out, outSites);
+}
+
+static int ClipAgainstCandidates(Vertex *vertices, const float *weights,
+                                 int i, const int *candidates,
+                                 int numCandidates, const Rectangle *period,
+                                 Cell *cell, int *inSites, int count,
+                                 int *edgeSites) {
+  Vector2 *in = cell->vertices;
+  Vector2 *out = cell->temp_vertices;
+  int outSites[MAX_CLIP_VERTICES];
+
+  Vector2 p = vertices[i].position;
+  for (int c = 0; c < numCandidates && count > 0; c++) {
+    int j = candidates[c];
+    if (j == i) {
+      continue;
+    }
+    Vector2 q = vertices[j].position;
+    if (period) {
+      q = Vector2Add(p, MinimumImage(Vector2Subtract(q, p), *period));
+    }
+
+    float shift = weights ? 0.5f * (weights[i] - weights[j]) : 0.0f;
+
+    count = ClipByBisector(p, q, shift, j, in, inSites, count, out, outSites);
+    memcpy(in, out, count * sizeof(Vector2));
+    memcpy(inSites, outSites, count * sizeof(int));
+  }
+
+  cell->num_vertices = count;
+  cell->temp_vertex_count = 0;
+  if (edgeSites) {
+    memcpy(edgeSites, inSites, count * sizeof(int));
+  }
+  return count;
+}
+
+// Clips the box against the half-planes of site i towards each candidate
+// site. edgeSites receives, for every edge k -> k+1 of the resulting cell, the
+// site whose bisector produced it (-1 for the box). Returns the vertex count.
+int ClipVoronoiCell(Vertex *vertices, int i, const int *candidates,
+                    int numCandidates, Rectangle box, Cell *cell,
+                    int *edgeSites) {
+  return ClipPowerCell(vertices, 0, i, candidates, numCandidates, box, cell,
+                       edgeSites);
+}
+
+// Power cell of site i: the points where |x - p_i|^2 - w_i is smallest. Same
+// labelling as ClipVoronoiCell; the cell can be empty, or miss its own site,
+// once the weights differ enough.
+int ClipPowerCell(Vertex *vertices, const float *weights, int i,
+                  const int *candidates, int numCandidates, Rectangle box,
+                  Cell *cell, int *edgeSites) {
+  Vector2 *in = cell->vertices;
+  int inSites[MAX_CLIP_VERTICES];
+  in[0] = (Vector2){box.x, box.y};
+  in[1] = (Vector2){box.x + box.width, box.y};
+  in[2] = (Vector2){box.x + box.width, box.y + box.height};
+  in[3] = (Vector2){box.x, box.y + box.height};
+  inSites[0] = inSites[1] = inSites[2] = inSites[3] = -1;
+
+  return ClipAgainstCandidates(vertices, weights, i, candidates, numCandidates,
+                               0, cell, inSites, 4, edgeSites);
+}
+
+// Shortest offset between two points on the torus spanned by period
+Vector2 MinimumImage(Vector2 d, Rectangle period) {
+  d.x -= period.width * roundf(d.x / period.width);
+  d.y -= period.height * roundf(d.y / period.height);
+  return d;
+}
+
+Vector2 WrapToPeriod(Vector2 p, Rectangle period) {
+  p.x -= period.width * floorf((p.x - period.x) / period.width);
+  p.y -= period.height * floorf((p.y - period.y) / period.height);
+  return p;
+}
+
+// Periodic version of ClipVoronoiCell. Each candidate is replaced by its image
+// nearest to site i, which is exactly the ghost site that can bound the cell,
+// so no ghost copies are stored. The starting square is one period centred on
+// the site; its sides are the bisectors towards the site's own images, so
+// they are never a boundary and only survive when there are too few sites to
+// close the cell. The cell is returned unwrapped around the site and tiles
+// the plane when translated by whole periods.
+int ClipPeriodicCell(Vertex *vertices, int i, const int *candidates,
+                     int numCandidates, Rectangle period, Cell *cell,
+                     int *edgeSites) {
+  Vector2 p = vertices[i].position;
+  float hw = 0.5f * period.width;
+  float hh = 0.5f * period.height;
+
+  Vector2 *in = cell->vertices;
+  int inSites[MAX_CLIP_VERTICES];
+  in[0] = (Vector2){p.x - hw, p.y - hh};
+  in[1] = (Vector2){p.x + hw, p.y - hh};
+  in[2] = (Vector2){p.x + hw, p.y + hh};
+  in[3] = (Vector2){p.x - hw, p.y + hh};
+  inSites[0] = inSites[1] = inSites[2] = inSites[3] = -1;
+
+  return ClipAgainstCandidates(vertices, 0, i, candidates, numCandidates,
+                               &period, cell, inSites, 4, edgeSites);
+}
+
+// Box the half-plane path clips against, also the period of the torus
+static Rectangle IncrementalBox(struct app_state *AppState) {
+  Rectangle box = {0, 0, GetScreenWidth(), GetScreenHeight()};
+  if (AppState->domain.valid && !AppState->periodic) {
+    box = AppState->domain.bounds;
+  }
+  return box;
+}
+
+// Whether dirty site i moved further than half the gap to its nearest
+// previous neighbour. Beyond that its old neighbourhood no longer brackets
+// the sites it may now border.
+static bool32 MovedFar(const Vertex *vertices, const IncrementalState *inc,
+                       int i) {
+  if (inc->numNeighbours[i] == 0) {
+    return 1;
+  }
+  Vector2 from = inc->cachedPositions[i];
+  float nearest = INFINITY;
+  for (int k = 0; k < inc->numNeighbours[i]; k++) {
+    int j = inc->neighbours[i][k];
+    nearest = fminf(nearest,
+                    Vector2DistanceSqr(from, inc->cachedPositions[j]));
+  }
+  return Vector2DistanceSqr(vertices[i].position, from) > 0.25f * nearest;
+}
+
+typedef struct {
+  const SiteGrid *grid;
+  int *candidates;
+  int count;
+} GridCandidates;
+
+static void GatherGridSlot(void *data, int k) {
+  GridCandidates *gather = (GridCandidates *)data;
+  gather->candidates[gather->count++] = gather->grid->sortedSite[k];
+}
+
+// Voronoi cell of i from the grid alone, adding rings of grid cells until
+// every site further out is more than twice the cell's radius away
+static int ClipCellFromGrid(Vertex *vertices, int i, const SiteGrid *grid,
+                            Rectangle box, Cell *cell, int *edgeSites) {
+  int candidates[MAX_SITES];
+  int inSites[MAX_CLIP_VERTICES];
+  cell->vertices[0] = (Vector2){box.x, box.y};
+  cell->vertices[1] = (Vector2){box.x + box.width, box.y};
+  cell->vertices[2] = (Vector2){box.x + box.width, box.y + box.height};
+  cell->vertices[3] = (Vector2){box.x, box.y + box.height};
+  inSites[0] = inSites[1] = inSites[2] = inSites[3] = -1;
+  memcpy(edgeSites, inSites, 4 * sizeof(int));
+
+  Vector2 p = vertices[i].position;
+  int count = 4;
+  int cx, cy;
+  SiteGridCoords(grid, p, &cx, &cy);
+  for (int r = 0; count > 0; r++) {
+    GridCandidates gather = {grid, candidates, 0};
+    if (!VisitSiteGridRing(grid, cx, cy, r, GatherGridSlot, &gather)) {
+      break;
+    }
+    count = ClipAgainstCandidates(vertices, 0, i, candidates, gather.count, 0,
+                                  cell, inSites, count, edgeSites);
+    float radius = 0;
+    for (int k = 0; k < count; k++) {
+      radius = fmaxf(radius, Vector2Distance(cell->vertices[k], p));
+    }
+    if (r * grid->cellSize >= 2.0f * radius) {
+      break;
+    }
+  }
+  cell->num_vertices = count;
+  return count;
+}
+
+// Half-plane path, split in three so a scheduler can spread one iteration
+// over several calls: Begin finds the affected sites, ClipIncrementalCells
+// re-clips any range of them, Finish computes the centroids and moves the
+// sites. Sites only move in Finish, so the ranges can be clipped at any time
+// in between. Returns the number of affected sites.
+int BeginIncrementalIteration(struct app_state *AppState,
+                              IncrementalState *inc, float epsilon) {
+  int n = AppState->num_vertices;
+  for (int i = 0; i < n; i++) {
+    inc->allSites[i] = i;
+  }
+  bool32 rebuild = inc->numSites != n;
+  int numAffected = CollectAffectedSites(AppState->vertices, n, inc, epsilon);
+  for (int a = 0; !rebuild && a < numAffected && !inc->farMove; a++) {
+    int i = inc->affectedSites[a];
+    inc->farMove = inc->dirty[i] && MovedFar(AppState->vertices, inc, i);
+  }
+
+  // Cells that cannot be clipped locally come from the grid when the app
+  // set one up; the torus has no grid and clips against every site
+  inc->clipFromGrid = (rebuild || inc->farMove) && !AppState->periodic &&
+                      inc->grid.maxSites >= n && numAffected > 0;
+  if (inc->clipFromGrid) {
+    for (int i = 0; i < n; i++) {
+      inc->gridPositions[i] = AppState->vertices[i].position;
+    }
+    BuildSiteGrid(&inc->grid, inc->gridPositions, n, IncrementalBox(AppState));
+  }
+  return numAffected;
+}
+
+// Re-clips affected sites [start, end). Each cell is clipped only against its
+// previous neighbours and the neighbours of those, so the cost tracks how many
+// sites moved rather than N. When a site moved too far for that, the cells
+// come from the grid instead. Sites whose neighbour lists gain or lose a
+// clipped cell have changed cells too and are appended to the affected set,
+// so callers run until numAffected stops growing.
+void ClipIncrementalCells(struct app_state *AppState, IncrementalState *inc,
+                          int start, int end) {
+  Rectangle box = IncrementalBox(AppState);
+  int n = AppState->num_vertices;
+  bool32 local = inc->numSites == n && !inc->farMove;
+
+  int candidates[MAX_SITES];
+  int edgeSites[MAX_CLIP_VERTICES];
+  for (int a = start; a < end; a++) {
+    int i = inc->affectedSites[a];
+    const int *list = inc->allSites;
+    int numCandidates = n;
+
+    if (local) {
+      // Local candidate set: the 2-ring of i in the previous diagram
+      numCandidates = 0;
+      int stamp = ++inc->stampCounter;
+      for (int k = 0; k < inc->numNeighbours[i]; k++) {
+        int j = inc->neighbours[i][k];
+        if (inc->candidateStamp[j] != stamp) {
+          inc->candidateStamp[j] = stamp;
+          candidates[numCandidates++] = j;
+        }
+        for (int l = 0; l < inc->numNeighbours[j]; l++) {
+          int m = inc->neighbours[j][l];
+          if (m != i && inc->candidateStamp[m] != stamp) {
+            inc->candidateStamp[m] = stamp;
+            candidates[numCandidates++] = m;
+          }
+        }
+      }
+      list = candidates;
+    }
+
+    Cell *cell = &AppState->cells[i];
+    int count;
+    if (inc->clipFromGrid) {
+      count = ClipCellFromGrid(AppState->vertices, i, &inc->grid, box, cell,
+                               edgeSites);
+    } else if (AppState->periodic) {
+      count = ClipPeriodicCell(AppState->vertices, i, list, numCandidates, box,
+                               cell, edgeSites);
+    } else {
+      count = ClipVoronoiCell(AppState->vertices, i, list, numCandidates, box,
+                              cell, edgeSites);
+    }
+
+    // Keep the lists symmetric. A site that only now borders i, or no longer
+    // does, has a changed cell, so it joins the affected set behind the
+    // cursor; one whose edge with i just moved is already in it.
+    int old[MAX_CELL_NEIGHBOURS];
+    int numOld = inc->numNeighbours[i];
+    memcpy(old, inc->neighbours[i], numOld * sizeof(int));
+    int before = ++inc->stampCounter;
+    for (int k = 0; k < numOld; k++) {
+      inc->candidateStamp[old[k]] = before;
+    }
+    inc->numNeighbours[i] = 0;
+    for (int k = 0; k < count; k++) {
+      int j = edgeSites[k];
+      if (j >= 0) {
+        AddNeighbour(inc, i, j);
+        AddNeighbour(inc, j, i);
+        if (inc->candidateStamp[j] != before) {
+          MarkAffected(inc, j);
+        }
+      }
+    }
+    int after = ++inc->stampCounter;
+    for (int k = 0; k < inc->numNeighbours[i]; k++) {
+      inc->candidateStamp[inc->neighbours[i][k]] = after;
+    }
+    for (int k = 0; k < numOld; k++) {
+      if (inc->candidateStamp[old[k]] != after) {
+        MarkAffected(inc, old[k]);
+      }
+    }
+
+    inc->cachedPositions[i] = AppState->vertices[i].position;
+  }
+}
+
+void FinishIncrementalIteration(struct app_state *AppState,
+                                IncrementalState *inc) {
+  Rectangle box = IncrementalBox(AppState);
+  int n = AppState->num_vertices;
+  inc->numSites = n;
+  inc->farMove = 0;
+  inc->clipFromGrid = 0;
+
+  // Cells are clipped against the domain's bounding box above; the domain
+  // itself only enters through the centroid, taking precedence over density.
+  // Periodic cells straddle the seams, so they always use the plain centroid.
+  bool32 shaped = !AppState->periodic &&
+                  (AppState->domain.valid || AppState->density.valid);
+  if (shaped && AppState->domain.valid) {
+    DomainCentroids(&AppState->domain, AppState->cells, AppState->vertices,
+                    inc->affectedSites, inc->numAffected,
+                    inc->cachedCentroids);
+  } else if (shaped) {
+    WeightedCentroids(&AppState->density, AppState->cells, inc->affectedSites,
+                      inc->numAffected, inc->cachedCentroids);
+  }
+  for (int a = 0; a < inc->numAffected; a++) {
+    int i = inc->affectedSites[a];
+    Cell *cell = &AppState->cells[i];
+    if (cell->num_vertices < 3) {
+      inc->cachedCentroids[i] = AppState->vertices[i].position;
+    } else if (!shaped) {
+      inc->cachedCentroids[i] =
+          ComputeTrueCentroid(cell->vertices, cell->num_vertices);
+    }
+  }
+
+  // UPDATE (Lloyd)
+  for (int i = 0; i < n; i++) {
+    Vertex *v = &AppState->vertices[i];
+    v->centroid = inc->cachedCentroids[i];
+    v->position = StepTowardsCentroid(v->position, inc->cachedCentroids[i],
+                                      inc->maxStep);
+    if (AppState->periodic) {
+      // Centroids are unwrapped around their site, so step first and wrap
+      // afterwards; a site crossing a seam just shows up as dirty next time
+      v->centroid = WrapToPeriod(v->centroid, box);
+      v->position = WrapToPeriod(v->position, box);
+    }
+  }
+}
+
+// Half-plane path. Only affected cells are re-clipped, and only against their
+// previous neighbours and the neighbours of those, so the cost tracks how many
+// sites moved rather than N. Clean sites step towards their cached centroid.
+void LloydRelaxationIncremental(struct app_state *AppState,
+                                IncrementalState *inc, float epsilon) {
+  BeginIncrementalIteration(AppState, inc, epsilon);
+  for (int start = 0; start < inc->numAffected;) {
+    int end = inc->numAffected;
+    ClipIncrementalCells(AppState, inc, start, end);
+    start = end;
+  }
+  FinishIncrementalIteration(AppState, inc);
+}
+
+static void BuildSiteEdgeIndex(FortuneState *state, IncrementalState *inc,
+                               int n) {
+  memset(inc->siteEdgeOffsets, 0, (n + 1) * sizeof(int));
+  for (int e = 0; e < state->edgesSize; e++) {
+    int a = state->edges[e].vertices[0];
+    int b = state->edges[e].vertices[1];
+    if (a >= 0 && a < n) {
+      inc->siteEdgeOffsets[a + 1]++;
+    }
+    if (b >= 0 && b < n && b != a) {
+      inc->siteEdgeOffsets[b + 1]++;
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    inc->siteEdgeOffsets[i + 1] += inc->siteEdgeOffsets[i];
+  }
+
+  int fill[MAX_SITES];
+  memcpy(fill, inc->siteEdgeOffsets, n * sizeof(int));
+  for (int e = 0; e < state->edgesSize; e++) {
+    int a = state->edges[e].vertices[0];
+    int b = state->edges[e].vertices[1];
+    if (a >= 0 && a < n) {
+      inc->siteEdges[fill[a]++] = e;
+    }
+    if (b >= 0 && b < n && b != a) {
+      inc->siteEdges[fill[b]++] = e;
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    inc->numNeighbours[i] = 0;
+  }
+  for (int e = 0; e < state->edgesSize; e++) {
+    int a = state->edges[e].vertices[0];
+    int b = state->edges[e].vertices[1];
+    if (a >= 0 && b >= 0 && a != b) {
+      AddNeighbour(inc, a, b);
+      AddNeighbour(inc, b, a);
+    }
+  }
+}
+
+// Sweep path, in the same three steps as the half-plane path. The sweep
+// itself cannot be resumed mid-diagram, so Begin runs it whole and only when
+// some site is dirty; the per-site polygon gathering and centroids, which
+// dominate, are redone only for the affected region using a per-site edge
+// index instead of scanning every edge for every site.
+int BeginFortuneIteration(struct app_state *AppState, IncrementalState *inc,
+                          float epsilon) {
+  int n = AppState->num_vertices;
+  int numAffected = CollectAffectedSites(AppState->vertices, n, inc, epsilon);
+  if (numAffected > 0) {
+    UpdateVoronoi(AppState);
+    BuildSiteEdgeIndex(&AppState->fortuneState, inc, n);
+    // Sites that only now border a moved one need their cells gathered too
+    for (int i = 0; i < n; i++) {
+      if (!inc->dirty[i]) {
+        continue;
+      }
+      for (int k = 0; k < inc->numNeighbours[i]; k++) {
+        MarkAffected(inc, inc->neighbours[i][k]);
+      }
+    }
+  }
+  return inc->numAffected;
+}
+
+void GatherFortuneCells(struct app_state *AppState, IncrementalState *inc,
+                        int start, int end) {
+  int screenWidth = GetScreenWidth();
+  int screenHeight = GetScreenHeight();
+  int n = AppState->num_vertices;
+
+  for (int a = start; a < end; a++) {
+    int i = inc->affectedSites[a];
+    int first = inc->siteEdgeOffsets[i];
+    int count = inc->siteEdgeOffsets[i + 1] - first;
+
+    Vector2 polygon[100];
+    int polySize = GatherFortuneCell(&AppState->fortuneState, i,
+                                     &inc->siteEdges[first], count,
+                                     screenWidth, screenHeight, polygon);
+
+    inc->cachedPositions[i] = AppState->vertices[i].position;
+    if (polySize > 0) {
+      inc->cachedCentroids[i] = ComputeTrueCentroid(polygon, polySize);
+    } else if (inc->numSites != n) {
+      inc->cachedCentroids[i] = AppState->vertices[i].position;
+    }
+  }
+}
+
+void FinishFortuneIteration(struct app_state *AppState,
+                            IncrementalState *inc) {
+  int n = AppState->num_vertices;
+  if (inc->numAffected > 0) {
+    inc->numSites = n;
+  }
+
+  for (int i = 0; i < n; i++) {
+    AppState->vertices[i].centroid = inc->cachedCentroids[i];
+    AppState->vertices[i].position = StepTowardsCentroid(
+        AppState->vertices[i].position, inc->cachedCentroids[i], inc->maxStep);
+  }
+}
+
+void LloydRelaxationFortuneIncremental(struct app_state *AppState,
+                                       IncrementalState *inc, float epsilon) {
+  // The sweep clips against the screen, the torus goes through the clipper
+  if (AppState->periodic) {
+    LloydRelaxationIncremental(AppState, inc, epsilon);
+    return;
+  }
+
+  int numAffected = BeginFortuneIteration(AppState, inc, epsilon);
+  GatherFortuneCells(AppState, inc, 0, numAffected);
+  FinishFortuneIteration(AppState, inc);
+}
@@ -0,0 +1,283 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+#define MIN_QUERIES_PER_JOB 1024
+#define MIN_TILES_PER_JOB 4
+// Grid queries are taken in square tiles of this many pixels a side
+#define GRID_TILE 16
+// Triangles whose circumcircles hold a query. The cavity has two sites more
+// on its rim than it has triangles, so each rim site's neighbours fit in a
+// 64-bit mask.
+#define MAX_CAVITY 62
+#define MAX_RING (MAX_CAVITY + 2)
+
+// The clipper carries edge labels, which the stolen areas have no use for
+static const int NoLabels[MAX_CLIP_VERTICES];
+
+// Positions come from the locator, which copied them from the sites the
+// triangulation was built for
+typedef struct {
+  const Triangulation *tri;
+  const PointLocator *loc;
+  const float *values;
+} NaturalField;
+
+static inline Vector2 At(const NaturalField *field, int site) {
+  return field->loc->sites[site];
+}
+
+static double PolygonArea(const Vector2 *polygon, int count) {
+  double area = 0;
+  for (int k = 0, j = count - 1; k < count; j = k++) {
+    area += (double)polygon[j].x * polygon[k].y -
+            (double)polygon[k].x * polygon[j].y;
+  }
+  return 0.5 * area;
+}
+
+// Sibson's interpolant at p. Inserting p virtually, the triangles whose
+// circumcircles hold it form a cavity, the sites on its rim are p's natural
+// neighbours and the circumcentres of p with each rim edge bound p's cell.
+// The area the cell takes from a neighbour is the part of it closer to that
+// neighbour than to every other one, found by clipping. Outside the hull the
+// cell is unbounded and p takes the value of its nearest site.
+static float InterpolateAt(const NaturalField *field, Vector2 p, int *start) {
+  const Triangulation *tri = field->tri;
+  int t = WalkToTriangle(tri->triangles, tri->numTriangles, field->loc->sites,
+                         p, start, 0);
+  if (t < 0) {
+    int site = tri->triangles[*start].v[0];
+    return field->values[LocatePoint(field->loc, p, site)];
+  }
+  for (int k = 0; k < 3; k++) {
+    int site = tri->triangles[t].v[k];
+    if (At(field, site).x == p.x && At(field, site).y == p.y) {
+      return field->values[site];
+    }
+  }
+
+  int cavity[MAX_CAVITY];
+  int numCavity = 0;
+  cavity[numCavity++] = t;
+  for (int c = 0; c < numCavity; c++) {
+    const DelaunayTriangle *dt = &tri->triangles[cavity[c]];
+    for (int k = 0; k < 3; k++) {
+      int u = dt->n[k];
+      bool32 seen = u < 0;
+      for (int d = 0; d < numCavity && !seen; d++) {
+        seen = cavity[d] == u;
+      }
+      if (seen || numCavity == MAX_CAVITY) {
+        continue;
+      }
+      const DelaunayTriangle *du = &tri->triangles[u];
+      if (InCircle(At(field, du->v[0]), At(field, du->v[1]),
+                   At(field, du->v[2]), p) > 0) {
+        cavity[numCavity++] = u;
+      }
+    }
+  }
+
+  // Rim edges, counter-clockwise around the cavity
+  int rimFrom[MAX_RING], rimTo[MAX_RING];
+  int numRim = 0;
+  for (int c = 0; c < numCavity; c++) {
+    const DelaunayTriangle *dt = &tri->triangles[cavity[c]];
+    for (int k = 0; k < 3; k++) {
+      int u = dt->n[k];
+      bool32 inside = 0;
+      for (int d = 0; d < numCavity && !inside && u >= 0; d++) {
+        inside = cavity[d] == u;
+      }
+      if (!inside && numRim < MAX_RING) {
+        rimFrom[numRim] = dt->v[(k + 1) % 3];
+        rimTo[numRim] = dt->v[(k + 2) % 3];
+        numRim++;
+      }
+    }
+  }
+
+  // Chain the rim into the ring of natural neighbours
+  int ring[MAX_RING];
+  int numRing = 0;
+  ring[numRing++] = rimFrom[0];
+  for (int next = rimTo[0]; next != ring[0] && numRing < numRim;) {
+    ring[numRing++] = next;
+    int e = 0;
+    while (e < numRim && rimFrom[e] != next) {
+      e++;
+    }
+    if (e == numRim) {
+      break;
+    }
+    next = rimTo[e];
+  }
+
+  // Everything from here is relative to p, which keeps the circumcentres of
+  // thin triangles with p well within float precision
+  Vector2 local[MAX_RING];
+  Vector2 cell[MAX_CLIP_VERTICES];
+  Vector2 origin = {0};
+  for (int r = 0; r < numRing; r++) {
+    local[r] = Vector2Subtract(At(field, ring[r]), p);
+  }
+  for (int r = 0; r < numRing; r++) {
+    Vector2 a = local[r], b = local[(r + 1) % numRing];
+    if (Orient(origin, a, b) <= 0) {
+      // p is on the hull, where its cell is unbounded
+      return field->values[LocatePoint(field->loc, p, ring[r])];
+    }
+    cell[r] = Circumcentre(origin, a, b);
+  }
+
+  // The old cell of a rim site crosses p's cell only along the Voronoi edges
+  // of cavity triangles, so it is cut by its neighbours in those alone
+  uint64 adjacent[MAX_RING] = {0};
+  for (int c = 0; c < numCavity; c++) {
+    const DelaunayTriangle *dt = &tri->triangles[cavity[c]];
+    int at[3];
+    for (int k = 0; k < 3; k++) {
+      at[k] = 0;
+      while (at[k] < numRing - 1 && ring[at[k]] != dt->v[k]) {
+        at[k]++;
+      }
+    }
+    for (int k = 0; k < 3; k++) {
+      adjacent[at[k]] |= (1ull << at[(k + 1) % 3]) | (1ull << at[(k + 2) % 3]);
+    }
+  }
+
+  int outLabels[MAX_CLIP_VERTICES];
+  Vector2 bufferA[MAX_CLIP_VERTICES], bufferB[MAX_CLIP_VERTICES];
+  double total = 0, weighted = 0;
+  for (int r = 0; r < numRing; r++) {
+    Vector2 site = local[r];
+    memcpy(bufferA, cell, numRing * sizeof(Vector2));
+    Vector2 *in = bufferA, *out = bufferB;
+    int count = numRing;
+    for (int s = 0; s < numRing && count > 0; s++) {
+      if (s == r || !(adjacent[r] & (1ull << s))) {
+        continue;
+      }
+      // Keep the side closer to site: dot(x - mid, other - site) <= 0
+      Vector2 other = local[s];
+      Vector2 normal = Vector2Subtract(other, site);
+      Vector2 mid = Vector2Scale(Vector2Add(site, other), 0.5f);
+      float offset = Vector2DotProduct(normal, mid);
+      count = ClipHalfPlane(normal, offset, 0, in, NoLabels, count, out,
+                            outLabels);
+      Vector2 *swap = in;
+      in = out;
+      out = swap;
+    }
+    double stolen = count > 2 ? PolygonArea(in, count) : 0;
+    if (stolen > 0) {
+      total += stolen;
+      weighted += stolen * field->values[ring[r]];
+    }
+  }
+  return total > 0 ? (float)(weighted / total) : field->values[ring[0]];
+}
+
+typedef struct {
+  NaturalField field;
+  const Vector2 *points;
+  const int *order;
+  float *out;
+} InterpolateJob;
+
+// Each range walks its stretch of the curve, every query starting from the
+// triangle the one before ended in
+static void RunInterpolate(void *data, int start, int end) {
+  InterpolateJob *job = (InterpolateJob *)data;
+  int triangle = 0;
+  for (int i = start; i < end; i++) {
+    int q = job->order[i];
+    job->out[q] = InterpolateAt(&job->field, job->points[q], &triangle);
+  }
+}
+
+// Natural-neighbour interpolation of the sites' values at count points, over
+// a triangulation and a locator built for the sites' current positions. The
+// queries are visited along a Hilbert curve, so consecutive ones walk a step
+// or two and find the same triangles still in cache. Returns 0 if the
+// triangulation is not valid or the arena is too small for the ordering.
+bool32 InterpolateNaturalNeighbour(const Triangulation *tri,
+                                   const PointLocator *loc,
+                                   const float *values, memory_arena *arena,
+                                   const Vector2 *points, int count,
+                                   float *out) {
+  if (!tri->valid || loc->numSites < 1) {
+    return 0;
+  }
+  if (count < 1) {
+    return 1;
+  }
+  uint64 used = arena->used;
+  int *order = HilbertQueryOrder(points, count, arena);
+  if (!order) {
+    return 0;
+  }
+  InterpolateJob job = {{tri, loc, values}, points, order, out};
+  ParallelFor(count, MIN_QUERIES_PER_JOB, RunInterpolate, &job);
+  arena->used = used;
+  return 1;
+}
+
+typedef struct {
+  NaturalField field;
+  Rectangle box;
+  int width;
+  int height;
+  int tilesAcross;
+  float *out;
+} GridJob;
+
+// Tiles are taken in row order and the pixels of each back and forth, so
+// every query starts next to the last one
+static void RunGridTiles(void *data, int start, int end) {
+  GridJob *job = (GridJob *)data;
+  float stepX = job->box.width / job->width;
+  float stepY = job->box.height / job->height;
+  int triangle = 0;
+  for (int tile = start; tile < end; tile++) {
+    int x0 = (tile % job->tilesAcross) * GRID_TILE;
+    int y0 = (tile / job->tilesAcross) * GRID_TILE;
+    int x1 = x0 + GRID_TILE < job->width ? x0 + GRID_TILE : job->width;
+    int y1 = y0 + GRID_TILE < job->height ? y0 + GRID_TILE : job->height;
+    for (int y = y0; y < y1; y++) {
+      for (int i = 0; i < x1 - x0; i++) {
+        int x = ((y - y0) & 1) ? x1 - 1 - i : x0 + i;
+        Vector2 p = {job->box.x + (x + 0.5f) * stepX,
+                     job->box.y + (y + 0.5f) * stepY};
+        job->out[y * job->width + x] =
+            InterpolateAt(&job->field, p, &triangle);
+      }
+    }
+  }
+}
+
+// Natural-neighbour interpolation onto a width by height grid over box, one
+// value per pixel centre, row-major. Returns 0 if the triangulation is not
+// valid.
+bool32 InterpolateNaturalNeighbourGrid(const Triangulation *tri,
+                                       const PointLocator *loc,
+                                       const float *values, Rectangle box,
+                                       int width, int height, float *out) {
+  if (!tri->valid || loc->numSites < 1) {
+    return 0;
+  }
+  if (width < 1 || height < 1) {
+    return 1;
+  }
+  int tilesAcross = (width + GRID_TILE - 1) / GRID_TILE;
+  int tilesDown = (height + GRID_TILE - 1) / GRID_TILE;
+  GridJob job = {{tri, loc, values}, box, width, height, tilesAcross, out};
+  ParallelFor(tilesAcross * tilesDown, MIN_TILES_PER_JOB, RunGridTiles, &job);
+  return 1;
+}
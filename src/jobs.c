@@ -0,0 +1,84 @@
+#include <raylib.h>
+
+#include "gui.h"
+
+#if !defined(PLATFORM_WEB)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+  ParallelJob *job;
+  void *data;
+  int start;
+  int end;
+} JobRange;
+
+#if !defined(PLATFORM_WEB)
+static void *RunJobRange(void *arg) {
+  JobRange *range = (JobRange *)arg;
+  range->job(range->data, range->start, range->end);
+  return 0;
+}
+#endif
+
+// Threads ParallelFor spreads work over, one per core
+int JobThreadCount(void) {
+#if defined(PLATFORM_WEB)
+  return 1;
+#else
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cores < 1) {
+    return 1;
+  }
+  return cores > MAX_JOB_THREADS ? MAX_JOB_THREADS : (int)cores;
+#endif
+}
+
+// Fork-join over [0, count). Threads only live for the duration of the call so
+// nothing is left running inside the plug when it gets hot reloaded. Ranges
+// smaller than minBatch are not worth a thread and run on the caller.
+void ParallelFor(int count, int minBatch, ParallelJob *job, void *data) {
+  if (count <= 0) {
+    return;
+  }
+
+#if defined(PLATFORM_WEB)
+  (void)minBatch;
+  job(data, 0, count);
+#else
+  if (minBatch < 1) {
+    minBatch = 1;
+  }
+  int threads = JobThreadCount();
+  if (threads > count / minBatch) {
+    threads = count / minBatch;
+  }
+  if (threads <= 1) {
+    job(data, 0, count);
+    return;
+  }
+
+  JobRange ranges[MAX_JOB_THREADS];
+  pthread_t handles[MAX_JOB_THREADS];
+  bool32 started[MAX_JOB_THREADS] = {0};
+  for (int t = 0; t < threads; t++) {
+    ranges[t] = (JobRange){job, data, (int)((int64)count * t / threads),
+                           (int)((int64)count * (t + 1) / threads)};
+  }
+
+  // The caller takes the first range itself
+  for (int t = 1; t < threads; t++) {
+    started[t] = pthread_create(&handles[t], 0, RunJobRange, &ranges[t]) == 0;
+    if (!started[t]) {
+      RunJobRange(&ranges[t]);
+    }
+  }
+  RunJobRange(&ranges[0]);
+  for (int t = 1; t < threads; t++) {
+    if (started[t]) {
+      pthread_join(handles[t], 0);
+    }
+  }
+#endif
+}
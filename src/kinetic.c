@@ -0,0 +1,437 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+#define BISECTION_STEPS 60
+
+#define NEXT(k) (((k) + 1) % 3)
+
+static bool32 EventIsLive(const KineticDelaunay *kd, const KineticEvent *e) {
+  const GhostTriangulation *gt = &kd->mesh;
+  return gt->versions[e->triangle] == e->version &&
+         gt->versions[e->neighbour] == e->neighbourVersion &&
+         gt->triangles[e->triangle].n[e->edge] == e->neighbour;
+}
+
+static void SiftDown(KineticDelaunay *kd, int k, KineticEvent e) {
+  for (;;) {
+    int child = 2 * k + 1;
+    if (child >= kd->numEvents) {
+      break;
+    }
+    if (child + 1 < kd->numEvents &&
+        kd->events[child + 1].time < kd->events[child].time) {
+      child++;
+    }
+    if (e.time <= kd->events[child].time) {
+      break;
+    }
+    kd->events[k] = kd->events[child];
+    k = child;
+  }
+  kd->events[k] = e;
+}
+
+// Drops the events retired by flips and velocity changes and restores the
+// heap. Every edge has at most one live event, so this always makes room.
+static void CompactEvents(KineticDelaunay *kd) {
+  int live = 0;
+  for (int k = 0; k < kd->numEvents; k++) {
+    if (EventIsLive(kd, &kd->events[k])) {
+      kd->events[live++] = kd->events[k];
+    }
+  }
+  kd->numEvents = live;
+  for (int k = live / 2 - 1; k >= 0; k--) {
+    SiftDown(kd, k, kd->events[k]);
+  }
+}
+
+static void PushEvent(KineticDelaunay *kd, KineticEvent e) {
+  if (kd->numEvents >= MAX_KINETIC_EVENTS) {
+    CompactEvents(kd);
+    if (kd->numEvents >= MAX_KINETIC_EVENTS) {
+      kd->overflow = 1;
+      return;
+    }
+  }
+  int k = kd->numEvents++;
+  while (k > 0) {
+    int parent = (k - 1) / 2;
+    if (kd->events[parent].time <= e.time) {
+      break;
+    }
+    kd->events[k] = kd->events[parent];
+    k = parent;
+  }
+  kd->events[k] = e;
+}
+
+static KineticEvent PopEvent(KineticDelaunay *kd) {
+  KineticEvent top = kd->events[0];
+  KineticEvent last = kd->events[--kd->numEvents];
+  if (kd->numEvents > 0) {
+    SiftDown(kd, 0, last);
+  }
+  return top;
+}
+
+// In-circle determinant of edge k of triangle t against the far vertex of its
+// neighbour, as a polynomial in the time since now. Every point moves
+// linearly, so relative to the far vertex each row is (x, y, x^2 + y^2) with
+// degrees 1, 1 and 2 and the determinant has degree 4.
+static void CertificatePolynomial(const KineticDelaunay *kd, int t, int k,
+                                  double c[5]) {
+  const GhostTriangulation *gt = &kd->mesh;
+  const DelaunayTriangle *dt = &gt->triangles[t];
+  int u = dt->n[k];
+  int d = gt->triangles[u].v[SharedEdge(gt->triangles, u, t)];
+  Vector2 pd = gt->positions[d], vd = kd->velocities[d];
+
+  double x[3][2], y[3][2], w[3][3];
+  for (int r = 0; r < 3; r++) {
+    Vector2 p = gt->positions[dt->v[r]], v = kd->velocities[dt->v[r]];
+    double px = (double)p.x - pd.x, py = (double)p.y - pd.y;
+    double vx = (double)v.x - vd.x, vy = (double)v.y - vd.y;
+    x[r][0] = px;
+    x[r][1] = vx;
+    y[r][0] = py;
+    y[r][1] = vy;
+    w[r][0] = px * px + py * py;
+    w[r][1] = 2.0 * (px * vx + py * vy);
+    w[r][2] = vx * vx + vy * vy;
+  }
+
+  // Cyclic expansion: sum over rows of x_r (y_{r+1} w_{r+2} - w_{r+1} y_{r+2})
+  memset(c, 0, 5 * sizeof(double));
+  for (int r = 0; r < 3; r++) {
+    int r1 = (r + 1) % 3, r2 = (r + 2) % 3;
+    double minor[4] = {0};
+    for (int i = 0; i < 2; i++) {
+      for (int j = 0; j < 3; j++) {
+        minor[i + j] += y[r1][i] * w[r2][j] - y[r2][i] * w[r1][j];
+      }
+    }
+    for (int i = 0; i < 2; i++) {
+      for (int j = 0; j < 4; j++) {
+        c[i + j] += x[r][i] * minor[j];
+      }
+    }
+  }
+}
+
+static double EvaluatePolynomial(const double *c, int degree, double x) {
+  double value = c[degree];
+  for (int k = degree - 1; k >= 0; k--) {
+    value = value * x + c[k];
+  }
+  return value;
+}
+
+// Bisects a monotone piece [a, b] whose ends lie on either side of zero and
+// returns the end of the final bracket where the polynomial is positive
+static double Bisect(const double *c, int degree, double a, double b) {
+  bool32 rising = EvaluatePolynomial(c, degree, b) > 0;
+  for (int step = 0; step < BISECTION_STEPS; step++) {
+    double m = 0.5 * (a + b);
+    if ((EvaluatePolynomial(c, degree, m) > 0) == rising) {
+      b = m;
+    } else {
+      a = m;
+    }
+  }
+  return rising ? b : a;
+}
+
+// Cuts [lo, hi] at the real roots of the polynomial's derivative, so the
+// polynomial is monotone between consecutive cuts and each piece holds at
+// most one of its roots. Returns the number of cuts, lo and hi included.
+static int MonotonePieces(const double *c, int degree, double lo, double hi,
+                          double *cuts) {
+  int numCuts = 0;
+  cuts[numCuts++] = lo;
+  if (degree >= 2) {
+    double derivative[4];
+    for (int k = 0; k < degree; k++) {
+      derivative[k] = (k + 1) * c[k + 1];
+    }
+    int d = degree - 1;
+    while (d > 0 && derivative[d] == 0) {
+      d--;
+    }
+    if (d > 0) {
+      double pieces[5];
+      int numPieces = MonotonePieces(derivative, d, lo, hi, pieces);
+      for (int k = 0; k + 1 < numPieces; k++) {
+        double fa = EvaluatePolynomial(derivative, d, pieces[k]);
+        double fb = EvaluatePolynomial(derivative, d, pieces[k + 1]);
+        if ((fa > 0) != (fb > 0)) {
+          cuts[numCuts++] = Bisect(derivative, d, pieces[k], pieces[k + 1]);
+        }
+      }
+    }
+  }
+  cuts[numCuts++] = hi;
+  return numCuts;
+}
+
+// Smallest x in [lo, hi] where the polynomial is positive, INFINITY when it
+// never is. A certificate that is positive at lo but falling is not a
+// failure: that is the new diagonal of a flip just made.
+static double FirstPositive(const double *c, int degree, double lo,
+                            double hi) {
+  while (degree > 0 && c[degree] == 0) {
+    degree--;
+  }
+
+  double cuts[6];
+  int numCuts = MonotonePieces(c, degree, lo, hi, cuts);
+  for (int k = 0; k + 1 < numCuts; k++) {
+    double a = cuts[k], b = cuts[k + 1];
+    double fa = EvaluatePolynomial(c, degree, a);
+    double fb = EvaluatePolynomial(c, degree, b);
+    if (fa > 0) {
+      if (k == 0 && fb < fa) {
+        continue;
+      }
+      return a;
+    }
+    if (fb > 0) {
+      return Bisect(c, degree, a, b);
+    }
+  }
+  return INFINITY;
+}
+
+// Schedules the next failure of the edge opposite v[k] of t within the
+// horizon, or a recheck at its end. Every edge is owned by its lower-index
+// triangle so a pair only ever has one live event.
+static void ScheduleEdge(KineticDelaunay *kd, int t, int k, double from) {
+  const GhostTriangulation *gt = &kd->mesh;
+  int u = gt->triangles[t].n[k];
+  if (u < 0) {
+    return;
+  }
+  if (u < t) {
+    k = SharedEdge(gt->triangles, u, t);
+    int swap = t;
+    t = u;
+    u = swap;
+  }
+
+  double c[5];
+  CertificatePolynomial(kd, t, k, c);
+  if (c[1] == 0 && c[2] == 0 && c[3] == 0 && c[4] == 0) {
+    return; // nothing on the edge moves
+  }
+
+  double lo = from - kd->now;
+  double hi = lo + kd->horizon;
+  double failure = FirstPositive(c, 4, lo, hi);
+
+  KineticEvent e = {0};
+  e.triangle = t;
+  e.edge = k;
+  e.neighbour = u;
+  e.version = gt->versions[t];
+  e.neighbourVersion = gt->versions[u];
+  e.recheck = !(failure <= hi);
+  e.time = kd->now + (e.recheck ? hi : failure);
+  PushEvent(kd, e);
+}
+
+static void ScheduleAllEdges(KineticDelaunay *kd) {
+  kd->numEvents = 0;
+  kd->overflow = 0;
+  for (int t = 0; t < kd->mesh.numTriangles; t++) {
+    for (int k = 0; k < 3; k++) {
+      if (kd->mesh.triangles[t].n[k] > t) {
+        ScheduleEdge(kd, t, k, kd->now);
+      }
+    }
+  }
+}
+
+// Triangulates the current positions inside ghost corners around bounds and
+// schedules every edge afresh
+static bool32 BuildKineticTriangulation(KineticDelaunay *kd,
+                                        Rectangle bounds) {
+  GhostTriangulation *gt = &kd->mesh;
+  gt->bounds = bounds;
+  for (int g = 0; g < GHOST_CORNERS; g++) {
+    kd->velocities[MAX_SITES + g] = (Vector2){0};
+  }
+  kd->rebuilds++;
+  kd->valid = BuildGhostTriangulation(gt);
+  if (kd->valid) {
+    ScheduleAllEdges(kd);
+  }
+  return kd->valid;
+}
+
+// Builds the structure for the sites' positions and velocities. The diagram
+// inside bounds is exact; sites may wander outside as long as they stay well
+// within the ghosts, otherwise the next step rebuilds around them.
+bool32 InitKineticDelaunay(KineticDelaunay *kd, const Vertex *vertices,
+                           int numSites, Rectangle bounds) {
+  kd->valid = 0;
+  if (numSites > MAX_SITES || numSites < 0) {
+    return 0;
+  }
+  kd->mesh.numSites = numSites;
+  kd->now = 0;
+  if (kd->horizon <= 0) {
+    kd->horizon = KINETIC_HORIZON;
+  }
+  for (int i = 0; i < numSites; i++) {
+    kd->mesh.positions[i] = vertices[i].position;
+    kd->velocities[i] = vertices[i].velocity;
+  }
+  kd->rebuilds = 0;
+  ClearGhostChanges(&kd->mesh);
+  return BuildKineticTriangulation(kd, bounds);
+}
+
+// A new velocity for site i invalidates the certificates of every edge it
+// takes part in, which are exactly the edges of the triangles around it
+void SetKineticVelocity(KineticDelaunay *kd, int i, Vector2 velocity) {
+  GhostTriangulation *gt = &kd->mesh;
+  kd->velocities[i] = velocity;
+  if (!kd->valid) {
+    return;
+  }
+
+  int first = gt->siteTriangle[i];
+  int ring[MAX_CELL_NEIGHBOURS * 2];
+  int count = 0;
+  int t = first;
+  do {
+    ring[count++] = t;
+    const DelaunayTriangle *dt = &gt->triangles[t];
+    int k = dt->v[0] == i ? 0 : (dt->v[1] == i ? 1 : 2);
+    t = dt->n[NEXT(k)];
+  } while (t >= 0 && t != first && count < (int)(sizeof(ring) / sizeof(int)));
+
+  for (int r = 0; r < count; r++) {
+    gt->versions[ring[r]]++;
+  }
+  for (int r = 0; r < count; r++) {
+    const DelaunayTriangle *dt = &gt->triangles[ring[r]];
+    for (int k = 0; k < 3; k++) {
+      int u = dt->n[k];
+      bool32 inRing = u >= 0 && (gt->triangles[u].v[0] == i ||
+                                 gt->triangles[u].v[1] == i ||
+                                 gt->triangles[u].v[2] == i);
+      // Edges through i are shared by two ring triangles, schedule them once
+      if (!inRing || ring[r] < u) {
+        ScheduleEdge(kd, ring[r], k, kd->now);
+      }
+    }
+  }
+}
+
+// Moves every site along its velocity for dt, repairing the triangulation at
+// each certificate failure in time order with a single flip and rescheduling
+// only the five edges of the flipped quad. Returns the number of flips.
+int AdvanceKineticDelaunay(KineticDelaunay *kd, float dt) {
+  if (!kd->valid) {
+    return 0;
+  }
+
+  GhostTriangulation *gt = &kd->mesh;
+  double end = kd->now + dt;
+  int maxFlips = 8 * gt->numTriangles + 64;
+  kd->flips = 0;
+  kd->eventsProcessed = 0;
+  while (kd->numEvents > 0 && kd->events[0].time <= end) {
+    KineticEvent e = PopEvent(kd);
+    if (!EventIsLive(kd, &e)) {
+      continue;
+    }
+    kd->eventsProcessed++;
+    if (e.recheck) {
+      ScheduleEdge(kd, e.triangle, e.edge, e.time);
+      continue;
+    }
+
+    int u = FlipGhostEdge(gt, e.triangle, e.edge);
+    for (int k = 0; k < 3; k++) {
+      ScheduleEdge(kd, e.triangle, k, e.time);
+    }
+    ScheduleEdge(kd, u, 0, e.time);
+    ScheduleEdge(kd, u, 1, e.time);
+    if (++kd->flips > maxFlips) {
+      kd->overflow = 1; // degenerate motion, rebuild below
+      break;
+    }
+  }
+
+  // Only now do the positions move; events were solved relative to them
+  bool32 escaped = 0;
+  for (int i = 0; i < gt->numSites; i++) {
+    Vector2 *p = &gt->positions[i];
+    *p = Vector2Add(*p, Vector2Scale(kd->velocities[i], dt));
+    escaped |= !InsideGhosts(gt, *p);
+  }
+  kd->now = end;
+
+  if (kd->overflow || escaped) {
+    kd->now = 0;
+    BuildKineticTriangulation(kd, gt->bounds);
+  }
+  return kd->flips;
+}
+
+// Gives every site a random heading at speed
+void SeedKineticVelocities(Vertex *vertices, int numSites, float speed,
+                           uint64 seed) {
+  pcg32 rng = Pcg32Seed(seed, 0);
+  for (int i = 0; i < numSites; i++) {
+    float angle = Pcg32Range(&rng, 0, 2 * PI);
+    vertices[i].velocity = (Vector2){speed * cosf(angle), speed * sinf(angle)};
+  }
+}
+
+// Kinetic mode for the app: sites drift along Vertex.velocity and bounce off
+// the screen edges, and the diagram is repaired by flips instead of swept
+// again every frame. Leaves kinetic mode past MAX_KINETIC_SITES sites.
+void StepKineticVoronoi(struct app_state *AppState, float dt) {
+  KineticDelaunay *kd = &AppState->kineticDelaunay;
+  int n = AppState->num_vertices;
+  if (n > MAX_KINETIC_SITES) {
+    AppState->kinetic = 0;
+    return;
+  }
+  Rectangle screen = {0, 0, GetScreenWidth(), GetScreenHeight()};
+  if (!kd->valid || kd->mesh.numSites != n) {
+    InitKineticDelaunay(kd, AppState->vertices, n, screen);
+  }
+
+  for (int i = 0; i < n; i++) {
+    Vector2 v = AppState->vertices[i].velocity;
+    if (v.x != kd->velocities[i].x || v.y != kd->velocities[i].y) {
+      SetKineticVelocity(kd, i, v);
+    }
+  }
+  AdvanceKineticDelaunay(kd, dt);
+
+  for (int i = 0; i < n; i++) {
+    Vertex *v = &AppState->vertices[i];
+    v->position = kd->mesh.positions[i];
+    if ((v->position.x < screen.x && v->velocity.x < 0) ||
+        (v->position.x > screen.x + screen.width && v->velocity.x > 0)) {
+      v->velocity.x = -v->velocity.x;
+    }
+    if ((v->position.y < screen.y && v->velocity.y < 0) ||
+        (v->position.y > screen.y + screen.height && v->velocity.y > 0)) {
+      v->velocity.y = -v->velocity.y;
+    }
+  }
+
+  AppState->fortuneState.edgesSize =
+      GhostVoronoiEdges(&kd->mesh, AppState->fortuneState.edges, MAX_EDGES);
+}
@@ -0,0 +1,734 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+
+#include "gui.h"
+
+#define MIN_POINTS_PER_JOB 4096
+#define MIN_CLUSTERS_PER_JOB 8
+// Seeding draws its random numbers per block of points, one PCG stream each
+#define SEED_BLOCK 4096
+#define SEED_ROUNDS 5
+#define SEED_OVERSAMPLING 2.0f
+#define SEED_TREE_LEAF 8
+#define SEED_TREE_STACK 128
+
+static inline const float *PointAt(const KMeans *km, int i) {
+  return &km->points[(uint64)i * km->dim];
+}
+
+static inline float *CentreAt(const KMeans *km, int j) {
+  return &km->centres[(uint64)j * km->dim];
+}
+
+static inline float PointWeight(const KMeans *km, int i) {
+  return km->weights ? km->weights[i] : 1;
+}
+
+// Accumulated in double, so the same pair always gives the same distance and
+// the rounding is far below the slack the bounds keep
+static inline double SquaredDistance(const float *a, const float *b,
+                                     int dim) {
+  double sum = 0;
+  for (int d = 0; d < dim; d++) {
+    double delta = (double)a[d] - b[d];
+    sum += delta * delta;
+  }
+  return sum;
+}
+
+static inline double Distance(const float *a, const float *b, int dim) {
+  return sqrt(SquaredDistance(a, b, dim));
+}
+
+// Bounds are stored as floats, rounded outwards so they stay bounds
+static inline float RoundUp(double x) {
+  float f = (float)x;
+  return f < x ? nextafterf(f, INFINITY) : f;
+}
+
+static inline float RoundDown(double x) {
+  float f = (float)x;
+  return f > x ? nextafterf(f, -INFINITY) : f;
+}
+
+bool32 InitKMeans(KMeans *km, memory_arena *arena, const float *points,
+                  int numPoints, int dim, int k, const float *centres) {
+  memset(km, 0, sizeof(*km));
+  if (numPoints < 1 || dim < 1 || k < 1 || k > numPoints) {
+    return 0;
+  }
+  km->points = points;
+  km->numPoints = numPoints;
+  km->dim = dim;
+  km->k = k;
+  km->pruning = 1;
+
+  km->centres = PushArray(arena, (uint64)k * dim, float);
+  km->assignment = PushArray(arena, numPoints, int);
+  km->upper = PushArray(arena, numPoints, float);
+  km->lower = PushArray(arena, numPoints, float);
+  km->drift = PushArray(arena, k, float);
+  km->halfSeparation = PushArray(arena, k, float);
+  km->centreDistances = PushArray(arena, (uint64)k * k, float);
+  km->packed = PushArray(arena, PackedCentresCount(k, dim), float);
+  km->norms = PushArray(arena, PackedCentresCount(k, 1), float);
+  km->clusterStart = PushArray(arena, k + 1, int);
+  km->clusterPoints = PushArray(arena, numPoints, int);
+  km->sums = PushArray(arena, (uint64)k * dim, double);
+  if (!km->centres || !km->assignment || !km->upper || !km->lower ||
+      !km->drift || !km->halfSeparation || !km->centreDistances ||
+      !km->packed || !km->norms || !km->clusterStart || !km->clusterPoints ||
+      !km->sums) {
+    return 0;
+  }
+
+  memset(km->assignment, 0, numPoints * sizeof(int));
+  // Without given centres, k points spread evenly through the data
+  for (int j = 0; j < k; j++) {
+    const float *from =
+        centres ? &centres[(uint64)j * dim]
+                : PointAt(km, (int)((uint64)j * numPoints / k));
+    memcpy(CentreAt(km, j), from, dim * sizeof(float));
+  }
+  return 1;
+}
+
+static void RunSeparations(void *data, int start, int end) {
+  KMeans *km = (KMeans *)data;
+  int k = km->k;
+  for (int j = start; j < end; j++) {
+    float closest = INFINITY;
+    for (int other = 0; other < k; other++) {
+      float gap = other == j ? 0
+                             : RoundDown(Distance(CentreAt(km, j),
+                                                  CentreAt(km, other),
+                                                  km->dim));
+      km->centreDistances[(uint64)j * k + other] = gap;
+      if (other != j) {
+        closest = fminf(closest, gap);
+      }
+    }
+    km->halfSeparation[j] = RoundDown(0.5 * closest);
+  }
+}
+
+typedef struct {
+  KMeans *km;
+  bool32 first;
+  bool32 fresh; // bounds are not to be trusted and are set from scratch
+  int changed;
+  uint64 distances;
+} AssignJob;
+
+// Closest centre to point i, ties to the lower index as a plain scan would,
+// starting from its current centre at distance best. A centre more than twice
+// best away from the closest found so far cannot be closer and is skipped
+// (Elkan); its distance is still bounded below for the runner-up.
+static int NearestCentre(const KMeans *km, int i, int nearest, double *best,
+                         double *second, uint64 *distances) {
+  const float *p = PointAt(km, i);
+  int start = nearest;
+  *second = INFINITY;
+  for (int j = 0; j < km->k; j++) {
+    if (j == start) {
+      continue;
+    }
+    if (km->pruning) {
+      double gap = km->centreDistances[(uint64)nearest * km->k + j];
+      if (gap > 2.0 * *best) {
+        *second = fmin(*second, gap - *best);
+        continue;
+      }
+    }
+    double d = Distance(p, CentreAt(km, j), km->dim);
+    (*distances)++;
+    if (d < *best || (d == *best && j < nearest)) {
+      *second = *best;
+      *best = d;
+      nearest = j;
+    } else if (d < *second) {
+      *second = d;
+    }
+  }
+  return nearest;
+}
+
+static void RunAssignment(void *data, int start, int end) {
+  AssignJob *job = (AssignJob *)data;
+  KMeans *km = job->km;
+  int changed = 0;
+  uint64 distances = 0;
+
+  for (int i = start; i < end; i++) {
+    int a = km->assignment[i];
+    float limit = 0;
+    if (!job->fresh && km->pruning) {
+      // No other centre can be closer while the upper bound stays below both
+      // the lower bound and half the gap to a's nearest centre (Hamerly)
+      limit = fmaxf(km->lower[i], km->halfSeparation[a]);
+      if (km->upper[i] < limit) {
+        continue;
+      }
+    }
+
+    double best = Distance(PointAt(km, i), CentreAt(km, a), km->dim);
+    distances++;
+    if (!job->fresh && km->pruning) {
+      km->upper[i] = RoundUp(best);
+      if (km->upper[i] < limit) {
+        continue;
+      }
+    }
+
+    double second;
+    int nearest = NearestCentre(km, i, a, &best, &second, &distances);
+    if (job->first || nearest != a) {
+      changed++;
+    }
+    km->assignment[i] = nearest;
+    km->upper[i] = RoundUp(best);
+    km->lower[i] = RoundDown(second);
+  }
+
+  __atomic_fetch_add(&job->changed, changed, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&job->distances, distances, __ATOMIC_RELAXED);
+}
+
+// Moves centre j to the mean of its points, summed in sums[j] with a total
+// weight of count
+static void MoveCentre(KMeans *km, int j, double count) {
+  km->drift[j] = 0;
+  if (count <= 0) {
+    return; // an empty cluster keeps its centre
+  }
+  const double *sum = &km->sums[(uint64)j * km->dim];
+  float *centre = CentreAt(km, j);
+  double moved = 0;
+  for (int d = 0; d < km->dim; d++) {
+    float mean = (float)(sum[d] / count);
+    double delta = (double)mean - centre[d];
+    moved += delta * delta;
+    centre[d] = mean;
+  }
+  km->drift[j] = RoundUp(sqrt(moved));
+}
+
+static void RunRecentre(void *data, int start, int end) {
+  KMeans *km = (KMeans *)data;
+  int dim = km->dim;
+  for (int j = start; j < end; j++) {
+    int from = km->clusterStart[j], to = km->clusterStart[j + 1];
+    double *sum = &km->sums[(uint64)j * dim];
+    memset(sum, 0, dim * sizeof(double));
+    double weight = 0;
+    for (int slot = from; slot < to; slot++) {
+      int i = km->clusterPoints[slot];
+      const float *p = PointAt(km, i);
+      float w = PointWeight(km, i);
+      for (int d = 0; d < dim; d++) {
+        sum[d] += w * p[d];
+      }
+      weight += w;
+    }
+    MoveCentre(km, j, weight);
+  }
+}
+
+// The tree backend leaves the sums and clusterStart filled in
+static void RunMoveCentres(void *data, int start, int end) {
+  KMeans *km = (KMeans *)data;
+  for (int j = start; j < end; j++) {
+    MoveCentre(km, j, km->clusterStart[j + 1] - km->clusterStart[j]);
+  }
+}
+
+// Every centre moves to the mean of its points. Points are grouped by cluster
+// first and each cluster sums its own points in index order, so the centres
+// come out the same whatever the thread count.
+static void Recentre(KMeans *km) {
+  int k = km->k;
+  memset(km->clusterStart, 0, (k + 1) * sizeof(int));
+  for (int i = 0; i < km->numPoints; i++) {
+    km->clusterStart[km->assignment[i] + 1]++;
+  }
+  for (int j = 0; j < k; j++) {
+    km->clusterStart[j + 1] += km->clusterStart[j];
+  }
+  // Fill with clusterStart[j] as the cursor, then shift it back
+  for (int i = 0; i < km->numPoints; i++) {
+    km->clusterPoints[km->clusterStart[km->assignment[i]]++] = i;
+  }
+  for (int j = k; j > 0; j--) {
+    km->clusterStart[j] = km->clusterStart[j - 1];
+  }
+  km->clusterStart[0] = 0;
+
+  ParallelFor(k, MIN_CLUSTERS_PER_JOB, RunRecentre, km);
+}
+
+typedef struct {
+  KMeans *km;
+  float largest;
+  float secondLargest;
+  int largestCentre;
+} BoundsJob;
+
+// A point's centre moved by its drift, any other centre by at most the
+// largest drift among the rest
+static void RunUpdateBounds(void *data, int start, int end) {
+  BoundsJob *job = (BoundsJob *)data;
+  KMeans *km = job->km;
+  for (int i = start; i < end; i++) {
+    int a = km->assignment[i];
+    float others = a == job->largestCentre ? job->secondLargest : job->largest;
+    km->upper[i] = nextafterf(km->upper[i] + km->drift[a], INFINITY);
+    km->lower[i] = nextafterf(km->lower[i] - others, -INFINITY);
+  }
+}
+
+// Dense assignment through the blocked kernel. Every distance is computed,
+// but as a matrix product, which for dim of 16 and up runs far closer to the
+// machine's peak than the bounds save. clusterPoints is free until Recentre
+// and takes the new assignment.
+static void AssignAllBlocked(KMeans *km, bool32 first) {
+  PackCentres(km->centres, km->k, km->dim, km->packed, km->norms);
+  int *nearest = km->clusterPoints;
+  AssignNearestBlocked(km->points, km->numPoints, km->dim, km->packed,
+                       km->norms, km->k, nearest, 0);
+  int changed = 0;
+  for (int i = 0; i < km->numPoints; i++) {
+    changed += first || nearest[i] != km->assignment[i];
+    km->assignment[i] = nearest[i];
+  }
+  km->changed = changed;
+  km->distances += (uint64)km->numPoints * km->k;
+}
+
+// One assign-recentre round, the same structure as LloydRelaxation with the
+// Voronoi cells of the sites replaced by the points nearest to each centre.
+// Returns the number of points that changed cluster; all of them on the
+// first call.
+int KMeansIteration(KMeans *km) {
+  bool32 first = km->iteration == 0;
+  // The bounds only hold if the last pass kept them up to date, so after a
+  // pass with pruning off or through the blocked kernel they start over
+  bool32 fresh = first || !km->bounded;
+  km->bounded = 0;
+  if (km->tree) {
+    FilterKMeansTree(km, 0);
+    ParallelFor(km->k, MIN_CLUSTERS_PER_JOB, RunMoveCentres, km);
+    km->iteration++;
+    return km->changed;
+  }
+
+  if (km->blocked) {
+    AssignAllBlocked(km, first);
+  } else {
+    if (km->pruning) {
+      ParallelFor(km->k, MIN_CLUSTERS_PER_JOB, RunSeparations, km);
+    }
+    AssignJob assign = {km, first, fresh, 0, 0};
+    ParallelFor(km->numPoints, MIN_POINTS_PER_JOB, RunAssignment, &assign);
+    km->changed = assign.changed;
+    km->distances += assign.distances;
+  }
+
+  Recentre(km);
+
+  if (km->pruning && !km->blocked) {
+    BoundsJob bounds = {km, 0, 0, -1};
+    for (int j = 0; j < km->k; j++) {
+      if (km->drift[j] > bounds.largest) {
+        bounds.secondLargest = bounds.largest;
+        bounds.largest = km->drift[j];
+        bounds.largestCentre = j;
+      } else if (km->drift[j] > bounds.secondLargest) {
+        bounds.secondLargest = km->drift[j];
+      }
+    }
+    ParallelFor(km->numPoints, MIN_POINTS_PER_JOB, RunUpdateBounds, &bounds);
+    km->bounded = 1;
+  }
+
+  km->iteration++;
+  return km->changed;
+}
+
+// Iterates until no point changes cluster or maxIterations is reached.
+// Returns the number of iterations run.
+int RunKMeans(KMeans *km, int maxIterations) {
+  int run = 0;
+  while (run < maxIterations) {
+    run++;
+    if (KMeansIteration(km) == 0) {
+      break;
+    }
+  }
+  if (km->tree) {
+    // The tree hands whole subtrees to a centre without touching their
+    // points, so the per-point assignment is written once at the end
+    FilterKMeansTree(km, 1);
+  }
+  return run;
+}
+
+// k-d tree over one seeding round's candidates, for the nearest candidate to
+// a point within the distance it already has
+typedef struct {
+  int start; // slice of the tree's order
+  int end;
+  int left; // children, -1 on a leaf
+  int right;
+  int axis;
+  float split;
+} SeedTreeNode;
+
+typedef struct {
+  const KMeans *km;
+  const int *candidates;
+  int *order; // candidate ids, each node's slice spatially grouped
+  SeedTreeNode *nodes;
+  int numNodes;
+} SeedTree;
+
+static inline float CandidateCoordinate(const SeedTree *tree, int c,
+                                        int axis) {
+  return PointAt(tree->km, tree->candidates[c])[axis];
+}
+
+// Rearranges order[start, end) so the candidate at mid has the mid-th
+// smallest coordinate on axis, smaller ones before it and larger after
+static void SelectMedian(SeedTree *tree, int start, int end, int mid,
+                         int axis) {
+  int *order = tree->order;
+  while (end - start > 1) {
+    float pivot = CandidateCoordinate(tree, order[(start + end) / 2], axis);
+    int lo = start, hi = end - 1;
+    while (lo <= hi) {
+      while (CandidateCoordinate(tree, order[lo], axis) < pivot) {
+        lo++;
+      }
+      while (CandidateCoordinate(tree, order[hi], axis) > pivot) {
+        hi--;
+      }
+      if (lo <= hi) {
+        int swap = order[lo];
+        order[lo++] = order[hi];
+        order[hi--] = swap;
+      }
+    }
+    if (mid <= hi) {
+      end = hi + 1;
+    } else if (mid >= lo) {
+      start = lo;
+    } else {
+      return;
+    }
+  }
+}
+
+// Nodes BuildSeedTree takes over count candidates
+static int SeedTreeNodeCount(int count) {
+  if (count <= SEED_TREE_LEAF) {
+    return 1;
+  }
+  return 1 + SeedTreeNodeCount(count / 2) +
+         SeedTreeNodeCount(count - count / 2);
+}
+
+static int BuildSeedTree(SeedTree *tree, int start, int end) {
+  int index = tree->numNodes++;
+  SeedTreeNode *node = &tree->nodes[index];
+  *node = (SeedTreeNode){start, end, -1, -1, 0, 0};
+  if (end - start <= SEED_TREE_LEAF) {
+    return index;
+  }
+
+  // Split the widest side at the median
+  int dim = tree->km->dim;
+  float widest = -1;
+  for (int axis = 0; axis < dim; axis++) {
+    float lo = INFINITY, hi = -INFINITY;
+    for (int slot = start; slot < end; slot++) {
+      float x = CandidateCoordinate(tree, tree->order[slot], axis);
+      lo = fminf(lo, x);
+      hi = fmaxf(hi, x);
+    }
+    if (hi - lo > widest) {
+      widest = hi - lo;
+      node->axis = axis;
+    }
+  }
+  int mid = (start + end) / 2;
+  SelectMedian(tree, start, end, mid, node->axis);
+  node->split = CandidateCoordinate(tree, tree->order[mid], node->axis);
+
+  int left = BuildSeedTree(tree, start, mid);
+  int right = BuildSeedTree(tree, mid, end);
+  tree->nodes[index].left = left;
+  tree->nodes[index].right = right;
+  return index;
+}
+
+// Lowers best (squared) to the closest candidate to p and sets nearest, if
+// any is closer than best already is. Subtrees across a split farther than
+// the current best are never entered.
+static void NearestInSeedTree(const SeedTree *tree, const float *p,
+                              double *best, int *nearest) {
+  int stack[SEED_TREE_STACK];
+  float gaps[SEED_TREE_STACK];
+  int top = 0;
+  stack[top] = 0;
+  gaps[top++] = 0;
+  while (top > 0) {
+    top--;
+    if ((double)gaps[top] * gaps[top] >= *best) {
+      continue;
+    }
+    const SeedTreeNode *node = &tree->nodes[stack[top]];
+    if (node->left < 0) {
+      for (int slot = node->start; slot < node->end; slot++) {
+        int c = tree->order[slot];
+        double d = SquaredDistance(p, PointAt(tree->km, tree->candidates[c]),
+                                   tree->km->dim);
+        if (d < *best) {
+          *best = d;
+          *nearest = c;
+        }
+      }
+      continue;
+    }
+    float gap = p[node->axis] - node->split;
+    int nearChild = gap < 0 ? node->left : node->right;
+    int farChild = gap < 0 ? node->right : node->left;
+    if (top + 2 <= SEED_TREE_STACK) {
+      stack[top] = farChild;
+      gaps[top++] = fabsf(gap);
+    }
+    stack[top] = nearChild;
+    gaps[top++] = 0;
+  }
+}
+
+typedef struct {
+  KMeans *km;
+  float *cost;  // squared distance to the closest candidate
+  int *nearest; // that candidate
+  uint8 *picked;
+  double *blockCost;
+  const int *candidates;
+  const SeedTree *tree; // over this round's candidates
+  uint64 seed;
+  double rate; // oversampling * k / total cost
+} SeedJob;
+
+static inline int BlockEnd(const KMeans *km, int block) {
+  int end = (block + 1) * SEED_BLOCK;
+  return end < km->numPoints ? end : km->numPoints;
+}
+
+static void RunFirstCosts(void *data, int start, int end) {
+  SeedJob *job = (SeedJob *)data;
+  KMeans *km = job->km;
+  const float *first = PointAt(km, job->candidates[0]);
+  for (int block = start; block < end; block++) {
+    double cost = 0;
+    for (int i = block * SEED_BLOCK; i < BlockEnd(km, block); i++) {
+      double d = SquaredDistance(PointAt(km, i), first, km->dim);
+      job->cost[i] = (float)d;
+      job->nearest[i] = 0;
+      cost += PointWeight(km, i) * d;
+    }
+    job->blockCost[block] = cost;
+  }
+}
+
+// Every point joins independently with probability rate * cost. Each block
+// draws from its own stream, so the picks do not depend on how the blocks
+// are spread over threads.
+static void RunPickCandidates(void *data, int start, int end) {
+  SeedJob *job = (SeedJob *)data;
+  KMeans *km = job->km;
+  for (int block = start; block < end; block++) {
+    pcg32 rng = Pcg32Seed(job->seed, block);
+    for (int i = block * SEED_BLOCK; i < BlockEnd(km, block); i++) {
+      job->picked[i] =
+          Pcg32Float(&rng) < job->rate * PointWeight(km, i) * job->cost[i];
+    }
+  }
+}
+
+static void RunUpdateCosts(void *data, int start, int end) {
+  SeedJob *job = (SeedJob *)data;
+  KMeans *km = job->km;
+  for (int block = start; block < end; block++) {
+    double cost = 0;
+    for (int i = block * SEED_BLOCK; i < BlockEnd(km, block); i++) {
+      double best = job->cost[i];
+      NearestInSeedTree(job->tree, PointAt(km, i), &best, &job->nearest[i]);
+      job->cost[i] = (float)best;
+      cost += PointWeight(km, i) * best;
+    }
+    job->blockCost[block] = cost;
+  }
+}
+
+static double TotalCost(const double *blockCost, int numBlocks) {
+  double total = 0;
+  for (int block = 0; block < numBlocks; block++) {
+    total += blockCost[block];
+  }
+  return total;
+}
+
+// k-means++ on the weighted candidates, on one thread. Distances to the first
+// candidate and to the one farthest from it bound every distance from below,
+// so a new centre only measures the candidates those bounds do not rule out.
+static void ReduceCandidates(KMeans *km, const int *candidates,
+                             int numCandidates, const double *weight,
+                             double *cost, float *pivotA, float *pivotB,
+                             pcg32 *rng) {
+  int farthest = 0;
+  for (int c = 0; c < numCandidates; c++) {
+    pivotA[c] = (float)Distance(PointAt(km, candidates[c]),
+                                PointAt(km, candidates[0]), km->dim);
+    farthest = pivotA[c] > pivotA[farthest] ? c : farthest;
+  }
+  double total = 0;
+  for (int c = 0; c < numCandidates; c++) {
+    pivotB[c] = (float)Distance(PointAt(km, candidates[c]),
+                                PointAt(km, candidates[farthest]), km->dim);
+    // Before the first centre every candidate counts by weight alone
+    cost[c] = 1;
+    total += weight[c];
+  }
+
+  for (int j = 0; j < km->k; j++) {
+    int pick = -1;
+    if (total > 0) {
+      double target = Pcg32Float(rng) * total;
+      for (int c = 0; c < numCandidates; c++) {
+        double w = weight[c] * cost[c];
+        if (w > 0) {
+          pick = c;
+          if ((target -= w) < 0) {
+            break;
+          }
+        }
+      }
+    }
+    if (pick < 0) {
+      // Fewer distinct candidates than centres, repeat one
+      pick = j % numCandidates;
+    }
+
+    int q = candidates[pick];
+    memcpy(CentreAt(km, j), PointAt(km, q), km->dim * sizeof(float));
+    bool32 first = j == 0;
+    total = 0;
+    for (int c = 0; c < numCandidates; c++) {
+      float da = pivotA[c] - pivotA[pick];
+      float db = pivotB[c] - pivotB[pick];
+      if (first || ((double)da * da < cost[c] && (double)db * db < cost[c])) {
+        double d = SquaredDistance(PointAt(km, candidates[c]), PointAt(km, q),
+                                   km->dim);
+        cost[c] = first ? d : fmin(cost[c], d);
+      }
+      total += weight[c] * cost[c];
+    }
+  }
+}
+
+// k-means|| seeding (Bahmani et al.). Instead of k sequential passes of
+// k-means++, a few passes each pick about oversampling * k candidates at once,
+// every point with probability proportional to its squared distance to the
+// candidates so far, and then measure every point against a k-d tree of the
+// new ones. The candidates, weighted by how many points are closest to them,
+// are reduced to k centres with k-means++ on one thread. Point weights scale
+// both the sampling and the candidate weights. rounds and
+// oversampling default to 5 and 2 when not positive. Overwrites the centres
+// and restarts the iteration count; returns 0 if the arena is too small.
+bool32 SeedKMeansParallel(KMeans *km, memory_arena *arena, uint64 seed,
+                          int rounds, float oversampling) {
+  rounds = rounds > 0 ? rounds : SEED_ROUNDS;
+  oversampling = oversampling > 0 ? oversampling : SEED_OVERSAMPLING;
+  int n = km->numPoints;
+  int numBlocks = (n + SEED_BLOCK - 1) / SEED_BLOCK;
+  double perRound = (double)oversampling * km->k;
+  int capacity = (int)fmin(n, 2.0 * perRound * rounds + km->k + 1);
+
+  uint64 used = arena->used;
+  SeedJob job = {.km = km};
+  job.cost = PushArray(arena, n, float);
+  job.nearest = PushArray(arena, n, int);
+  job.picked = PushArray(arena, n, uint8);
+  job.blockCost = PushArray(arena, numBlocks, double);
+  int *candidates = PushArray(arena, capacity, int);
+  double *weight = PushArray(arena, capacity, double);
+  double *reduceCost = PushArray(arena, capacity, double);
+  float *pivotA = PushArray(arena, capacity, float);
+  float *pivotB = PushArray(arena, capacity, float);
+  SeedTree tree = {.km = km, .candidates = candidates};
+  tree.order = PushArray(arena, capacity, int);
+  tree.nodes = PushArray(arena, SeedTreeNodeCount(capacity), SeedTreeNode);
+  if (!job.cost || !job.nearest || !job.picked || !job.blockCost ||
+      !candidates || !weight || !reduceCost || !pivotA || !pivotB ||
+      !tree.order || !tree.nodes) {
+    arena->used = used;
+    return 0;
+  }
+  job.candidates = candidates;
+  job.tree = &tree;
+
+  pcg32 rng = Pcg32Seed(seed, (uint64)-1);
+  int numCandidates = 0;
+  candidates[numCandidates++] = (int)Pcg32Bounded(&rng, n);
+  ParallelFor(numBlocks, 1, RunFirstCosts, &job);
+  double total = TotalCost(job.blockCost, numBlocks);
+
+  // A few more rounds when the first ones came up short of k
+  for (int round = 0; round < 4 * rounds && total > 0; round++) {
+    if (round >= rounds && numCandidates >= km->k) {
+      break;
+    }
+    job.seed = Mix64(seed + round);
+    job.rate = perRound / total;
+    ParallelFor(numBlocks, 1, RunPickCandidates, &job);
+
+    int first = numCandidates;
+    for (int i = 0; i < n && numCandidates < capacity; i++) {
+      if (job.picked[i]) {
+        candidates[numCandidates++] = i;
+      }
+    }
+    if (numCandidates == first) {
+      continue;
+    }
+    for (int c = first; c < numCandidates; c++) {
+      tree.order[c - first] = c;
+    }
+    tree.numNodes = 0;
+    BuildSeedTree(&tree, 0, numCandidates - first);
+    ParallelFor(numBlocks, 1, RunUpdateCosts, &job);
+    total = TotalCost(job.blockCost, numBlocks);
+    if (numCandidates >= capacity) {
+      break;
+    }
+  }
+
+  for (int c = 0; c < numCandidates; c++) {
+    weight[c] = 0;
+  }
+  for (int i = 0; i < n; i++) {
+    weight[job.nearest[i]] += PointWeight(km, i);
+  }
+  ReduceCandidates(km, candidates, numCandidates, weight, reduceCost, pivotA,
+                   pivotB, &rng);
+
+  km->iteration = 0;
+  km->changed = 0;
+  arena->used = used;
+  return 1;
+}
@@ -0,0 +1,204 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+
+#include "gui.h"
+
+#define MIN_QUERIES_PER_JOB 4096
+// Sites bucketed per hint cell on average
+#define SITES_PER_HINT 2
+
+static inline double SquaredGap(Vector2 a, Vector2 b) {
+  double dx = (double)a.x - b.x, dy = (double)a.y - b.y;
+  return dx * dx + dy * dy;
+}
+
+bool32 InitPointLocator(PointLocator *loc, memory_arena *arena,
+                        int capacity) {
+  memset(loc, 0, sizeof(*loc));
+  loc->capacity = capacity;
+  loc->sites = PushArray(arena, capacity, Vector2);
+  loc->hints = PushArray(arena, capacity, int);
+  return loc->sites && loc->hints;
+}
+
+static inline int HintCell(const PointLocator *loc, Vector2 p) {
+  int x = (int)((p.x - loc->box.x) / loc->cellSize);
+  int y = (int)((p.y - loc->box.y) / loc->cellSize);
+  x = CLAMP(x, 0, loc->gridW - 1);
+  y = CLAMP(y, 0, loc->gridH - 1);
+  return y * loc->gridW + x;
+}
+
+// Greedy descent over the Delaunay graph: a site that is not the nearest to
+// p always has a Delaunay neighbour nearer than itself, so the walk only
+// stops at a nearest site
+static int Walk(const PointLocator *loc, Vector2 p, int site) {
+  const SiteGraph *graph = loc->graph;
+  double best = SquaredGap(loc->sites[site], p);
+  for (;;) {
+    int next = -1;
+    for (int k = graph->neighbourStart[site];
+         k < graph->neighbourStart[site + 1]; k++) {
+      int s = graph->neighbours[k];
+      double gap = SquaredGap(loc->sites[s], p);
+      if (gap < best) {
+        best = gap;
+        next = s;
+      }
+    }
+    if (next < 0) {
+      return site;
+    }
+    site = next;
+  }
+}
+
+// The hint for a cell is the site nearest its centre, found by walking from
+// the cell before, so a query starts at most about a cell away
+static void BuildHints(PointLocator *loc) {
+  Vector2 min = loc->sites[0], max = loc->sites[0];
+  for (int i = 1; i < loc->numSites; i++) {
+    Vector2 p = loc->sites[i];
+    min.x = p.x < min.x ? p.x : min.x;
+    min.y = p.y < min.y ? p.y : min.y;
+    max.x = p.x > max.x ? p.x : max.x;
+    max.y = p.y > max.y ? p.y : max.y;
+  }
+  float width = max.x - min.x, height = max.y - min.y;
+  float extent = width > height ? width : height;
+  int cells = loc->numSites / SITES_PER_HINT;
+  cells = cells > 1 ? cells : 1;
+  loc->cellSize = sqrtf(width * height / cells);
+  if (!(loc->cellSize > 0)) {
+    // Sites along a line, or all in one place
+    loc->cellSize = extent > 0 ? extent / cells : 1;
+  }
+  loc->gridW = (int)(width / loc->cellSize) + 1;
+  loc->gridH = (int)(height / loc->cellSize) + 1;
+  while (loc->gridW * loc->gridH > loc->capacity) {
+    loc->cellSize *= 1.25f;
+    loc->gridW = (int)(width / loc->cellSize) + 1;
+    loc->gridH = (int)(height / loc->cellSize) + 1;
+  }
+  loc->box = (Rectangle){min.x, min.y, width, height};
+
+  // Boustrophedon, so every cell starts from one next to it
+  int site = 0;
+  for (int y = 0; y < loc->gridH; y++) {
+    for (int i = 0; i < loc->gridW; i++) {
+      int x = (y & 1) ? loc->gridW - 1 - i : i;
+      Vector2 centre = {min.x + (x + 0.5f) * loc->cellSize,
+                        min.y + (y + 0.5f) * loc->cellSize};
+      site = Walk(loc, centre, site);
+      loc->hints[y * loc->gridW + x] = site;
+    }
+  }
+}
+
+// Walks the Delaunay graph of the last sweep over the sites' current
+// positions and builds the hint grid. Returns 0 if there are more sites than
+// the locator holds. The graph must outlive the locator's use.
+bool32 BuildPointLocator(PointLocator *loc, const SiteGraph *graph,
+                         const Vertex *vertices) {
+  loc->numSites = 0;
+  loc->graph = graph;
+  loc->graphVersion = graph->version;
+  if (graph->numSites < 1 || graph->numSites > loc->capacity) {
+    return 0;
+  }
+  loc->numSites = graph->numSites;
+  for (int i = 0; i < loc->numSites; i++) {
+    loc->sites[i] = vertices[i].position;
+  }
+  BuildHints(loc);
+  return 1;
+}
+
+// Site whose cell holds p, walking from start, or from the hint grid when
+// start is negative. On a boundary between cells either site may come back.
+int LocatePoint(const PointLocator *loc, Vector2 p, int start) {
+  if (start < 0 || start >= loc->numSites) {
+    start = loc->hints[HintCell(loc, p)];
+  }
+  return Walk(loc, p, start);
+}
+
+typedef struct {
+  const PointLocator *loc;
+  const Vector2 *points;
+  const int *order;
+  int *sites;
+} LocateJob;
+
+// Each range walks its stretch of the curve, every query starting from the
+// answer to the one before
+static void RunLocate(void *data, int start, int end) {
+  LocateJob *job = (LocateJob *)data;
+  int site = -1;
+  for (int i = start; i < end; i++) {
+    int q = job->order[i];
+    site = LocatePoint(job->loc, job->points[q], site);
+    job->sites[q] = site;
+  }
+}
+
+// Locates count points at once. The queries are visited along a Hilbert
+// curve, so consecutive walks are a step or two long. Returns 0 if the arena
+// is too small for the ordering.
+bool32 LocatePoints(const PointLocator *loc, memory_arena *arena,
+                    const Vector2 *points, int count, int *sites) {
+  if (count < 1) {
+    return 1;
+  }
+  uint64 used = arena->used;
+  int *order = HilbertQueryOrder(points, count, arena);
+  if (!order) {
+    return 0;
+  }
+  LocateJob job = {loc, points, order, sites};
+  ParallelFor(count, MIN_QUERIES_PER_JOB, RunLocate, &job);
+  arena->used = used;
+  return 1;
+}
+
+// Whether the locator still matches the graph and the sites' positions.
+// Comparing the positions is a fraction of the cost of the hint walks.
+static bool32 LocatorCurrent(const PointLocator *loc, const SiteGraph *graph,
+                             const Vertex *vertices, int numSites) {
+  if (loc->graph != graph || loc->graphVersion != graph->version ||
+      loc->numSites != numSites) {
+    return 0;
+  }
+  for (int i = 0; i < numSites; i++) {
+    if (loc->sites[i].x != vertices[i].position.x ||
+        loc->sites[i].y != vertices[i].position.y) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Site under the mouse, in the diagram's y-up coordinates, walking the last
+// sweep's graph. Between sweeps the sites only move by relaxation steps, so
+// the old graph is near enough for picking. The locator is only rebuilt when
+// the graph or the sites have changed since, and the walk starts from the
+// site hovered last frame. Returns -1 before there is a diagram.
+int SiteAtMouse(struct app_state *AppState) {
+  AppState->mouse_x = GetMouseX();
+  AppState->mouse_y = GetMouseY();
+  PointLocator *loc = &AppState->locator;
+  const SiteGraph *graph = &AppState->siteGraph;
+  int n = AppState->num_vertices;
+  if (!loc->capacity || graph->numSites != n) {
+    return -1;
+  }
+  if (!LocatorCurrent(loc, graph, AppState->vertices, n) &&
+      !BuildPointLocator(loc, graph, AppState->vertices)) {
+    return -1;
+  }
+  Vector2 p = {(float)AppState->mouse_x,
+               (float)(GetScreenHeight() - AppState->mouse_y)};
+  return LocatePoint(loc, p, AppState->hoveredSite);
+}
@@ -0,0 +1,258 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <raylib.h>
+
+#include "gui.h"
+
+#define MIN_CENTRES_PER_JOB 8
+#define CHECKPOINT_MAGIC 0x4b434d42u // "BMCK"
+#define CHECKPOINT_VERSION 1
+
+typedef struct {
+  uint32 magic;
+  uint32 version;
+  int32 k;
+  int32 dim;
+  uint64 batches;
+  uint64 cursor;
+} CheckpointHeader;
+
+static inline const float *RowAt(const MiniBatchKMeans *mb, uint64 row) {
+  return &mb->mapped[row * mb->dim];
+}
+
+static inline float *CentreAt(const MiniBatchKMeans *mb, int j) {
+  return &mb->centres[(uint64)j * mb->dim];
+}
+
+// Maps the file and seeds the centres with k rows drawn from all of it.
+// Returns 0 if the file cannot be mapped, holds fewer than k rows or the
+// arena is too small.
+bool32 OpenMiniBatchKMeans(MiniBatchKMeans *mb, memory_arena *arena,
+                           const char *path, int dim, int k, int batchSize,
+                           uint64 seed) {
+  memset(mb, 0, sizeof(*mb));
+  mb->fd = -1;
+  if (dim < 1 || k < 1 || batchSize < 1) {
+    return 0;
+  }
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return 0;
+  }
+  struct stat st;
+  uint64 rowBytes = (uint64)dim * sizeof(float);
+  if (fstat(fd, &st) != 0 || (uint64)st.st_size / rowBytes < (uint64)k) {
+    close(fd);
+    return 0;
+  }
+  void *mapped = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED) {
+    close(fd);
+    return 0;
+  }
+  madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+
+  mb->fd = fd;
+  mb->mapped = (const float *)mapped;
+  mb->mappedBytes = st.st_size;
+  mb->numPoints = st.st_size / rowBytes;
+  mb->dim = dim;
+  mb->k = k;
+  mb->batchSize =
+      (uint64)batchSize < mb->numPoints ? batchSize : (int)mb->numPoints;
+
+  mb->centres = PushArray(arena, (uint64)k * dim, float);
+  mb->counts = PushArray(arena, k, double);
+  mb->packed = PushArray(arena, PackedCentresCount(k, dim), float);
+  mb->norms = PushArray(arena, PackedCentresCount(k, 1), float);
+  mb->assignment = PushArray(arena, mb->batchSize, int);
+  mb->distances = PushArray(arena, mb->batchSize, float);
+  mb->clusterStart = PushArray(arena, k + 1, int);
+  mb->clusterRows = PushArray(arena, mb->batchSize, int);
+  if (!mb->centres || !mb->counts || !mb->packed || !mb->norms ||
+      !mb->assignment || !mb->distances || !mb->clusterStart ||
+      !mb->clusterRows) {
+    CloseMiniBatchKMeans(mb);
+    return 0;
+  }
+
+  // One row from each of k equal strides, so a sorted file still seeds
+  // centres across its whole range
+  pcg32 rng = Pcg32Seed(seed, 0);
+  for (int j = 0; j < k; j++) {
+    uint64 from = (uint64)j * mb->numPoints / k;
+    uint64 to = (uint64)(j + 1) * mb->numPoints / k;
+    uint64 row = from + Pcg32Bounded(&rng, (uint32)(to - from));
+    memcpy(CentreAt(mb, j), RowAt(mb, row), rowBytes);
+    mb->counts[j] = 0;
+  }
+  return 1;
+}
+
+void CloseMiniBatchKMeans(MiniBatchKMeans *mb) {
+  if (mb->mapped) {
+    munmap((void *)mb->mapped, mb->mappedBytes);
+    mb->mapped = 0;
+  }
+  if (mb->fd >= 0) {
+    close(mb->fd);
+    mb->fd = -1;
+  }
+}
+
+typedef struct {
+  MiniBatchKMeans *mb;
+  uint64 first;
+} BatchJob;
+
+// Taking a centre's batch points one at a time with rate 1 / count, as
+// Sculley does, leaves it at the running mean of everything it has absorbed,
+// so each centre takes its batch points in one step. Centres are independent.
+static void RunBatchUpdate(void *data, int start, int end) {
+  BatchJob *job = (BatchJob *)data;
+  MiniBatchKMeans *mb = job->mb;
+  int dim = mb->dim;
+  for (int j = start; j < end; j++) {
+    int from = mb->clusterStart[j], to = mb->clusterStart[j + 1];
+    if (from == to) {
+      continue;
+    }
+    float *centre = CentreAt(mb, j);
+    double before = mb->counts[j];
+    double after = before + (to - from);
+    for (int d = 0; d < dim; d++) {
+      double sum = 0;
+      for (int slot = from; slot < to; slot++) {
+        sum += RowAt(mb, job->first + mb->clusterRows[slot])[d];
+      }
+      centre[d] = (float)((centre[d] * before + sum) / after);
+    }
+    mb->counts[j] = after;
+  }
+}
+
+// Assigns the next batch to the current centres and moves each centre
+// towards its share of it. Writes a checkpoint when one is due. Returns the
+// batch's mean squared distance to the centres it was assigned to.
+double MiniBatchStep(MiniBatchKMeans *mb) {
+  uint64 remaining = mb->numPoints - mb->cursor;
+  int rows = remaining < (uint64)mb->batchSize ? (int)remaining
+                                               : mb->batchSize;
+  BatchJob job = {mb, mb->cursor};
+
+  PackCentres(mb->centres, mb->k, mb->dim, mb->packed, mb->norms);
+  AssignNearestBlocked(RowAt(mb, job.first), rows, mb->dim, mb->packed,
+                       mb->norms, mb->k, mb->assignment, mb->distances);
+
+  // Group the batch by centre, clusterStart[j] as the cursor while filling
+  int k = mb->k;
+  memset(mb->clusterStart, 0, (k + 1) * sizeof(int));
+  double inertia = 0;
+  for (int r = 0; r < rows; r++) {
+    mb->clusterStart[mb->assignment[r] + 1]++;
+    inertia += mb->distances[r];
+  }
+  for (int j = 0; j < k; j++) {
+    mb->clusterStart[j + 1] += mb->clusterStart[j];
+  }
+  for (int r = 0; r < rows; r++) {
+    mb->clusterRows[mb->clusterStart[mb->assignment[r]]++] = r;
+  }
+  for (int j = k; j > 0; j--) {
+    mb->clusterStart[j] = mb->clusterStart[j - 1];
+  }
+  mb->clusterStart[0] = 0;
+
+  ParallelFor(k, MIN_CENTRES_PER_JOB, RunBatchUpdate, &job);
+
+  // The pages of this batch will not be read again until the next pass
+  uint64 page = sysconf(_SC_PAGESIZE);
+  uint64 begin = job.first * mb->dim * sizeof(float) / page * page;
+  uint64 end = (job.first + rows) * mb->dim * sizeof(float) / page * page;
+  if (end > begin) {
+    madvise((uint8_t *)mb->mapped + begin, end - begin, MADV_DONTNEED);
+  }
+
+  mb->cursor += rows;
+  if (mb->cursor >= mb->numPoints) {
+    mb->cursor = 0;
+  }
+  mb->batches++;
+  mb->inertia = rows > 0 ? inertia / rows : 0;
+
+  if (mb->checkpointPath && mb->checkpointEvery > 0 &&
+      mb->batches % mb->checkpointEvery == 0) {
+    SaveMiniBatchCheckpoint(mb, mb->checkpointPath);
+  }
+  return mb->inertia;
+}
+
+// Writes the centres, their counts and the stream position. The file is
+// written next to path and renamed over it, so a crash mid-write leaves the
+// previous checkpoint intact.
+bool32 SaveMiniBatchCheckpoint(const MiniBatchKMeans *mb, const char *path) {
+  char temporary[1024];
+  if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) >=
+      (int)sizeof(temporary)) {
+    return 0;
+  }
+  FILE *file = fopen(temporary, "wb");
+  if (!file) {
+    return 0;
+  }
+
+  CheckpointHeader header = {CHECKPOINT_MAGIC, CHECKPOINT_VERSION, mb->k,
+                             mb->dim, mb->batches, mb->cursor};
+  uint64 numCentres = (uint64)mb->k * mb->dim;
+  bool32 written =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(mb->centres, sizeof(float), numCentres, file) == numCentres &&
+      fwrite(mb->counts, sizeof(double), mb->k, file) == (uint64)mb->k;
+  written = (fclose(file) == 0) && written;
+  if (!written || rename(temporary, path) != 0) {
+    remove(temporary);
+    return 0;
+  }
+  return 1;
+}
+
+// Resumes from a checkpoint made with the same k and dim. Leaves the state
+// untouched and returns 0 if the file does not match.
+bool32 LoadMiniBatchCheckpoint(MiniBatchKMeans *mb, const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return 0;
+  }
+
+  CheckpointHeader header;
+  bool32 loaded = fread(&header, sizeof(header), 1, file) == 1 &&
+                  header.magic == CHECKPOINT_MAGIC &&
+                  header.version == CHECKPOINT_VERSION &&
+                  header.k == mb->k && header.dim == mb->dim &&
+                  header.cursor < mb->numPoints;
+  if (loaded) {
+    // Check the length first so a truncated file leaves the centres alone
+    uint64 numCentres = (uint64)mb->k * mb->dim;
+    long payload = (long)(numCentres * sizeof(float) + mb->k * sizeof(double));
+    long start = ftell(file);
+    loaded = fseek(file, 0, SEEK_END) == 0 && ftell(file) - start == payload &&
+             fseek(file, start, SEEK_SET) == 0 &&
+             fread(mb->centres, sizeof(float), numCentres, file) ==
+                 numCentres &&
+             fread(mb->counts, sizeof(double), mb->k, file) == (uint64)mb->k;
+  }
+  fclose(file);
+
+  if (loaded) {
+    mb->batches = header.batches;
+    mb->cursor = header.cursor;
+  }
+  return loaded;
+}
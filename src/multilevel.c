@@ -0,0 +1,175 @@
+#include <math.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+#define MULTILEVEL_BRANCHING 4
+#define MAX_LEVELS 16
+
+// Stream for the prolongation jitter, InitialiseSites uses the ones below
+#define PROLONG_STREAM 2
+
+void LloydIterationHalfPlane(struct app_state *AppState) {
+  LloydRelaxationIncremental(AppState, &AppState->incremental, DIRTY_EPSILON);
+}
+
+void LloydIterationSweep(struct app_state *AppState) {
+  LloydRelaxationFortuneIncremental(AppState, &AppState->incremental,
+                                    DIRTY_EPSILON);
+}
+
+// Where a child of parent lands: jittered within the fine-level spacing and
+// kept in the box
+static Vector2 ChildPosition(Vector2 parent, float jitter, Rectangle box,
+                             pcg32 *rng) {
+  float angle = Pcg32Range(rng, 0.0f, 2.0f * Pi32);
+  float radius = jitter * Pcg32Range(rng, 0.5f, 1.0f);
+  Vector2 offset = {cosf(angle) * radius, sinf(angle) * radius};
+  return Vector2Clamp(Vector2Add(parent, offset), (Vector2){box.x, box.y},
+                      (Vector2){box.x + box.width, box.y + box.height});
+}
+
+// Grows the site set from numCoarse to numFine. Every coarse site keeps its
+// place and spawns children jittered within the fine-level spacing, so the
+// coarse relaxation carries over as the low-frequency part of the fine one.
+static void ProlongSites(struct app_state *AppState, int numCoarse,
+                         int numFine, Rectangle box, pcg32 *rng) {
+  float jitter = 0.5f * sqrtf(box.width * box.height / numFine);
+  int count = numCoarse;
+  for (int round = 0; count < numFine; round++) {
+    for (int parent = 0; parent < numCoarse && count < numFine; parent++) {
+      Vertex *p = &AppState->vertices[parent];
+      Vertex *child = &AppState->vertices[count++];
+      child->position = ChildPosition(p->position, jitter, box, rng);
+      child->velocity = (Vector2){0};
+      child->centroid = child->position;
+      child->color = p->color;
+    }
+  }
+
+  AppState->num_vertices = numFine;
+}
+
+static void ProlongPoints(Vector2 *points, int numCoarse, int numFine,
+                          Rectangle box, pcg32 *rng) {
+  float jitter = 0.5f * sqrtf(box.width * box.height / numFine);
+  int count = numCoarse;
+  while (count < numFine) {
+    for (int parent = 0; parent < numCoarse && count < numFine; parent++) {
+      points[count++] = ChildPosition(points[parent], jitter, box, rng);
+    }
+  }
+}
+
+// Site counts from the finest level down, each MULTILEVEL_BRANCHING times
+// smaller, stopping before one would drop below coarsestSites
+static int LevelSchedule(int targetSites, int coarsestSites, int *levels) {
+  if (coarsestSites < 3) {
+    coarsestSites = 3;
+  }
+  int numLevels = 0;
+  for (int n = targetSites; numLevels < MAX_LEVELS; n /= MULTILEVEL_BRANCHING) {
+    levels[numLevels++] = n;
+    if (n / MULTILEVEL_BRANCHING < coarsestSites) {
+      break;
+    }
+  }
+  return numLevels;
+}
+
+// Most sites an iteration handles without dropping part of the diagram
+static int IterationCapacity(LloydIteration *iterate) {
+  return iterate == LloydIterationSweep ? MAX_SWEEP_SITES : MAX_SITES;
+}
+
+// Coarse-to-fine Lloyd. Relaxes a small site set first, then repeatedly
+// prolongs it by MULTILEVEL_BRANCHING and runs only a few iterations of the
+// regular step on each finer level. Low-frequency error is removed cheaply on
+// the coarse levels, where a single iteration moves sites across the domain.
+// The target is clamped to what iterate can handle; returns the site count
+// actually relaxed.
+int MultilevelLloyd(struct app_state *AppState, int targetSites,
+                    int coarsestSites, int iterationsPerLevel,
+                    LloydIteration *iterate, uint64 seed) {
+  Rectangle box = {0, 0, GetScreenWidth(), GetScreenHeight()};
+
+  int capacity = IterationCapacity(iterate);
+  if (targetSites > capacity) {
+    targetSites = capacity;
+  }
+  if (targetSites < 1) {
+    return 0;
+  }
+
+  int levels[MAX_LEVELS];
+  int numLevels = LevelSchedule(targetSites, coarsestSites, levels);
+
+  // Full Lloyd steps, a clamped step would undo the point of the coarse levels
+  float maxStep = AppState->incremental.maxStep;
+  AppState->incremental.maxStep = 0;
+
+  // Jittered start, colours and prolongation all follow from the seed
+  InitialiseSites(AppState, levels[numLevels - 1], box, JitteredSites, seed);
+  pcg32 rng = Pcg32Seed(seed, PROLONG_STREAM);
+
+  for (int level = numLevels - 1; level >= 0; level--) {
+    if (AppState->num_vertices < levels[level]) {
+      ProlongSites(AppState, AppState->num_vertices, levels[level], box,
+                   &rng);
+    }
+
+    // Site count changed, so every cached cell is stale
+    InvalidateIncrementalState(&AppState->incremental);
+    AppState->triangulation.valid = 0;
+
+    for (int it = 0; it < iterationsPerLevel; it++) {
+      iterate(AppState);
+    }
+  }
+
+  AppState->incremental.maxStep = maxStep;
+  return AppState->num_vertices;
+}
+
+// The same schedule on a caller's array instead of the app's fixed one, for
+// site counts far past MAX_SITES. sites needs room for targetSites. Each
+// level runs the grid-based step of RelaxSiteSetParallel with a workspace
+// taken from the arena and given back afterwards. Returns the site count
+// relaxed, 0 if the workspace does not fit.
+int MultilevelRelaxSites(Vector2 *sites, int targetSites, Rectangle box,
+                         int coarsestSites, int iterationsPerLevel,
+                         memory_arena *arena, uint64 seed) {
+  uint64 used = arena->used;
+  LloydWorkspace ws;
+  if (targetSites < 1 || !InitLloydWorkspace(&ws, arena, targetSites)) {
+    arena->used = used;
+    return 0;
+  }
+
+  int levels[MAX_LEVELS];
+  int numLevels = LevelSchedule(targetSites, coarsestSites, levels);
+
+  pcg32 rng = Pcg32Seed(seed, PROLONG_STREAM);
+  int count = levels[numLevels - 1];
+  for (int i = 0; i < count; i++) {
+    sites[i] = (Vector2){Pcg32Range(&rng, box.x, box.x + box.width),
+                         Pcg32Range(&rng, box.y, box.y + box.height)};
+  }
+
+  for (int level = numLevels - 1; level >= 0; level--) {
+    if (count < levels[level]) {
+      ProlongPoints(sites, count, levels[level], box, &rng);
+      count = levels[level];
+    }
+    EnsembleSet set = {.sites = sites,
+                       .numSites = count,
+                       .box = box,
+                       .iterations = iterationsPerLevel};
+    RelaxSiteSetParallel(&ws, &set, 0);
+  }
+
+  arena->used = used;
+  return count;
+}
@@ -0,0 +1,377 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+#define MAX_LINE_SEARCH_STEPS 16
+#define MAX_CG_ITERATIONS 500
+#define POWER_SITES_PER_CELL 2.0f
+
+bool32 InitPowerDiagram(PowerDiagram *pd, memory_arena *arena, int numSites,
+                        Rectangle box) {
+  memset(pd, 0, sizeof(*pd));
+  pd->numSites = numSites;
+  pd->box = box;
+
+  pd->weights = PushArray(arena, numSites, float);
+  pd->targets = PushArray(arena, numSites, float);
+  pd->areas = PushArray(arena, numSites, double);
+  pd->centroids = PushArray(arena, numSites, Vector2);
+  pd->numNeighbours = PushArray(arena, numSites, int);
+  pd->neighbours = PushArray(arena, numSites * MAX_CELL_NEIGHBOURS, int);
+  pd->coupling = PushArray(arena, numSites * MAX_CELL_NEIGHBOURS, double);
+  pd->positions = PushArray(arena, numSites, Vector2);
+  pd->trialWeights = PushArray(arena, numSites, float);
+  pd->residual = PushArray(arena, numSites, double);
+  pd->direction = PushArray(arena, numSites, double);
+  pd->product = PushArray(arena, numSites, double);
+  pd->step = PushArray(arena, numSites, double);
+  if (!pd->weights || !pd->targets || !pd->areas || !pd->centroids ||
+      !pd->numNeighbours || !pd->neighbours || !pd->coupling ||
+      !pd->positions || !pd->trialWeights || !pd->residual ||
+      !pd->direction || !pd->product || !pd->step ||
+      !InitSiteGrid(&pd->grid, arena, numSites, POWER_SITES_PER_CELL)) {
+    return 0;
+  }
+
+  // Equal capacities by default
+  float share = box.width * box.height / numSites;
+  for (int i = 0; i < numSites; i++) {
+    pd->weights[i] = 0;
+    pd->targets[i] = share;
+  }
+  return 1;
+}
+
+typedef struct {
+  PowerDiagram *pd;
+  Vertex *vertices;
+  const float *weights;
+  Cell *cells;
+  float maxWeight;
+} PowerCellJob;
+
+typedef struct {
+  const PowerCellJob *job;
+  int i;
+  Cell *cell;
+  int *edgeSites;
+  int count;
+} PowerClip;
+
+static void ClipAgainstPowerSlot(void *data, int k) {
+  PowerClip *clip = (PowerClip *)data;
+  const SiteGrid *grid = &clip->job->pd->grid;
+  int i = clip->i;
+  int j = grid->sortedSite[k];
+  if (j == i || clip->count == 0) {
+    return;
+  }
+  // Keep the side where the power distance to i is smaller:
+  // dot(x - mid, q - p) <= (w_i - w_j) / 2
+  const float *weights = clip->job->weights;
+  Vector2 p = clip->job->vertices[i].position;
+  Vector2 q = {grid->sortedX[k], grid->sortedY[k]};
+  Vector2 normal = Vector2Subtract(q, p);
+  float offset = Vector2DotProduct(normal, Midpoint(p, q)) +
+                 0.5f * (weights[i] - weights[j]);
+  Cell *cell = clip->cell;
+  int outSites[MAX_CLIP_VERTICES];
+  clip->count =
+      ClipHalfPlane(normal, offset, j, cell->vertices, clip->edgeSites,
+                    clip->count, cell->temp_vertices, outSites);
+  memcpy(cell->vertices, cell->temp_vertices, clip->count * sizeof(Vector2));
+  memcpy(clip->edgeSites, outSites, clip->count * sizeof(int));
+}
+
+// Power cell of site i, clipped from the box by the sites in growing rings
+// of grid cells. Once every unvisited site is at least D away and the cell
+// lies within rho of p_i, such a site j could only cut it if
+// (D - rho)^2 - w_j < rho^2 - w_i, so the rings stop when
+// D >= rho + sqrt(rho^2 + w_max - w_i). The cost per cell then depends on
+// the weight spread rather than on N.
+static int ClipPowerCellFromGrid(const PowerCellJob *job, int i,
+                                 int *edgeSites) {
+  const SiteGrid *grid = &job->pd->grid;
+  Rectangle box = job->pd->box;
+  Cell *cell = &job->cells[i];
+  cell->vertices[0] = (Vector2){box.x, box.y};
+  cell->vertices[1] = (Vector2){box.x + box.width, box.y};
+  cell->vertices[2] = (Vector2){box.x + box.width, box.y + box.height};
+  cell->vertices[3] = (Vector2){box.x, box.y + box.height};
+  edgeSites[0] = edgeSites[1] = edgeSites[2] = edgeSites[3] = -1;
+
+  PowerClip clip = {job, i, cell, edgeSites, 4};
+  Vector2 p = job->vertices[i].position;
+  float slack = job->maxWeight - job->weights[i];
+  int cx, cy;
+  SiteGridCoords(grid, p, &cx, &cy);
+  for (int r = 0; clip.count > 0; r++) {
+    if (!VisitSiteGridRing(grid, cx, cy, r, ClipAgainstPowerSlot, &clip)) {
+      break;
+    }
+    float rho = 0;
+    for (int k = 0; k < clip.count; k++) {
+      rho = fmaxf(rho, Vector2Distance(cell->vertices[k], p));
+    }
+    float reach = rho + sqrtf(fmaxf(0.0f, rho * rho + slack));
+    if (r * grid->cellSize >= reach) {
+      break;
+    }
+  }
+  cell->num_vertices = clip.count;
+  cell->temp_vertex_count = 0;
+  return clip.count;
+}
+
+static void RunPowerCells(void *data, int start, int end) {
+  PowerCellJob *job = (PowerCellJob *)data;
+  PowerDiagram *pd = job->pd;
+  int edgeSites[MAX_CLIP_VERTICES];
+
+  for (int i = start; i < end; i++) {
+    Cell *cell = &job->cells[i];
+    int count = ClipPowerCellFromGrid(job, i, edgeSites);
+
+    double area = 0;
+    for (int k = 0; k < count; k++) {
+      Vector2 a = cell->vertices[k];
+      Vector2 b = cell->vertices[(k + 1) % count];
+      area += 0.5 * ((double)a.x * b.y - (double)b.x * a.y);
+    }
+    pd->areas[i] = count >= 3 ? fabs(area) : 0;
+    pd->centroids[i] = count >= 3
+                           ? ComputeTrueCentroid(cell->vertices, count)
+                           : job->vertices[i].position;
+
+    // Moving the shared edge with site j by dw / (2 |p_i - p_j|) trades area
+    // between the two cells at the rate of the edge length
+    int *neighbours = &pd->neighbours[i * MAX_CELL_NEIGHBOURS];
+    double *coupling = &pd->coupling[i * MAX_CELL_NEIGHBOURS];
+    int numNeighbours = 0;
+    for (int k = 0; k < count && numNeighbours < MAX_CELL_NEIGHBOURS; k++) {
+      int j = edgeSites[k];
+      if (j < 0) {
+        continue;
+      }
+      float length =
+          Vector2Distance(cell->vertices[k], cell->vertices[(k + 1) % count]);
+      float distance =
+          Vector2Distance(job->vertices[i].position, job->vertices[j].position);
+      if (length <= 0 || distance <= 0) {
+        continue;
+      }
+      neighbours[numNeighbours] = j;
+      coupling[numNeighbours++] = length / (2.0 * distance);
+    }
+    pd->numNeighbours[i] = numNeighbours;
+  }
+}
+
+static void ComputeCells(PowerDiagram *pd, Vertex *vertices,
+                         const float *weights, Cell *cells) {
+  // The grid spans the box and any site outside it, so the distance bound
+  // of the ring search holds for every site
+  Rectangle box = pd->box;
+  Vector2 lo = {box.x, box.y};
+  Vector2 hi = {box.x + box.width, box.y + box.height};
+  float maxWeight = -FLT_MAX;
+  for (int i = 0; i < pd->numSites; i++) {
+    pd->positions[i] = vertices[i].position;
+    lo = Vector2Min(lo, pd->positions[i]);
+    hi = Vector2Max(hi, pd->positions[i]);
+    maxWeight = fmaxf(maxWeight, weights[i]);
+  }
+  BuildSiteGrid(&pd->grid, pd->positions, pd->numSites,
+                (Rectangle){lo.x, lo.y, hi.x - lo.x, hi.y - lo.y});
+
+  PowerCellJob job = {pd, vertices, weights, cells, maxWeight};
+  ParallelFor(pd->numSites, 16, RunPowerCells, &job);
+}
+
+// Recomputes every power cell with the current weights, together with the
+// areas, centroids and the Hessian couplings of the Newton solve
+void ComputePowerDiagram(PowerDiagram *pd, Vertex *vertices, Cell *cells) {
+  ComputeCells(pd, vertices, pd->weights, cells);
+}
+
+// Hessian of the cell areas with respect to the weights. It is a graph
+// Laplacian over the dual triangulation: dA_i/dw_j = -coupling_ij and
+// dA_i/dw_i = sum_j coupling_ij. Both cells of an edge measure it, and they
+// can disagree on tiny edges, so each side contributes half to keep the
+// matrix exactly symmetric, which conjugate gradients relies on.
+static void MultiplyHessian(const PowerDiagram *pd, const double *x,
+                            double *out) {
+  for (int i = 0; i < pd->numSites; i++) {
+    // A tiny diagonal shift keeps the solve defined for isolated cells
+    out[i] = 1e-9 * x[i];
+  }
+  for (int i = 0; i < pd->numSites; i++) {
+    const int *neighbours = &pd->neighbours[i * MAX_CELL_NEIGHBOURS];
+    const double *coupling = &pd->coupling[i * MAX_CELL_NEIGHBOURS];
+    for (int k = 0; k < pd->numNeighbours[i]; k++) {
+      int j = neighbours[k];
+      double flow = 0.5 * coupling[k] * (x[i] - x[j]);
+      out[i] += flow;
+      out[j] -= flow;
+    }
+  }
+}
+
+static double Dot(const double *a, const double *b, int n) {
+  double sum = 0;
+  for (int i = 0; i < n; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+static void RemoveMean(double *x, int n) {
+  double mean = 0;
+  for (int i = 0; i < n; i++) {
+    mean += x[i];
+  }
+  mean /= n;
+  for (int i = 0; i < n; i++) {
+    x[i] -= mean;
+  }
+}
+
+// Conjugate gradients for H step = residual, consuming the residual. Weights
+// are only defined up to a constant, so everything stays in the zero-mean
+// subspace where the Laplacian is positive definite.
+static void SolveNewtonStep(PowerDiagram *pd) {
+  int n = pd->numSites;
+  double *x = pd->step;
+  double *r = pd->residual;
+  double *d = pd->direction;
+  double *q = pd->product;
+
+  memset(x, 0, n * sizeof(double));
+  RemoveMean(r, n);
+  memcpy(d, r, n * sizeof(double));
+
+  double rr = Dot(r, r, n);
+  double stop = 1e-12 * rr;
+  for (int it = 0; it < MAX_CG_ITERATIONS && rr > stop; it++) {
+    MultiplyHessian(pd, d, q);
+    double dq = Dot(d, q, n);
+    if (dq <= 0) {
+      break;
+    }
+    double alpha = rr / dq;
+    for (int i = 0; i < n; i++) {
+      x[i] += alpha * d[i];
+      r[i] -= alpha * q[i];
+    }
+    double next = Dot(r, r, n);
+    for (int i = 0; i < n; i++) {
+      d[i] = r[i] + (next / rr) * d[i];
+    }
+    rr = next;
+  }
+  RemoveMean(x, n);
+}
+
+static double AreaError(const PowerDiagram *pd, double *minArea) {
+  double error = 0;
+  *minArea = FLT_MAX;
+  for (int i = 0; i < pd->numSites; i++) {
+    double e = pd->targets[i] - pd->areas[i];
+    error += e * e;
+    if (pd->areas[i] < *minArea) {
+      *minArea = pd->areas[i];
+    }
+  }
+  return sqrt(error);
+}
+
+// Damped Newton on the weights until every cell is within tolerance (as a
+// fraction of its target) of its capacity. Steps are halved until all cells
+// stay non-empty and the error drops, which keeps the Hessian well posed and
+// gives quadratic convergence near the solution. Targets should add up to the
+// box area. Returns the number of Newton steps taken.
+int SolvePowerWeights(PowerDiagram *pd, Vertex *vertices, Cell *cells,
+                      int maxIterations, float tolerance) {
+  int n = pd->numSites;
+  ComputePowerDiagram(pd, vertices, cells);
+
+  // Warm-start weights can leave a cell empty once the sites have moved,
+  // which Newton cannot recover from; zero weights give every site a cell
+  for (int i = 0; i < n; i++) {
+    if (pd->areas[i] <= 0) {
+      memset(pd->weights, 0, n * sizeof(float));
+      ComputePowerDiagram(pd, vertices, cells);
+      break;
+    }
+  }
+
+  int it = 0;
+  for (; it < maxIterations; it++) {
+    double minArea;
+    double error = AreaError(pd, &minArea);
+
+    bool32 converged = 1;
+    for (int i = 0; i < n && converged; i++) {
+      converged = fabs(pd->targets[i] - pd->areas[i]) <=
+                  tolerance * pd->targets[i];
+    }
+    if (converged) {
+      break;
+    }
+
+    for (int i = 0; i < n; i++) {
+      pd->residual[i] = pd->targets[i] - pd->areas[i];
+    }
+    SolveNewtonStep(pd);
+
+    double floorArea = 0.5 * minArea;
+    float alpha = 1.0f;
+    bool32 accepted = 0;
+    for (int s = 0; s < MAX_LINE_SEARCH_STEPS; s++, alpha *= 0.5f) {
+      for (int i = 0; i < n; i++) {
+        pd->trialWeights[i] = pd->weights[i] + alpha * (float)pd->step[i];
+      }
+      ComputeCells(pd, vertices, pd->trialWeights, cells);
+
+      double trialMin;
+      double trialError = AreaError(pd, &trialMin);
+      if (trialMin > floorArea && trialError <= (1 - 0.5 * alpha) * error) {
+        accepted = 1;
+        break;
+      }
+    }
+
+    if (!accepted) {
+      // Leave the diagram consistent with the weights we keep
+      ComputePowerDiagram(pd, vertices, cells);
+      break;
+    }
+    memcpy(pd->weights, pd->trialWeights, n * sizeof(float));
+  }
+
+  pd->newtonIterations = it;
+  return it;
+}
+
+// Capacity-constrained Lloyd: each round solves for the weights that give
+// every cell its capacity, then moves the sites to the centroids of their
+// power cells. Weights carry over between rounds as the next warm start, so
+// later solves only need a Newton step or two.
+void CapacityConstrainedLloyd(struct app_state *AppState, PowerDiagram *pd,
+                              int iterations, float tolerance) {
+  for (int it = 0; it < iterations; it++) {
+    SolvePowerWeights(pd, AppState->vertices, AppState->cells, 20, tolerance);
+    for (int i = 0; i < pd->numSites; i++) {
+      Vertex *v = &AppState->vertices[i];
+      if (pd->areas[i] > 0) {
+        v->centroid = pd->centroids[i];
+        v->position = pd->centroids[i];
+      }
+    }
+  }
+  ComputePowerDiagram(pd, AppState->vertices, AppState->cells);
+}
@@ -0,0 +1,565 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+
+#include "gui.h"
+
+#define MIN_PIXELS_PER_JOB 16384
+#define QUANTISE_ITERATIONS 20
+// Past this many distinct colours, k-means runs on the means of bins of
+// BIN_BITS a channel instead, which bounds its cost for noisy photographs
+#define QUANTISE_MAX_COLOURS 32768
+#define BIN_BITS 5
+#define NUM_BINS (1 << (3 * BIN_BITS))
+#define GRID_SIDE (1 << PALETTE_GRID_BITS)
+#define GRID_CELLS (GRID_SIDE * GRID_SIDE * GRID_SIDE)
+#define CELL_SIDE (256 / GRID_SIDE)
+// The lookup grid is built from cubes of this side, one job each
+#define GRID_TASK_SIDE 64
+#define GRID_DEPTHS 8
+// Unused group lanes, farther from every colour than any real entry
+#define FAR_CHANNEL 4096.0f
+
+// Pixels are partitioned by hash into buckets of about BUCKET_ENTRIES runs,
+// each counted in a table small enough to live on the stack and in cache
+#define MAX_CHUNKS 64
+#define BUCKET_ENTRIES 2048
+#define MAX_BUCKET_BITS 14
+// Buckets past this many runs, from an unlucky hash, get a table in the arena
+#define STACK_ENTRIES (2 * BUCKET_ENTRIES)
+#define STACK_SLOTS (2 * STACK_ENTRIES + 1)
+
+typedef struct {
+  uint32 key; // colour + 1, 0 for an empty slot
+  uint32 count;
+} ColourSlot;
+
+typedef struct {
+  const Color *pixels;
+  int count;
+  int numChunks;
+  int chunkPixels;
+  int bucketBits;
+  int numBuckets;
+  int *chunkStart; // chunk x bucket, where the chunk's runs go
+  int *bucketStart;
+  int *bucketUnique;
+  uint64 *overflowStart; // table offsets of the oversized buckets
+  ColourSlot *overflow;
+  uint32 *keys; // runs of one colour grouped by bucket, then compacted
+  uint32 *runs;
+  uint32 *colours;
+  float *weights;
+} HistogramJob;
+
+static inline uint32 ColourKey(Color c) {
+  return (uint32)c.r << 16 | (uint32)c.g << 8 | c.b;
+}
+
+// Fibonacci hashing; the top bits pick the bucket, the 32 below them the
+// slot in the bucket's table
+static inline uint64 ColourHash(uint32 key) {
+  return key * 0x9e3779b97f4a7c15ull;
+}
+
+static inline int BucketOf(const HistogramJob *job, uint32 key) {
+  return job->bucketBits ? (int)(ColourHash(key) >> (64 - job->bucketBits))
+                         : 0;
+}
+
+// Runs of one colour, common in flat regions, go in as one entry
+static void RunCountBuckets(void *data, int start, int end) {
+  HistogramJob *job = (HistogramJob *)data;
+  for (int chunk = start; chunk < end; chunk++) {
+    int *counts = &job->chunkStart[(uint64)chunk * job->numBuckets];
+    memset(counts, 0, job->numBuckets * sizeof(int));
+    int from = chunk * job->chunkPixels;
+    int to = from + job->chunkPixels < job->count ? from + job->chunkPixels
+                                                  : job->count;
+    for (int i = from; i < to; i++) {
+      uint32 key = ColourKey(job->pixels[i]);
+      if (i == from || key != ColourKey(job->pixels[i - 1])) {
+        counts[BucketOf(job, key)]++;
+      }
+    }
+  }
+}
+
+static void RunScatterBuckets(void *data, int start, int end) {
+  HistogramJob *job = (HistogramJob *)data;
+  for (int chunk = start; chunk < end; chunk++) {
+    int *next = &job->chunkStart[(uint64)chunk * job->numBuckets];
+    int from = chunk * job->chunkPixels;
+    int to = from + job->chunkPixels < job->count ? from + job->chunkPixels
+                                                  : job->count;
+    for (int i = from; i < to;) {
+      uint32 key = ColourKey(job->pixels[i]);
+      int run = i;
+      while (run < to && ColourKey(job->pixels[run]) == key) {
+        run++;
+      }
+      int slot = next[BucketOf(job, key)]++;
+      job->keys[slot] = key;
+      job->runs[slot] = run - i;
+      i = run;
+    }
+  }
+}
+
+// Counts one bucket in its own table and compacts it over its stretch of
+// keys, the counts going into runs
+static void RunCountColours(void *data, int start, int end) {
+  HistogramJob *job = (HistogramJob *)data;
+  ColourSlot stackTable[STACK_SLOTS];
+  for (int bucket = start; bucket < end; bucket++) {
+    int from = job->bucketStart[bucket], to = job->bucketStart[bucket + 1];
+    uint32 size = 2 * (to - from) + 1;
+    ColourSlot *table = to - from <= STACK_ENTRIES
+                            ? stackTable
+                            : &job->overflow[job->overflowStart[bucket]];
+    memset(table, 0, size * sizeof(ColourSlot));
+    for (int i = from; i < to; i++) {
+      uint32 key = job->keys[i];
+      uint32 slot = (uint32)(((ColourHash(key) >> (32 - job->bucketBits) &
+                               0xffffffffu) *
+                              size) >>
+                             32);
+      while (table[slot].key != 0 && table[slot].key != key + 1) {
+        slot = slot + 1 < size ? slot + 1 : 0;
+      }
+      table[slot].key = key + 1;
+      table[slot].count += job->runs[i];
+    }
+    int unique = 0;
+    for (uint32 slot = 0; slot < size; slot++) {
+      if (table[slot].key != 0) {
+        job->keys[from + unique] = table[slot].key - 1;
+        job->runs[from + unique++] = table[slot].count;
+      }
+    }
+    job->bucketUnique[bucket + 1] = unique;
+  }
+}
+
+static void RunGatherColours(void *data, int start, int end) {
+  HistogramJob *job = (HistogramJob *)data;
+  for (int bucket = start; bucket < end; bucket++) {
+    int from = job->bucketStart[bucket];
+    int to = job->bucketUnique[bucket];
+    int unique = job->bucketUnique[bucket + 1] - to;
+    memcpy(&job->colours[to], &job->keys[from], unique * sizeof(uint32));
+    for (int c = 0; c < unique; c++) {
+      job->weights[to + c] = (float)job->runs[from + c];
+    }
+  }
+}
+
+// Counts the pixels of each distinct RGB colour, alpha ignored. Pixels are
+// first partitioned by hash into buckets, chunk by chunk, then every bucket
+// is hashed on its own thread without locks or atomics. The partition is
+// stable, so the colours come out in the same order on every run. Returns 0
+// if the arena is too small.
+bool32 BuildColourHistogram(ColourHistogram *histogram, memory_arena *arena,
+                            const Color *pixels, int count) {
+  memset(histogram, 0, sizeof(*histogram));
+  // Room for every pixel a distinct colour, below the scratch
+  uint32 *colours = PushArray(arena, count, uint32);
+  float *weights = PushArray(arena, count, float);
+  uint64 used = arena->used;
+  HistogramJob *job = PushStruct(arena, HistogramJob);
+  if (!colours || !weights || !job) {
+    return 0;
+  }
+  memset(job, 0, sizeof(*job));
+  job->pixels = pixels;
+  job->count = count;
+  job->numChunks = (count + MIN_PIXELS_PER_JOB - 1) / MIN_PIXELS_PER_JOB;
+  job->numChunks = job->numChunks < MAX_CHUNKS ? job->numChunks : MAX_CHUNKS;
+  job->numChunks = job->numChunks > 0 ? job->numChunks : 1;
+  job->chunkPixels = (count + job->numChunks - 1) / job->numChunks;
+  while (job->bucketBits < MAX_BUCKET_BITS &&
+         (count >> job->bucketBits) > BUCKET_ENTRIES) {
+    job->bucketBits++;
+  }
+  job->numBuckets = 1 << job->bucketBits;
+  job->chunkStart =
+      PushArray(arena, (uint64)job->numChunks * job->numBuckets, int);
+  job->bucketStart = PushArray(arena, job->numBuckets + 1, int);
+  job->bucketUnique = PushArray(arena, job->numBuckets + 1, int);
+  job->overflowStart = PushArray(arena, job->numBuckets, uint64);
+  job->keys = PushArray(arena, count, uint32);
+  job->runs = PushArray(arena, count, uint32);
+  if (!job->chunkStart || !job->bucketStart || !job->bucketUnique ||
+      !job->overflowStart || !job->keys || !job->runs) {
+    arena->used = used;
+    return 0;
+  }
+
+  ParallelFor(job->numChunks, 1, RunCountBuckets, job);
+  int next = 0;
+  uint64 overflow = 0;
+  for (int bucket = 0; bucket < job->numBuckets; bucket++) {
+    job->bucketStart[bucket] = next;
+    for (int chunk = 0; chunk < job->numChunks; chunk++) {
+      int *start = &job->chunkStart[(uint64)chunk * job->numBuckets + bucket];
+      int size = *start;
+      *start = next;
+      next += size;
+    }
+    int entries = next - job->bucketStart[bucket];
+    job->overflowStart[bucket] = overflow;
+    overflow += entries > STACK_ENTRIES ? 2 * (uint64)entries + 1 : 0;
+  }
+  job->bucketStart[job->numBuckets] = next;
+  job->overflow = PushArray(arena, overflow, ColourSlot);
+  if (overflow > 0 && !job->overflow) {
+    arena->used = used;
+    return 0;
+  }
+  ParallelFor(job->numChunks, 1, RunScatterBuckets, job);
+  ParallelFor(job->numBuckets, 1, RunCountColours, job);
+
+  job->bucketUnique[0] = 0;
+  for (int bucket = 0; bucket < job->numBuckets; bucket++) {
+    job->bucketUnique[bucket + 1] += job->bucketUnique[bucket];
+  }
+  job->colours = colours;
+  job->weights = weights;
+  ParallelFor(job->numBuckets, 1, RunGatherColours, job);
+  histogram->colours = colours;
+  histogram->weights = weights;
+  histogram->count = job->bucketUnique[job->numBuckets];
+  arena->used = used;
+  return 1;
+}
+
+// Merges the colours into bins, each at the weighted mean of its colours.
+// Returns the number of bins used.
+static int BinColours(const ColourHistogram *histogram, double *bins,
+                      float *points, float *weights) {
+  memset(bins, 0, NUM_BINS * 4 * sizeof(double));
+  int drop = 8 - BIN_BITS;
+  for (int i = 0; i < histogram->count; i++) {
+    uint32 c = histogram->colours[i];
+    uint32 r = c >> 16, g = c >> 8 & 255, b = c & 255;
+    double *bin = &bins[4 * ((r >> drop << BIN_BITS | g >> drop)
+                                 << BIN_BITS |
+                             b >> drop)];
+    double w = histogram->weights[i];
+    bin[0] += w * r;
+    bin[1] += w * g;
+    bin[2] += w * b;
+    bin[3] += w;
+  }
+  int count = 0;
+  for (int i = 0; i < NUM_BINS; i++) {
+    const double *bin = &bins[4 * i];
+    if (bin[3] > 0) {
+      for (int d = 0; d < 3; d++) {
+        points[3 * count + d] = (float)(bin[d] / bin[3]);
+      }
+      weights[count++] = (float)bin[3];
+    }
+  }
+  return count;
+}
+
+// Weighted k-means over the histogram's colours, seeded with k-means||, so
+// the cost follows the distinct colours rather than the pixels. Returns the
+// palette size, fewer than k when the image has fewer colours, or 0 if the
+// arena is too small.
+int BuildPalette(Color *palette, memory_arena *arena,
+                 const ColourHistogram *histogram, int k, uint64 seed) {
+  k = k < MAX_PALETTE ? k : MAX_PALETTE;
+  int count = histogram->count;
+  if (count <= k) {
+    for (int j = 0; j < count; j++) {
+      uint32 c = histogram->colours[j];
+      palette[j] = (Color){c >> 16, c >> 8 & 255, c & 255, 255};
+    }
+    return count;
+  }
+
+  uint64 used = arena->used;
+  KMeans km;
+  bool32 binned = count > QUANTISE_MAX_COLOURS;
+  int numPoints = binned ? QUANTISE_MAX_COLOURS : count;
+  float *points = PushArray(arena, (uint64)numPoints * 3, float);
+  float *weights = binned ? PushArray(arena, numPoints, float)
+                          : histogram->weights;
+  double *bins = binned ? PushArray(arena, NUM_BINS * 4, double) : 0;
+  if (!points || !weights || (binned && !bins)) {
+    arena->used = used;
+    return 0;
+  }
+  if (binned) {
+    numPoints = BinColours(histogram, bins, points, weights);
+  } else {
+    for (int i = 0; i < count; i++) {
+      uint32 c = histogram->colours[i];
+      points[3 * i] = (float)(c >> 16);
+      points[3 * i + 1] = (float)(c >> 8 & 255);
+      points[3 * i + 2] = (float)(c & 255);
+    }
+  }
+  k = k < numPoints ? k : numPoints;
+  if (!InitKMeans(&km, arena, points, numPoints, 3, k, 0)) {
+    arena->used = used;
+    return 0;
+  }
+  km.weights = weights;
+  if (!SeedKMeansParallel(&km, arena, seed, 0, 0)) {
+    arena->used = used;
+    return 0;
+  }
+  RunKMeans(&km, QUANTISE_ITERATIONS);
+
+  for (int j = 0; j < k; j++) {
+    unsigned char channel[3];
+    for (int d = 0; d < 3; d++) {
+      channel[d] = (unsigned char)CLAMP(km.centres[3 * j + d] + 0.5f, 0, 255);
+    }
+    palette[j] = (Color){channel[0], channel[1], channel[2], 255};
+  }
+  arena->used = used;
+  return k;
+}
+
+typedef struct {
+  PaletteGrid *grid;
+  bool32 fill; // counting the groups first, then writing them
+} GridJob;
+
+// Keeps the entries that are nearest to some colour in the cube of side
+// side at lo, as in the tree filtering for k-means: an entry farther than
+// the one nearest the cube's centre at the corner furthest towards it is
+// farther everywhere. Ties go to the lower index. All integer, so exact.
+static int PruneEntries(const PaletteGrid *grid, const int lo[3], int side,
+                        const int *z, int nz, int *kept) {
+  // Doubled coordinates keep the cube's centre an integer
+  int best = z[0];
+  int bestGap = 1 << 30;
+  for (int c = 0; c < nz; c++) {
+    Color e = grid->colours[z[c]];
+    int channel[3] = {e.r, e.g, e.b};
+    int gap = 0;
+    for (int d = 0; d < 3; d++) {
+      int delta = 2 * channel[d] - (2 * lo[d] + side - 1);
+      gap += delta * delta;
+    }
+    if (gap < bestGap) {
+      bestGap = gap;
+      best = z[c];
+    }
+  }
+
+  Color b = grid->colours[best];
+  int bestChannel[3] = {b.r, b.g, b.b};
+  int numKept = 0;
+  for (int c = 0; c < nz; c++) {
+    Color e = grid->colours[z[c]];
+    int channel[3] = {e.r, e.g, e.b};
+    int dz = 0, db = 0;
+    for (int d = 0; d < 3; d++) {
+      int v = channel[d] > bestChannel[d] ? lo[d] + side - 1 : lo[d];
+      dz += (channel[d] - v) * (channel[d] - v);
+      db += (bestChannel[d] - v) * (bestChannel[d] - v);
+    }
+    if (z[c] == best || dz < db || (dz == db && z[c] < best)) {
+      kept[numKept++] = z[c];
+    }
+  }
+  return numKept;
+}
+
+static void FillCell(GridJob *job, const int lo[3], const int *z, int nz) {
+  PaletteGrid *grid = job->grid;
+  int cell = (lo[0] / CELL_SIDE * GRID_SIDE + lo[1] / CELL_SIDE) * GRID_SIDE +
+             lo[2] / CELL_SIDE;
+  if (!job->fill) {
+    grid->cellStart[cell + 1] = (nz + 3) / 4;
+    grid->owner[cell] = nz == 1 ? z[0] : -1;
+    return;
+  }
+  PaletteGroup *group = &grid->groups[grid->cellStart[cell]];
+  for (int c = 0; c < (nz + 3) / 4 * 4; c++) {
+    int lane = c % 4;
+    Color e = grid->colours[c < nz ? z[c] : 0];
+    bool32 real = c < nz;
+    group[c / 4].r[lane] = real ? e.r : FAR_CHANNEL;
+    group[c / 4].g[lane] = real ? e.g : FAR_CHANNEL;
+    group[c / 4].b[lane] = real ? e.b : FAR_CHANNEL;
+    group[c / 4].index[lane] = real ? z[c] : 0;
+  }
+}
+
+// Halves the cube until it is one cell, pruning the entries on the way, so
+// most of the grid is settled high up with few entries left
+static void FilterCube(GridJob *job, const int lo[3], int side, const int *z,
+                       int nz, int (*lists)[MAX_PALETTE], int depth) {
+  const int *kept = z;
+  int numKept = nz;
+  if (nz > 1) {
+    numKept = PruneEntries(job->grid, lo, side, z, nz, lists[depth]);
+    kept = lists[depth];
+  }
+  if (side == CELL_SIDE) {
+    FillCell(job, lo, kept, numKept);
+    return;
+  }
+  int half = side / 2;
+  for (int child = 0; child < 8; child++) {
+    int childLo[3] = {lo[0] + (child >> 2 & 1) * half,
+                      lo[1] + (child >> 1 & 1) * half,
+                      lo[2] + (child & 1) * half};
+    FilterCube(job, childLo, half, kept, numKept, lists, depth + 1);
+  }
+}
+
+static void RunFilterCubes(void *data, int start, int end) {
+  GridJob *job = (GridJob *)data;
+  int tasksPerSide = 256 / GRID_TASK_SIDE;
+  int all[MAX_PALETTE];
+  int lists[GRID_DEPTHS][MAX_PALETTE];
+  for (int j = 0; j < job->grid->size; j++) {
+    all[j] = j;
+  }
+  for (int task = start; task < end; task++) {
+    int lo[3] = {task / (tasksPerSide * tasksPerSide) * GRID_TASK_SIDE,
+                 task / tasksPerSide % tasksPerSide * GRID_TASK_SIDE,
+                 task % tasksPerSide * GRID_TASK_SIDE};
+    FilterCube(job, lo, GRID_TASK_SIDE, all, job->grid->size, lists, 0);
+  }
+}
+
+// Returns 0 if the arena is too small
+bool32 BuildPaletteGrid(PaletteGrid *grid, memory_arena *arena,
+                        const Color *palette, int size) {
+  memset(grid, 0, sizeof(*grid));
+  if (size < 1 || size > MAX_PALETTE) {
+    return 0;
+  }
+  grid->size = size;
+  memcpy(grid->colours, palette, size * sizeof(Color));
+  grid->owner = PushArray(arena, GRID_CELLS, int);
+  grid->cellStart = PushArray(arena, GRID_CELLS + 1, int);
+  if (!grid->owner || !grid->cellStart) {
+    return 0;
+  }
+
+  int tasksPerSide = 256 / GRID_TASK_SIDE;
+  int numTasks = tasksPerSide * tasksPerSide * tasksPerSide;
+  GridJob job = {grid, 0};
+  ParallelFor(numTasks, 1, RunFilterCubes, &job);
+  grid->cellStart[0] = 0;
+  for (int cell = 0; cell < GRID_CELLS; cell++) {
+    grid->cellStart[cell + 1] += grid->cellStart[cell];
+  }
+  grid->groups =
+      PushArray(arena, grid->cellStart[GRID_CELLS], PaletteGroup);
+  if (!grid->groups) {
+    return 0;
+  }
+  job.fill = 1;
+  ParallelFor(numTasks, 1, RunFilterCubes, &job);
+  return 1;
+}
+
+typedef struct {
+  const PaletteGrid *grid;
+  Color *pixels;
+  uint8 *indices;
+} RemapJob;
+
+static int NearestEntry(const PaletteGrid *grid, Color c) {
+  int cell = ((c.r / CELL_SIDE) * GRID_SIDE + c.g / CELL_SIDE) * GRID_SIDE +
+             c.b / CELL_SIDE;
+  if (grid->owner[cell] >= 0) {
+    return grid->owner[cell];
+  }
+  float4 r = {c.r, c.r, c.r, c.r};
+  float4 g = {c.g, c.g, c.g, c.g};
+  float4 b = {c.b, c.b, c.b, c.b};
+  float bestGap = INFINITY;
+  int best = 0;
+  for (int i = grid->cellStart[cell]; i < grid->cellStart[cell + 1]; i++) {
+    const PaletteGroup *group = &grid->groups[i];
+    float4 dr = group->r - r;
+    float4 dg = group->g - g;
+    float4 db = group->b - b;
+    float4 gap = dr * dr + dg * dg + db * db;
+    // Entries are listed in index order, so a strict compare keeps the
+    // lower one on a tie
+    for (int lane = 0; lane < 4; lane++) {
+      if (gap[lane] < bestGap) {
+        bestGap = gap[lane];
+        best = group->index[lane];
+      }
+    }
+  }
+  return best;
+}
+
+static void RunRemap(void *data, int start, int end) {
+  RemapJob *job = (RemapJob *)data;
+  const PaletteGrid *grid = job->grid;
+  uint32 lastKey = 0xffffffffu;
+  int last = 0;
+  for (int i = start; i < end; i++) {
+    Color c = job->pixels[i];
+    uint32 key = ColourKey(c);
+    if (key != lastKey) {
+      last = NearestEntry(grid, c);
+      lastKey = key;
+    }
+    Color e = grid->colours[last];
+    job->pixels[i] = (Color){e.r, e.g, e.b, c.a};
+    if (job->indices) {
+      job->indices[i] = (uint8)last;
+    }
+  }
+}
+
+// Replaces every pixel's RGB with its nearest palette entry, keeping alpha,
+// and writes the entry's index to indices if given. The same as a search of
+// the whole palette, ties to the lower index.
+void RemapToPalette(const PaletteGrid *grid, Color *pixels, uint8 *indices,
+                    int count) {
+  RemapJob job = {grid, pixels, indices};
+  ParallelFor(count, MIN_PIXELS_PER_JOB, RunRemap, &job);
+}
+
+// Builds a palette of up to k colours for the image and remaps it in place,
+// converting it to 8-bit RGBA first if needed. indices, if given, gets each
+// pixel's palette index. Scratch memory comes from the arena and is handed
+// back before returning. Returns the palette size, 0 on failure.
+int QuantiseImage(Image *image, memory_arena *arena, int k, uint64 seed,
+                  Color *palette, uint8 *indices) {
+  if (!image->data || k < 1) {
+    return 0;
+  }
+  if (image->format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8) {
+    ImageFormat(image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    if (image->format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8) {
+      return 0;
+    }
+  }
+  Color *pixels = (Color *)image->data;
+  int count = image->width * image->height;
+
+  uint64 used = arena->used;
+  ColourHistogram histogram;
+  PaletteGrid grid;
+  int size = 0;
+  if (BuildColourHistogram(&histogram, arena, pixels, count)) {
+    size = BuildPalette(palette, arena, &histogram, k, seed);
+  }
+  if (size > 0 && BuildPaletteGrid(&grid, arena, palette, size)) {
+    RemapToPalette(&grid, pixels, indices, count);
+  } else {
+    size = 0;
+  }
+  arena->used = used;
+  return size;
+}
@@ -0,0 +1,316 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+#define POISSON_ATTEMPTS 30
+#define HILBERT_ORDER 16
+
+// Site colours come from their own stream, so switching samplers only moves
+// the sites
+#define POSITION_STREAM 0
+#define COLOUR_STREAM 1
+
+static void SampleUniform(Vector2 *points, int n, Rectangle box, pcg32 *rng) {
+  for (int i = 0; i < n; i++) {
+    points[i] = (Vector2){Pcg32Range(rng, box.x, box.x + box.width),
+                          Pcg32Range(rng, box.y, box.y + box.height)};
+  }
+}
+
+// One point in each of n distinct strata of a grid with about square cells.
+// When the grid has more strata than points, a random subset is used.
+static bool32 SampleJittered(Vector2 *points, int n, Rectangle box,
+                             pcg32 *rng, memory_arena *arena) {
+  int cols = (int)roundf(sqrtf(n * box.width / box.height));
+  cols = cols < 1 ? 1 : cols;
+  int rows = (n + cols - 1) / cols;
+  int strata = cols * rows;
+
+  int *order = PushArray(arena, strata, int);
+  if (!order) {
+    return 0;
+  }
+  for (int k = 0; k < strata; k++) {
+    order[k] = k;
+  }
+
+  float cellW = box.width / cols;
+  float cellH = box.height / rows;
+  for (int i = 0; i < n; i++) {
+    // Partial Fisher-Yates: the first n entries end up a random subset
+    int j = i + (int)Pcg32Bounded(rng, strata - i);
+    int stratum = order[j];
+    order[j] = order[i];
+    order[i] = stratum;
+
+    int cx = stratum % cols;
+    int cy = stratum / cols;
+    points[i] = (Vector2){box.x + (cx + Pcg32Float(rng)) * cellW,
+                          box.y + (cy + Pcg32Float(rng)) * cellH};
+  }
+  return 1;
+}
+
+// Bridson's Poisson-disk sampling: grow from active points by trying
+// candidates in the annulus [radius, 2 radius] and keeping the ones that no
+// accepted point is too close to. Cells of radius / sqrt(2) hold at most one
+// point, so the test only looks at the 5x5 cells around a candidate.
+int SamplePoissonDisk(Vector2 *points, int maxPoints, Rectangle box,
+                      float radius, pcg32 *rng, memory_arena *arena) {
+  float cellSize = radius / sqrtf(2.0f);
+  int gridW = (int)ceilf(box.width / cellSize);
+  int gridH = (int)ceilf(box.height / cellSize);
+
+  uint64 used = arena->used;
+  int *grid = PushArray(arena, (uint64)gridW * gridH, int);
+  int *active = PushArray(arena, maxPoints, int);
+  if (!grid || !active || maxPoints <= 0) {
+    arena->used = used;
+    return 0;
+  }
+  memset(grid, 0xff, (uint64)gridW * gridH * sizeof(int));
+
+  int count = 0;
+  int numActive = 0;
+  float radiusSq = radius * radius;
+
+#define POISSON_CELL(p)                                                        \
+  (CLAMP((int)(((p).y - box.y) / cellSize), 0, gridH - 1) * gridW +            \
+   CLAMP((int)(((p).x - box.x) / cellSize), 0, gridW - 1))
+
+  points[count] = (Vector2){Pcg32Range(rng, box.x, box.x + box.width),
+                            Pcg32Range(rng, box.y, box.y + box.height)};
+  grid[POISSON_CELL(points[count])] = count;
+  active[numActive++] = count++;
+
+  while (numActive > 0 && count < maxPoints) {
+    int a = (int)Pcg32Bounded(rng, numActive);
+    Vector2 origin = points[active[a]];
+
+    bool32 placed = 0;
+    for (int attempt = 0; attempt < POISSON_ATTEMPTS && !placed; attempt++) {
+      // Uniform by area over the annulus
+      float angle = 2.0f * Pi32 * Pcg32Float(rng);
+      float r = radius * sqrtf(1.0f + 3.0f * Pcg32Float(rng));
+      Vector2 c = {origin.x + r * cosf(angle), origin.y + r * sinf(angle)};
+      if (c.x < box.x || c.x >= box.x + box.width || c.y < box.y ||
+          c.y >= box.y + box.height) {
+        continue;
+      }
+
+      int gx = (int)((c.x - box.x) / cellSize);
+      int gy = (int)((c.y - box.y) / cellSize);
+      bool32 clear = 1;
+      for (int y = gy - 2; y <= gy + 2 && clear; y++) {
+        for (int x = gx - 2; x <= gx + 2 && clear; x++) {
+          if (x < 0 || y < 0 || x >= gridW || y >= gridH) {
+            continue;
+          }
+          int other = grid[y * gridW + x];
+          clear = other < 0 ||
+                  Vector2DistanceSqr(points[other], c) >= radiusSq;
+        }
+      }
+
+      if (clear) {
+        points[count] = c;
+        grid[POISSON_CELL(c)] = count;
+        active[numActive++] = count++;
+        placed = 1;
+      }
+    }
+
+    if (!placed) {
+      active[a] = active[--numActive];
+    }
+  }
+#undef POISSON_CELL
+
+  arena->used = used;
+  return count;
+}
+
+// Position along a Hilbert curve over a 2^16 x 2^16 grid
+static uint32 HilbertIndex(uint32 x, uint32 y) {
+  uint32 n = 1u << HILBERT_ORDER;
+  uint32 d = 0;
+  for (uint32 s = n / 2; s > 0; s /= 2) {
+    uint32 rx = (x & s) > 0;
+    uint32 ry = (y & s) > 0;
+    d += s * s * ((3 * rx) ^ ry);
+    if (ry == 0) {
+      if (rx == 1) {
+        x = n - 1 - x;
+        y = n - 1 - y;
+      }
+      uint32 t = x;
+      x = y;
+      y = t;
+    }
+  }
+  return d;
+}
+
+// Writes the permutation that sorts points along a Hilbert curve over box, so
+// consecutive indices are close in space. Two 16-bit radix passes over the
+// curve keys.
+bool32 HilbertOrder(const Vector2 *points, int n, Rectangle box, int *order,
+                    memory_arena *arena) {
+  uint64 used = arena->used;
+  uint32 *keys = PushArray(arena, n, uint32);
+  uint32 *keysTemp = PushArray(arena, n, uint32);
+  int *orderTemp = PushArray(arena, n, int);
+  int *counts = PushArray(arena, 1 << 16, int);
+  if (!keys || !keysTemp || !orderTemp || !counts) {
+    arena->used = used;
+    return 0;
+  }
+
+  float scale = (float)((1u << HILBERT_ORDER) - 1);
+  for (int i = 0; i < n; i++) {
+    float u = CLAMP((points[i].x - box.x) / box.width, 0.0f, 1.0f);
+    float v = CLAMP((points[i].y - box.y) / box.height, 0.0f, 1.0f);
+    keys[i] = HilbertIndex((uint32)(u * scale), (uint32)(v * scale));
+    order[i] = i;
+  }
+
+  for (int shift = 0; shift < 32; shift += 16) {
+    memset(counts, 0, (1 << 16) * sizeof(int));
+    for (int i = 0; i < n; i++) {
+      counts[(keys[i] >> shift) & 0xffff]++;
+    }
+    int sum = 0;
+    for (int b = 0; b < (1 << 16); b++) {
+      int c = counts[b];
+      counts[b] = sum;
+      sum += c;
+    }
+    for (int i = 0; i < n; i++) {
+      int slot = counts[(keys[i] >> shift) & 0xffff]++;
+      keysTemp[slot] = keys[i];
+      orderTemp[slot] = order[i];
+    }
+    memcpy(keys, keysTemp, n * sizeof(uint32));
+    memcpy(order, orderTemp, n * sizeof(int));
+  }
+
+  arena->used = used;
+  return 1;
+}
+
+// Order for a batch of queries: a Hilbert curve over the points' own bounding
+// box, so consecutive queries are close. The order stays on the arena for the
+// caller to pop; returns 0, with the arena as it was, if it does not fit.
+int *HilbertQueryOrder(const Vector2 *points, int count,
+                       memory_arena *arena) {
+  uint64 used = arena->used;
+  int *order = PushArray(arena, count, int);
+  if (!order || count < 1) {
+    arena->used = used;
+    return 0;
+  }
+  Vector2 min = points[0], max = points[0];
+  for (int i = 1; i < count; i++) {
+    min.x = points[i].x < min.x ? points[i].x : min.x;
+    min.y = points[i].y < min.y ? points[i].y : min.y;
+    max.x = points[i].x > max.x ? points[i].x : max.x;
+    max.y = points[i].y > max.y ? points[i].y : max.y;
+  }
+  Rectangle box = {min.x, min.y, max.x - min.x, max.y - min.y};
+  box.width = box.width > 0 ? box.width : 1;
+  box.height = box.height > 0 ? box.height : 1;
+  if (!HilbertOrder(points, count, box, order, arena)) {
+    arena->used = used;
+    return 0;
+  }
+  return order;
+}
+
+// Radius at which Bridson's sampler yields a few more than n points over the
+// area, it settles at about 0.65 / radius^2 points per unit area
+float PoissonDiskRadius(int n, Rectangle box) {
+  return sqrtf(0.6f * box.width * box.height / n);
+}
+
+// Replaces the sites with numSites new ones drawn by sampler over box. The
+// same seed always gives the same sites and colours. Returns the site count.
+int InitialiseSites(struct app_state *AppState, int numSites, Rectangle box,
+                    SiteSampler sampler, uint64 seed) {
+  if (numSites > MAX_SITES) {
+    numSites = MAX_SITES;
+  }
+
+  memory_arena *arena = &AppState->arena;
+  uint64 used = arena->used;
+  Vector2 *points = PushArray(arena, numSites, Vector2);
+  int *order = PushArray(arena, numSites, int);
+  if (!points || !order) {
+    arena->used = used;
+    return 0;
+  }
+
+  pcg32 rng = Pcg32Seed(seed, POSITION_STREAM);
+  switch (sampler) {
+  case UniformSites:
+    SampleUniform(points, numSites, box, &rng);
+    break;
+  case JitteredSites:
+  case HilbertSites:
+    if (!SampleJittered(points, numSites, box, &rng, arena)) {
+      SampleUniform(points, numSites, box, &rng);
+    }
+    break;
+  case PoissonDiskSites: {
+    // How many points fit varies with the seed, so sample with room to spare
+    // and shrink the radius until there are enough. A random subset of the
+    // result keeps the spacing even over the whole box, where stopping the
+    // sampler early would leave part of it empty.
+    int poolSize = 2 * numSites;
+    Vector2 *pool = PushArray(arena, poolSize, Vector2);
+    float radius = PoissonDiskRadius(numSites, box);
+    int count = 0;
+    for (int attempt = 0; pool && attempt < 8; attempt++) {
+      count = SamplePoissonDisk(pool, poolSize, box, radius, &rng, arena);
+      if (count >= numSites) {
+        break;
+      }
+      radius *= 0.95f * sqrtf((float)count / numSites);
+    }
+
+    int kept = count < numSites ? count : numSites;
+    for (int i = 0; i < kept; i++) {
+      int j = i + (int)Pcg32Bounded(&rng, count - i);
+      Vector2 t = pool[j];
+      pool[j] = pool[i];
+      pool[i] = t;
+      points[i] = t;
+    }
+    SampleUniform(points + kept, numSites - kept, box, &rng);
+  } break;
+  }
+
+  for (int i = 0; i < numSites; i++) {
+    order[i] = i;
+  }
+  if (sampler == HilbertSites) {
+    HilbertOrder(points, numSites, box, order, arena);
+  }
+
+  pcg32 colours = Pcg32Seed(seed, COLOUR_STREAM);
+  for (int i = 0; i < numSites; i++) {
+    Vertex *v = &AppState->vertices[i];
+    v->position = points[order[i]];
+    v->velocity = (Vector2){0};
+    v->centroid = v->position;
+    v->color = (Color){Pcg32Bounded(&colours, 256), Pcg32Bounded(&colours, 256),
+                       Pcg32Bounded(&colours, 256), 255};
+  }
+  AppState->num_vertices = numSites;
+
+  arena->used = used;
+  return numSites;
+}
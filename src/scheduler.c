@@ -0,0 +1,85 @@
+#include <raylib.h>
+
+#include "gui.h"
+
+void InitLloydScheduler(LloydScheduler *s, double budget, int chunkSize,
+                        bool32 sweep) {
+  *s = (LloydScheduler){0};
+  s->budget = budget;
+  s->chunkSize = chunkSize > 0 ? chunkSize : 1;
+  s->sweep = sweep;
+}
+
+// Runs Lloyd iterations on the incremental paths until the frame's budget is
+// spent, reading the monotonic clock after every chunk of cells. An iteration
+// that is still gathering cells when time runs out is picked up again on the
+// next call; sites only move when one completes, so the diagram on screen is
+// always a whole one. Stops early once an iteration finds nothing to update.
+// Returns the number of iterations completed.
+int RunLloydScheduler(struct app_state *AppState, LloydScheduler *s) {
+  IncrementalState *inc = &AppState->incremental;
+  // The sweep clips against the screen, the torus goes through the clipper
+  bool32 sweep = s->sweep && !AppState->periodic;
+  if (s->inIteration && sweep != s->sweepIteration) {
+    // The mode changed under a half-done iteration, its cells are useless
+    s->inIteration = 0;
+    InvalidateIncrementalState(inc);
+  }
+
+  double start = GetTime();
+  double deadline = start + s->budget;
+  int completed = 0;
+  s->chunks = 0;
+  s->converged = 0;
+
+  for (;;) {
+    if (!s->inIteration) {
+      s->numAffected =
+          sweep ? BeginFortuneIteration(AppState, inc, DIRTY_EPSILON)
+                : BeginIncrementalIteration(AppState, inc, DIRTY_EPSILON);
+      s->cursor = 0;
+      s->inIteration = 1;
+      s->sweepIteration = sweep;
+    }
+
+    while (s->cursor < s->numAffected) {
+      int end = s->cursor + s->chunkSize;
+      end = end < s->numAffected ? end : s->numAffected;
+      if (sweep) {
+        GatherFortuneCells(AppState, inc, s->cursor, end);
+      } else {
+        ClipIncrementalCells(AppState, inc, s->cursor, end);
+        // Clipping can widen the affected set
+        s->numAffected = inc->numAffected;
+      }
+      s->cursor = end;
+      s->chunks++;
+      if (s->cursor < s->numAffected && GetTime() >= deadline) {
+        s->seconds = GetTime() - start;
+        s->iterationsLastFrame = completed;
+        return completed;
+      }
+    }
+
+    if (sweep) {
+      FinishFortuneIteration(AppState, inc);
+    } else {
+      FinishIncrementalIteration(AppState, inc);
+    }
+    s->inIteration = 0;
+    s->iterations++;
+    completed++;
+
+    if (s->numAffected == 0) {
+      s->converged = 1;
+      break;
+    }
+    if (GetTime() >= deadline) {
+      break;
+    }
+  }
+
+  s->seconds = GetTime() - start;
+  s->iterationsLastFrame = completed;
+  return completed;
+}
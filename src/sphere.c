@@ -0,0 +1,236 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+#define MAX_SPHERE_GRID 192
+#define SPHERE_SITES_PER_CELL 3
+
+// Half-size of the starting square in gnomonic coordinates, 45 degrees along
+// the tangent axes. Wider cells, as with a handful of sites, start again from
+// a square GNOMONIC_GROWTH times larger, up to about 89.9 degrees; only a cell
+// reaching a full hemisphere, with three sites or fewer, stays cut there.
+#define GNOMONIC_EXTENT 1.0f
+#define GNOMONIC_GROWTH 8.0f
+#define GNOMONIC_MAX_EXTENT 512.0f
+
+bool32 InitSphericalLloyd(SphericalLloyd *s, memory_arena *arena,
+                          int numSites, uint64 seed) {
+  memset(s, 0, sizeof(*s));
+  s->numSites = numSites;
+
+  // The sites form a shell, so only about pi * gridSize^2 cells are occupied
+  float gridSize = ceilf(sqrtf(numSites / (SPHERE_SITES_PER_CELL * Pi32)));
+  BoundingBox cube = {{-1, -1, -1}, {1, 1, 1}};
+  if (!InitSiteGrid3(&s->grid, arena, numSites, cube, 2.0f / gridSize,
+                     MAX_SPHERE_GRID)) {
+    return 0;
+  }
+
+  s->sites = PushArray(arena, numSites, Vector3);
+  s->centroids = PushArray(arena, numSites, Vector3);
+  if (!s->sites || !s->centroids) {
+    return 0;
+  }
+
+  // Uniform on the sphere: z uniform in [-1, 1], longitude uniform
+  pcg32 rng = Pcg32Seed(seed, 0);
+  for (int i = 0; i < numSites; i++) {
+    float z = Pcg32Range(&rng, -1.0f, 1.0f);
+    float phi = Pcg32Range(&rng, -Pi32, Pi32);
+    float r = sqrtf(fmaxf(0.0f, 1.0f - z * z));
+    s->sites[i] = (Vector3){r * cosf(phi), r * sinf(phi), z};
+  }
+  BuildSiteGrid3(&s->grid, s->sites);
+  return 1;
+}
+
+// Right-handed tangent frame (e1, e2, p), so counter-clockwise in the plane is
+// counter-clockwise on the sphere seen from outside
+static void TangentFrame(Vector3 p, Vector3 *e1, Vector3 *e2) {
+  Vector3 axis = {1, 0, 0};
+  if (fabsf(p.y) < fabsf(p.x) && fabsf(p.y) <= fabsf(p.z)) {
+    axis = (Vector3){0, 1, 0};
+  } else if (fabsf(p.z) < fabsf(p.x)) {
+    axis = (Vector3){0, 0, 1};
+  }
+  *e1 = Vector3Normalize(Vector3CrossProduct(p, axis));
+  *e2 = Vector3CrossProduct(p, *e1);
+}
+
+typedef struct {
+  Vector3 p;
+  Vector3 e1;
+  Vector3 e2;
+  Vector2 polygon[MAX_CLIP_VERTICES];
+  Vector2 scratch[MAX_CLIP_VERTICES];
+  int labels[MAX_CLIP_VERTICES];
+  int scratchLabels[MAX_CLIP_VERTICES];
+  int count;
+} SphereCell;
+
+static inline Vector3 SphereCellVertex(const SphereCell *cell, Vector2 u) {
+  Vector3 x = Vector3Add(cell->p, Vector3Add(Vector3Scale(cell->e1, u.x),
+                                             Vector3Scale(cell->e2, u.y)));
+  return Vector3Normalize(x);
+}
+
+// Cuts the cell by the great circle bisecting p and q. Great circles through
+// the gnomonic projection are straight lines: x = p + u is closer to p when
+// dot(u, q_t) <= 1 - dot(p, q), with q_t the tangent part of q. The offset
+// is taken as |p - q|^2 / 2, which is the same for unit vectors but neither
+// cancels away in float nor turns negative for very close sites, so the cell
+// always keeps its site.
+static void ClipSphereCell(SphereCell *cell, Vector3 q, int site) {
+  Vector2 normal = {Vector3DotProduct(q, cell->e1),
+                    Vector3DotProduct(q, cell->e2)};
+  float offset = 0.5f * Vector3LengthSqr(Vector3Subtract(cell->p, q));
+  cell->count =
+      ClipHalfPlane(normal, offset, site, cell->polygon, cell->labels,
+                    cell->count, cell->scratch, cell->scratchLabels);
+  memcpy(cell->polygon, cell->scratch, cell->count * sizeof(Vector2));
+  memcpy(cell->labels, cell->scratchLabels, cell->count * sizeof(int));
+}
+
+// Largest chord from the site to a cell vertex
+static float SphereCellRadius(const SphereCell *cell) {
+  float radius = 0;
+  for (int k = 0; k < cell->count; k++) {
+    Vector3 v = SphereCellVertex(cell, cell->polygon[k]);
+    radius = fmaxf(radius, Vector3Distance(v, cell->p));
+  }
+  return radius;
+}
+
+typedef struct {
+  const SphericalLloyd *s;
+  SphereCell *cell;
+  int slot;
+} SphereShellVisit;
+
+static void ClipBySlot(void *data, int k) {
+  SphereShellVisit *visit = (SphereShellVisit *)data;
+  if (k != visit->slot) {
+    const SiteGrid3 *grid = &visit->s->grid;
+    ClipSphereCell(visit->cell, grid->sorted[k], grid->sortedSite[k]);
+  }
+}
+
+// Spherical Voronoi cell of sorted slot k. Neighbours are visited in growing
+// shells of grid cells until the shell is more than twice the cell radius
+// away, past which no site can cut the cell any more. A cell that still has a
+// side on the starting square is wider than it, so it is built again from a
+// larger one.
+static void BuildSphereCell(const SphericalLloyd *s, int slot,
+                            SphereCell *cell) {
+  cell->p = s->grid.sorted[slot];
+  TangentFrame(cell->p, &cell->e1, &cell->e2);
+  int c[3];
+  SiteGrid3Coords(&s->grid, cell->p, c);
+
+  for (float extent = GNOMONIC_EXTENT;; extent *= GNOMONIC_GROWTH) {
+    cell->count = 4;
+    cell->polygon[0] = (Vector2){-extent, -extent};
+    cell->polygon[1] = (Vector2){extent, -extent};
+    cell->polygon[2] = (Vector2){extent, extent};
+    cell->polygon[3] = (Vector2){-extent, extent};
+    cell->labels[0] = cell->labels[1] = cell->labels[2] = cell->labels[3] = -1;
+
+    SphereShellVisit visit = {s, cell, slot};
+    for (int r = 0; VisitSiteGrid3Shell(&s->grid, c, r, ClipBySlot, &visit);
+         r++) {
+      if (r * s->grid.cellSize >= 2.0f * SphereCellRadius(cell)) {
+        break;
+      }
+    }
+
+    bool32 onSquare = 0;
+    for (int k = 0; k < cell->count; k++) {
+      onSquare |= cell->labels[k] < 0;
+    }
+    if (!onSquare || extent >= GNOMONIC_MAX_EXTENT) {
+      break;
+    }
+  }
+}
+
+// Integral of x over the spherical polygon: half the sum over its edges of
+// the arc length times the unit normal of the edge's great circle. The terms
+// are about as large as the cell is wide but sum to its area, so with a
+// million sites float would lose most of the centroid's offset; accumulate in
+// double.
+static Vector3 SphereCellMoment(const SphereCell *cell) {
+  double corners[MAX_CLIP_VERTICES][3];
+  for (int k = 0; k < cell->count; k++) {
+    Vector2 u = cell->polygon[k];
+    double x = (double)cell->p.x + (double)cell->e1.x * u.x + cell->e2.x * u.y;
+    double y = (double)cell->p.y + (double)cell->e1.y * u.x + cell->e2.y * u.y;
+    double z = (double)cell->p.z + (double)cell->e1.z * u.x + cell->e2.z * u.y;
+    double length = sqrt(x * x + y * y + z * z);
+    corners[k][0] = x / length;
+    corners[k][1] = y / length;
+    corners[k][2] = z / length;
+  }
+
+  double moment[3] = {0};
+  for (int k = 0; k < cell->count; k++) {
+    const double *a = corners[k];
+    const double *b = corners[(k + 1) % cell->count];
+    double n[3] = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+                   a[0] * b[1] - a[1] * b[0]};
+    double sine = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (sine <= 0) {
+      continue;
+    }
+    double angle = atan2(sine, a[0] * b[0] + a[1] * b[1] + a[2] * b[2]);
+    for (int d = 0; d < 3; d++) {
+      moment[d] += n[d] * 0.5 * angle / sine;
+    }
+  }
+  return (Vector3){(float)moment[0], (float)moment[1], (float)moment[2]};
+}
+
+typedef struct {
+  SphericalLloyd *s;
+} SphereCentroidJob;
+
+static void RunSphereCentroids(void *data, int start, int end) {
+  SphericalLloyd *s = ((SphereCentroidJob *)data)->s;
+  SphereCell cell;
+  for (int slot = start; slot < end; slot++) {
+    BuildSphereCell(s, slot, &cell);
+    Vector3 moment = SphereCellMoment(&cell);
+    int i = s->grid.sortedSite[slot];
+    s->centroids[i] = Vector3Length(moment) > 0 ? Vector3Normalize(moment)
+                                                : s->grid.sorted[slot];
+  }
+}
+
+// One Lloyd step on the unit sphere: every site moves to the normalised
+// centroid of its spherical Voronoi cell. Cells are built independently in
+// grid order, so neighbouring threads touch neighbouring memory. The grid is
+// rebuilt for the new positions, ready for the next step or for drawing.
+void SphericalLloydIteration(SphericalLloyd *s) {
+  SphereCentroidJob job = {s};
+  ParallelFor(s->numSites, 256, RunSphereCentroids, &job);
+
+  memcpy(s->sites, s->centroids, s->numSites * sizeof(Vector3));
+  BuildSiteGrid3(&s->grid, s->sites);
+  s->iteration++;
+}
+
+// Corners of the spherical cell of site i as unit vectors, counter-clockwise
+// seen from outside. Returns the vertex count.
+int SphericalVoronoiCell(const SphericalLloyd *s, int i, Vector3 *corners,
+                         int maxCorners) {
+  SphereCell cell;
+  BuildSphereCell(s, SiteGrid3Slot(&s->grid, i), &cell);
+  int count = cell.count < maxCorners ? cell.count : maxCorners;
+  for (int k = 0; k < count; k++) {
+    corners[k] = SphereCellVertex(&cell, cell.polygon[k]);
+  }
+  return count;
+}
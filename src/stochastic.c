@@ -0,0 +1,251 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+#define MIN_SITES_PER_JOB 4096
+
+static int UpperBound(const double *values, int count, double target) {
+  int lo = 0, hi = count;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (values[mid] <= target) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static Vector2 DrawSample(const StochasticLloyd *s, uint64 key) {
+  float u = UnitFloat(Mix64(key));
+  float v = UnitFloat(Mix64(key ^ 0x5851f42d4c957f2dull));
+
+  const DensityField *field = s->density;
+  if (!field) {
+    return (Vector2){s->box.x + u * s->box.width, s->box.y + v * s->box.height};
+  }
+
+  // Inverse-CDF sampling: pick a row by its mass, then a column inside it
+  double target = u * s->rowCdf[field->height];
+  int row = UpperBound(s->rowCdf + 1, field->height, target);
+  if (row >= field->height) {
+    row = field->height - 1;
+  }
+  const double *prefix = &field->rowMass[(uint64)row * (field->width + 1)];
+  double inRow = v * prefix[field->width];
+  int col = UpperBound(prefix + 1, field->width, inRow);
+  if (col >= field->width) {
+    col = field->width - 1;
+  }
+  double pixelMass = prefix[col + 1] - prefix[col];
+  double fx = (pixelMass > 0) ? (inRow - prefix[col]) / pixelMass : 0.5;
+  float jitterY = UnitFloat(Mix64(key ^ 0x2545f4914f6cdd1dull));
+
+  return (Vector2){
+      field->box.x + (col + (float)fx) * field->box.width / field->width,
+      field->box.y + (row + jitterY) * field->box.height / field->height};
+}
+
+bool32 InitStochasticLloyd(StochasticLloyd *s, memory_arena *arena,
+                           int numSites, Rectangle box,
+                           const DensityField *density, uint64 seed) {
+  memset(s, 0, sizeof(*s));
+  s->numSites = numSites;
+  s->box = box;
+  s->density = (density && density->valid) ? density : 0;
+  s->seed = seed;
+
+  // About two sites per grid cell
+  s->sites = PushArray(arena, numSites, Vector2);
+  s->totalHits = PushArray(arena, numSites, float);
+  if (!s->sites || !s->totalHits ||
+      !InitSiteGrid(&s->grid, arena, numSites, 2.0f)) {
+    return 0;
+  }
+  for (int k = 0; k < STOCHASTIC_SLICES; k++) {
+    s->sumX[k] = PushArray(arena, numSites, float);
+    s->sumY[k] = PushArray(arena, numSites, float);
+    s->hits[k] = PushArray(arena, numSites, int);
+    if (!s->sumX[k] || !s->sumY[k] || !s->hits[k]) {
+      return 0;
+    }
+  }
+
+  if (s->density) {
+    const DensityField *field = s->density;
+    s->rowCdf = PushArray(arena, field->height + 1, double);
+    if (!s->rowCdf) {
+      return 0;
+    }
+    s->rowCdf[0] = 0;
+    for (int row = 0; row < field->height; row++) {
+      s->rowCdf[row + 1] =
+          s->rowCdf[row] +
+          field->rowMass[(uint64)row * (field->width + 1) + field->width];
+    }
+  }
+
+  // Start from the target distribution itself
+  for (int i = 0; i < numSites; i++) {
+    s->sites[i] = DrawSample(s, Mix64(seed) ^ ((uint64)i << 1));
+    s->totalHits[i] = 1.0f;
+  }
+  return 1;
+}
+
+static inline void NearestInSpan(const SiteGrid *grid, int start, int end,
+                                 float px, float py, float *bestDist,
+                                 int *best) {
+  int i = start;
+  float4 qx = {px, px, px, px};
+  float4 qy = {py, py, py, py};
+  for (; i + 4 <= end; i += 4) {
+    float4 x, y;
+    memcpy(&x, &grid->sortedX[i], sizeof(x));
+    memcpy(&y, &grid->sortedY[i], sizeof(y));
+    float4 dx = x - qx;
+    float4 dy = y - qy;
+    float4 d = dx * dx + dy * dy;
+    float lowest = fminf(fminf(d[0], d[1]), fminf(d[2], d[3]));
+    if (lowest < *bestDist) {
+      for (int k = 0; k < 4; k++) {
+        if (d[k] < *bestDist) {
+          *bestDist = d[k];
+          *best = i + k;
+        }
+      }
+    }
+  }
+  for (; i < end; i++) {
+    float dx = grid->sortedX[i] - px;
+    float dy = grid->sortedY[i] - py;
+    float d = dx * dx + dy * dy;
+    if (d < *bestDist) {
+      *bestDist = d;
+      *best = i;
+    }
+  }
+}
+
+// Searches rings of grid cells around the sample until no unvisited cell can
+// hold anything closer. Grid rows are contiguous in sorted order, so each
+// ring row is a single span. Returns the sorted slot of the nearest site.
+static int NearestSite(const SiteGrid *grid, Vector2 p) {
+  int cx, cy;
+  SiteGridCoords(grid, p, &cx, &cy);
+  float localX = p.x - (grid->box.x + cx * grid->cellSize);
+  float localY = p.y - (grid->box.y + cy * grid->cellSize);
+  float edge = fminf(fminf(localX, grid->cellSize - localX),
+                     fminf(localY, grid->cellSize - localY));
+  edge = fmaxf(edge, 0.0f);
+
+  float bestDist = FLT_MAX;
+  int best = -1;
+  int maxRing = grid->gridW > grid->gridH ? grid->gridW : grid->gridH;
+  for (int r = 0; r <= maxRing; r++) {
+    int x0 = cx - r < 0 ? 0 : cx - r;
+    int x1 = cx + r >= grid->gridW ? grid->gridW - 1 : cx + r;
+    for (int y = cy - r; y <= cy + r; y++) {
+      if (y < 0 || y >= grid->gridH) {
+        continue;
+      }
+      const int *rowStart = &grid->cellStart[y * grid->gridW];
+      if (y == cy - r || y == cy + r) {
+        NearestInSpan(grid, rowStart[x0], rowStart[x1 + 1], p.x, p.y,
+                      &bestDist, &best);
+      } else {
+        if (cx - r >= 0) {
+          NearestInSpan(grid, rowStart[cx - r], rowStart[cx - r + 1], p.x,
+                        p.y, &bestDist, &best);
+        }
+        if (cx + r < grid->gridW) {
+          NearestInSpan(grid, rowStart[cx + r], rowStart[cx + r + 1], p.x,
+                        p.y, &bestDist, &best);
+        }
+      }
+    }
+
+    float reach = r * grid->cellSize + edge;
+    if (best >= 0 && bestDist <= reach * reach) {
+      break;
+    }
+  }
+  return best;
+}
+
+typedef struct {
+  StochasticLloyd *s;
+  int numSamples;
+} SampleJob;
+
+static void RunSampleSlices(void *data, int start, int end) {
+  SampleJob *job = (SampleJob *)data;
+  StochasticLloyd *s = job->s;
+
+  for (int slice = start; slice < end; slice++) {
+    float *sumX = s->sumX[slice];
+    float *sumY = s->sumY[slice];
+    int *hits = s->hits[slice];
+    memset(sumX, 0, s->numSites * sizeof(float));
+    memset(sumY, 0, s->numSites * sizeof(float));
+    memset(hits, 0, s->numSites * sizeof(int));
+
+    int first = (int)((int64)job->numSamples * slice / STOCHASTIC_SLICES);
+    int last = (int)((int64)job->numSamples * (slice + 1) / STOCHASTIC_SLICES);
+    uint64 stream = Mix64(s->seed ^ Mix64((uint64)s->iteration + 1));
+
+    for (int n = first; n < last; n++) {
+      Vector2 p = DrawSample(s, stream + (uint64)n * 0x9e3779b97f4a7c15ull);
+      int slot = NearestSite(&s->grid, p);
+      int i = s->grid.sortedSite[slot];
+      sumX[i] += p.x;
+      sumY[i] += p.y;
+      hits[i]++;
+    }
+  }
+}
+
+typedef struct {
+  StochasticLloyd *s;
+} UpdateJob;
+
+static void RunSiteUpdates(void *data, int start, int end) {
+  StochasticLloyd *s = ((UpdateJob *)data)->s;
+  for (int i = start; i < end; i++) {
+    float sumX = 0, sumY = 0;
+    int hits = 0;
+    for (int k = 0; k < STOCHASTIC_SLICES; k++) {
+      sumX += s->sumX[k][i];
+      sumY += s->sumY[k][i];
+      hits += s->hits[k][i];
+    }
+    if (hits == 0) {
+      continue;
+    }
+
+    // MacQueen's running mean: the step shrinks as a site absorbs samples
+    s->totalHits[i] += hits;
+    float rate = hits / s->totalHits[i];
+    Vector2 mean = {sumX / hits, sumY / hits};
+    s->sites[i] = Vector2Lerp(s->sites[i], mean, rate);
+  }
+}
+
+// One stochastic Lloyd step over numSamples samples. Samples are split into
+// fixed slices with their own accumulators, so the result does not depend on
+// how many threads happened to run them.
+void StochasticLloydIteration(StochasticLloyd *s, int numSamples) {
+  BuildSiteGrid(&s->grid, s->sites, s->numSites, s->box);
+
+  SampleJob sampleJob = {s, numSamples};
+  ParallelFor(STOCHASTIC_SLICES, 1, RunSampleSlices, &sampleJob);
+
+  UpdateJob updateJob = {s};
+  ParallelFor(s->numSites, MIN_SITES_PER_JOB, RunSiteUpdates, &updateJob);
+  s->iteration++;
+}
@@ -0,0 +1,141 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+// A cell holding more than SPLIT_SHARE shares gets a second site, one holding
+// less than MERGE_SHARE loses its site. The gap keeps sites from flickering in
+// and out between frames.
+#define SPLIT_SHARE 1.8
+#define MERGE_SHARE 0.5
+
+void InitTemporalLloyd(TemporalLloyd *t, int iterationsPerFrame,
+                       float tolerance) {
+  memset(t, 0, sizeof(*t));
+  t->iterationsPerFrame = iterationsPerFrame;
+  t->tolerance = tolerance;
+}
+
+static double CellArea(const Cell *cell) {
+  double area = 0;
+  for (int k = 0, j = cell->num_vertices - 1; k < cell->num_vertices;
+       j = k++) {
+    area += (double)cell->vertices[j].x * cell->vertices[k].y -
+            (double)cell->vertices[k].x * cell->vertices[j].y;
+  }
+  return 0.5 * fabs(area);
+}
+
+// Lloyd spreads sites with a local density proportional to sqrt(rho), so once
+// converged every cell holds about the same sqrt(mass * area) whatever the
+// density under it. That is the share a frame's cells are compared against.
+static double CellShare(const DensityField *field, const Cell *cell) {
+  double mass = DensityMass(field, cell->vertices, cell->num_vertices);
+  return sqrt(fmax(mass, 0) * CellArea(cell));
+}
+
+static double MeanShare(struct app_state *AppState) {
+  int n = AppState->num_vertices;
+  double total = 0;
+  for (int i = 0; i < n; i++) {
+    total += CellShare(&AppState->density, &AppState->cells[i]);
+  }
+  return n > 0 ? total / n : 0;
+}
+
+// Splits cells the new density has made too heavy and drops sites whose cells
+// it has emptied, measured on the cells the last frame converged to. A new
+// site goes halfway towards the corner of its parent's cell farthest from the
+// parent, where the cell has the most room.
+static void RebalanceSites(struct app_state *AppState, TemporalLloyd *t) {
+  int n = AppState->num_vertices;
+  uint8 remove[MAX_SITES] = {0};
+
+  for (int i = 0; i < n; i++) {
+    Cell *cell = &AppState->cells[i];
+    if (cell->num_vertices < 3) {
+      continue;
+    }
+    double share = CellShare(&AppState->density, cell) / t->share;
+    if (share < MERGE_SHARE && AppState->num_vertices - t->removed > 1) {
+      remove[i] = 1;
+      t->removed++;
+    } else if (share > SPLIT_SHARE) {
+      Vector2 p = AppState->vertices[i].position;
+      Vector2 far = cell->vertices[0];
+      for (int k = 1; k < cell->num_vertices; k++) {
+        if (Vector2DistanceSqr(cell->vertices[k], p) >
+            Vector2DistanceSqr(far, p)) {
+          far = cell->vertices[k];
+        }
+      }
+      if (InsertSite(AppState, i, Midpoint(p, far)) >= 0) {
+        t->inserted++;
+      }
+    }
+  }
+
+  if (t->removed > 0) {
+    RemoveSites(AppState, remove);
+  }
+}
+
+// Relaxes one frame of an animated density, starting from where the last
+// frame converged instead of from fresh sites. The incremental cache is kept,
+// so cells are clipped against their previous neighbours from the first
+// iteration on; only the centroids are forced to update. Sites are added or
+// removed where the density's mass moved, then Lloyd runs until no site moves
+// more than the tolerance or the frame's iteration budget is spent. rho covers
+// the screen. Returns the number of iterations run.
+int RelaxDensityFrame(struct app_state *AppState, TemporalLloyd *t,
+                      const float *rho, int width, int height) {
+  Rectangle box = {0, 0, GetScreenWidth(), GetScreenHeight()};
+  if (!UpdateDensityField(&AppState->density, &AppState->arena, rho, width,
+                          height, box)) {
+    return 0;
+  }
+
+  IncrementalState *inc = &AppState->incremental;
+  t->inserted = 0;
+  t->removed = 0;
+  if (t->share > 0 && inc->numSites == AppState->num_vertices) {
+    RebalanceSites(AppState, t);
+  }
+
+  // The density moves every centroid, also under sites that stay put
+  for (int i = 0; i < AppState->num_vertices; i++) {
+    inc->stale[i] = 1;
+  }
+
+  Vector2 previous[MAX_SITES];
+  t->iterationsRun = 0;
+  t->movement = 0;
+  while (t->iterationsRun < t->iterationsPerFrame) {
+    int n = AppState->num_vertices;
+    for (int i = 0; i < n; i++) {
+      previous[i] = AppState->vertices[i].position;
+    }
+    LloydRelaxationIncremental(AppState, inc, DIRTY_EPSILON);
+    t->iterationsRun++;
+
+    t->movement = 0;
+    for (int i = 0; i < n; i++) {
+      t->movement = fmaxf(t->movement, Vector2Distance(
+                                           previous[i],
+                                           AppState->vertices[i].position));
+    }
+    if (t->movement <= t->tolerance) {
+      break;
+    }
+  }
+
+  // The first frame sets how much of the density one site stands for
+  if (t->share <= 0) {
+    t->share = MeanShare(AppState);
+  }
+  t->frame++;
+  return t->iterationsRun;
+}
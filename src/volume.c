@@ -0,0 +1,284 @@
+#include <math.h>
+#include <string.h>
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "gui.h"
+
+#define MAX_VOLUME_GRID 128
+#define VOLUME_SITES_PER_CELL 2
+
+bool32 InitVolumeLloyd(VolumeLloyd *v, memory_arena *arena, int numSites,
+                       BoundingBox box, uint64 seed) {
+  memset(v, 0, sizeof(*v));
+  v->numSites = numSites;
+  v->box = box;
+
+  Vector3 size = Vector3Subtract(box.max, box.min);
+  float cellSize =
+      cbrtf(size.x * size.y * size.z * VOLUME_SITES_PER_CELL / numSites);
+  if (!InitSiteGrid3(&v->grid, arena, numSites, box, cellSize,
+                     MAX_VOLUME_GRID)) {
+    return 0;
+  }
+
+  v->sites = PushArray(arena, numSites, Vector3);
+  v->centroids = PushArray(arena, numSites, Vector3);
+  v->volumes = PushArray(arena, numSites, float);
+  if (!v->sites || !v->centroids || !v->volumes) {
+    return 0;
+  }
+
+  pcg32 rng = Pcg32Seed(seed, 0);
+  for (int i = 0; i < numSites; i++) {
+    v->sites[i] = (Vector3){box.min.x + Pcg32Float(&rng) * size.x,
+                            box.min.y + Pcg32Float(&rng) * size.y,
+                            box.min.z + Pcg32Float(&rng) * size.z};
+  }
+  BuildSiteGrid3(&v->grid, v->sites);
+  return 1;
+}
+
+// The box as six faces, counter-clockwise seen from outside
+static void BoxPolyhedron(BoundingBox box, Polyhedron *poly) {
+  Vector3 lo = box.min, hi = box.max;
+  Vector3 corners[8] = {{lo.x, lo.y, lo.z}, {hi.x, lo.y, lo.z},
+                        {hi.x, hi.y, lo.z}, {lo.x, hi.y, lo.z},
+                        {lo.x, lo.y, hi.z}, {hi.x, lo.y, hi.z},
+                        {hi.x, hi.y, hi.z}, {lo.x, hi.y, hi.z}};
+  static const int faces[6][4] = {{0, 3, 2, 1}, {4, 5, 6, 7}, {0, 1, 5, 4},
+                                  {2, 3, 7, 6}, {0, 4, 7, 3}, {1, 2, 6, 5}};
+
+  poly->numFaces = 6;
+  for (int f = 0; f < 6; f++) {
+    poly->faceStart[f] = 4 * f;
+    poly->faceLabel[f] = -1;
+    for (int k = 0; k < 4; k++) {
+      poly->corners[4 * f + k] = corners[faces[f][k]];
+    }
+  }
+  poly->faceStart[6] = 24;
+}
+
+// Orders the cap corners counter-clockwise around the plane normal, seen from
+// outside the kept half-space
+static void SortCapCorners(Vector3 *cap, int count, Vector3 normal) {
+  Vector3 centre = {0};
+  for (int k = 0; k < count; k++) {
+    centre = Vector3Add(centre, cap[k]);
+  }
+  centre = Vector3Scale(centre, 1.0f / count);
+
+  Vector3 u = Vector3Normalize(Vector3Subtract(cap[0], centre));
+  Vector3 w = Vector3CrossProduct(normal, u);
+  float angles[MAX_POLY_CORNERS];
+  for (int k = 0; k < count; k++) {
+    Vector3 d = Vector3Subtract(cap[k], centre);
+    angles[k] = atan2f(Vector3DotProduct(d, w), Vector3DotProduct(d, u));
+  }
+
+  // Caps are small, insertion sort is enough
+  for (int k = 1; k < count; k++) {
+    float angle = angles[k];
+    Vector3 corner = cap[k];
+    int j = k - 1;
+    for (; j >= 0 && angles[j] > angle; j--) {
+      angles[j + 1] = angles[j];
+      cap[j + 1] = cap[j];
+    }
+    angles[j + 1] = angle;
+    cap[j + 1] = corner;
+  }
+}
+
+// Keeps the part of the polyhedron where dot(normal, x) <= offset. Every face
+// is clipped like a polygon; the points where faces leave the kept side are
+// exactly the corners of the new cap face, labelled with label. Returns the
+// face count, 0 when nothing is left.
+int ClipPolyhedron(const Polyhedron *in, Vector3 normal, float offset,
+                   int label, Polyhedron *out) {
+  Vector3 cap[MAX_POLY_CORNERS];
+  int capCount = 0;
+  int used = 0;
+  out->numFaces = 0;
+
+  for (int f = 0; f < in->numFaces; f++) {
+    int first = in->faceStart[f];
+    int count = in->faceStart[f + 1] - first;
+    int start = used;
+
+    for (int k = 0; k < count; k++) {
+      Vector3 a = in->corners[first + k];
+      Vector3 b = in->corners[first + (k + 1) % count];
+      float da = Vector3DotProduct(normal, a) - offset;
+      float db = Vector3DotProduct(normal, b) - offset;
+
+      if (da <= 0 && used < MAX_POLY_CORNERS) {
+        out->corners[used++] = a;
+      }
+      if ((da <= 0) != (db <= 0) && used < MAX_POLY_CORNERS) {
+        Vector3 x = Vector3Lerp(a, b, da / (da - db));
+        out->corners[used++] = x;
+        // The neighbouring face crosses the same edge the other way, so
+        // taking only the leaving crossings records every cap corner once
+        if (da <= 0 && capCount < MAX_POLY_CORNERS) {
+          cap[capCount++] = x;
+        }
+      }
+    }
+
+    if (used - start >= 3 && out->numFaces < MAX_POLY_FACES - 1) {
+      out->faceStart[out->numFaces] = start;
+      out->faceLabel[out->numFaces++] = in->faceLabel[f];
+    } else {
+      used = start;
+    }
+  }
+
+  if (capCount >= 3 && used + capCount <= MAX_POLY_CORNERS) {
+    SortCapCorners(cap, capCount, normal);
+    out->faceStart[out->numFaces] = used;
+    out->faceLabel[out->numFaces++] = label;
+    memcpy(&out->corners[used], cap, capCount * sizeof(Vector3));
+    used += capCount;
+  }
+  out->faceStart[out->numFaces] = used;
+
+  if (out->numFaces < 4) {
+    out->numFaces = 0;
+    out->faceStart[0] = 0;
+  }
+  return out->numFaces;
+}
+
+// Volume and centroid from tetrahedra between the reference point and a fan
+// over every face. Corners are taken relative to the reference so the sums
+// stay well conditioned far from the origin.
+float PolyhedronCentroid(const Polyhedron *poly, Vector3 reference,
+                         Vector3 *centroid) {
+  double volume = 0;
+  double moment[3] = {0};
+  for (int f = 0; f < poly->numFaces; f++) {
+    int first = poly->faceStart[f];
+    int count = poly->faceStart[f + 1] - first;
+    Vector3 a = Vector3Subtract(poly->corners[first], reference);
+    for (int k = 1; k + 1 < count; k++) {
+      Vector3 b = Vector3Subtract(poly->corners[first + k], reference);
+      Vector3 c = Vector3Subtract(poly->corners[first + k + 1], reference);
+      double v = Vector3DotProduct(a, Vector3CrossProduct(b, c)) / 6.0;
+      volume += v;
+      moment[0] += v * (a.x + b.x + c.x) / 4.0;
+      moment[1] += v * (a.y + b.y + c.y) / 4.0;
+      moment[2] += v * (a.z + b.z + c.z) / 4.0;
+    }
+  }
+
+  if (volume <= 0) {
+    *centroid = reference;
+    return 0;
+  }
+  *centroid = (Vector3){reference.x + (float)(moment[0] / volume),
+                        reference.y + (float)(moment[1] / volume),
+                        reference.z + (float)(moment[2] / volume)};
+  return (float)volume;
+}
+
+typedef struct {
+  const VolumeLloyd *v;
+  Vector3 p;
+  int slot;
+  Polyhedron *cell;
+  Polyhedron *scratch;
+} VolumeShellVisit;
+
+static void ClipCellBySlot(void *data, int k) {
+  VolumeShellVisit *visit = (VolumeShellVisit *)data;
+  if (k == visit->slot || visit->cell->numFaces == 0) {
+    return;
+  }
+
+  // Keep the side closer to p: dot(x - mid, q - p) <= 0
+  const SiteGrid3 *grid = &visit->v->grid;
+  Vector3 q = grid->sorted[k];
+  Vector3 normal = Vector3Subtract(q, visit->p);
+  Vector3 mid = Vector3Scale(Vector3Add(visit->p, q), 0.5f);
+  float offset = Vector3DotProduct(normal, mid);
+
+  // Planes that miss the cell leave it unchanged, skip the copy
+  bool32 cuts = 0;
+  const Polyhedron *cell = visit->cell;
+  for (int c = 0; c < cell->faceStart[cell->numFaces] && !cuts; c++) {
+    cuts = Vector3DotProduct(normal, cell->corners[c]) > offset;
+  }
+  if (!cuts) {
+    return;
+  }
+
+  ClipPolyhedron(visit->cell, normal, offset, grid->sortedSite[k],
+                 visit->scratch);
+  Polyhedron *swap = visit->cell;
+  visit->cell = visit->scratch;
+  visit->scratch = swap;
+}
+
+static float PolyhedronRadius(const Polyhedron *poly, Vector3 p) {
+  float radius = 0;
+  for (int c = 0; c < poly->faceStart[poly->numFaces]; c++) {
+    radius = fmaxf(radius, Vector3Distance(poly->corners[c], p));
+  }
+  return radius;
+}
+
+// Voronoi cell of sorted slot k, clipped from the box. Shells of grid cells
+// are added until they are more than twice the cell radius away, past which
+// no site can cut the cell. The result ends up in one of the two buffers and
+// is returned.
+static Polyhedron *BuildVolumeCell(const VolumeLloyd *v, int slot,
+                                   Polyhedron *buffers) {
+  VolumeShellVisit visit = {v, v->grid.sorted[slot], slot, &buffers[0],
+                            &buffers[1]};
+  BoxPolyhedron(v->box, visit.cell);
+
+  int c[3];
+  SiteGrid3Coords(&v->grid, visit.p, c);
+  for (int r = 0; VisitSiteGrid3Shell(&v->grid, c, r, ClipCellBySlot, &visit);
+       r++) {
+    if (r * v->grid.cellSize >= 2.0f * PolyhedronRadius(visit.cell, visit.p)) {
+      break;
+    }
+  }
+  return visit.cell;
+}
+
+typedef struct {
+  VolumeLloyd *v;
+} VolumeCentroidJob;
+
+static void RunVolumeCentroids(void *data, int start, int end) {
+  VolumeLloyd *v = ((VolumeCentroidJob *)data)->v;
+  Polyhedron buffers[2];
+  for (int slot = start; slot < end; slot++) {
+    Polyhedron *cell = BuildVolumeCell(v, slot, buffers);
+    int i = v->grid.sortedSite[slot];
+    v->volumes[i] =
+        PolyhedronCentroid(cell, v->grid.sorted[slot], &v->centroids[i]);
+  }
+}
+
+// One Lloyd step in 3D. Every cell is clipped on its own, so the cells split
+// across threads exactly like the planar path.
+void VolumeLloydIteration(VolumeLloyd *v) {
+  VolumeCentroidJob job = {v};
+  ParallelFor(v->numSites, 64, RunVolumeCentroids, &job);
+
+  memcpy(v->sites, v->centroids, v->numSites * sizeof(Vector3));
+  BuildSiteGrid3(&v->grid, v->sites);
+  v->iteration++;
+}
+
+// Polyhedral cell of site i, for drawing or export
+void VolumeVoronoiCell(const VolumeLloyd *v, int i, Polyhedron *cell) {
+  Polyhedron buffers[2];
+  *cell = *BuildVolumeCell(v, SiteGrid3Slot(&v->grid, i), buffers);
+}